@@ -0,0 +1,547 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "buffer.h"
+#include "db.h"
+#include "def.h"
+#include "http_fake.h"
+#include "log.h"
+#include "subs.h"
+#include "update.h"
+#include "util.h"
+#include "youtube_fake.h"
+
+#include "curses/search.h"
+#include "curses/source.h"
+#include "curses/videos.h"
+#include "curses/window/list.h"
+#include "curses/window/list_search.h"
+
+#include "window.h"
+
+const char *PROG_NAME = "bench";
+const char *CMD_NAME = NULL;
+
+enum {
+    /** Items in each page of the fake LBRY and YouTube servers. */
+    PAGE_SIZE = 20,
+};
+
+struct config {
+    const char *db_path;
+    size_t n_subs, n_videos, n_tags, n_pages, iterations;
+    /** Artificial latency of the fake servers, in milliseconds. */
+    size_t latency;
+};
+
+struct bench {
+    const struct config *c;
+    struct subs s;
+    FILE *null;
+    struct http_fake fake;
+    /** Fake and real clients, the latter through the loopback server. */
+    struct http_client http, curl;
+    struct updater youtube;
+    i64 update_sub, youtube_sub;
+    /* Arguments for each benchmark. */
+    int tag, type, sub;
+    u8 flags;
+    struct list list;
+    struct search search;
+};
+
+/* xorshift64, so that databases are reproducible. */
+static u64 rand_next(u64 *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+static double rand_unit(u64 *x) {
+    return (double)(rand_next(x) >> 11) / (double)((u64)1 << 53);
+}
+
+static u64 now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u64)t.tv_sec * 1000000000 + (u64)t.tv_nsec;
+}
+
+static double ms(u64 ns) {
+    return (double)ns / 1e6;
+}
+
+static bool exec(sqlite3 *db, const char *sql) {
+    char *err = NULL;
+    if(sqlite3_exec(db, sql, NULL, NULL, &err) == SQLITE_OK)
+        return true;
+    LOG_ERR("%s: %s\n", sql, err);
+    sqlite3_free(err);
+    return false;
+}
+
+static bool step_reset(sqlite3_stmt *stmt) {
+    const bool ret = step_stmt_once(stmt);
+    return sqlite3_reset(stmt) == SQLITE_OK && ret;
+}
+
+/**
+ * Populates the database with synthetic data.
+ * Videos are concentrated on a few subscriptions, which get up to three tags
+ * each, and a small fraction of videos are tagged individually.
+ */
+static bool generate(const struct config *c, sqlite3 *db) {
+    u64 x = 0x9e3779b97f4a7c15;
+    sqlite3_stmt *sub = NULL, *tag = NULL, *sub_tag = NULL;
+    sqlite3_stmt *video = NULL, *video_tag = NULL;
+    bool ret = false;
+    if(!(
+        exec(db, "begin")
+        && sqlite3_prepare_v3(
+            db, "insert into subs (type, ext_id, name) values (?, ?, ?)",
+            -1, 0, &sub, NULL) == SQLITE_OK
+        && sqlite3_prepare_v3(
+            db, "insert into tags (name) values (?)",
+            -1, 0, &tag, NULL) == SQLITE_OK
+        && sqlite3_prepare_v3(
+            db, "insert or ignore into subs_tags (sub, tag) values (?, ?)",
+            -1, 0, &sub_tag, NULL) == SQLITE_OK
+        && sqlite3_prepare_v3(
+            db,
+            "insert into videos"
+                " (sub, ext_id, title, timestamp, duration_seconds, watched)"
+                " values (?, ?, ?, ?, ?, ?)",
+            -1, 0, &video, NULL) == SQLITE_OK
+        && sqlite3_prepare_v3(
+            db, "insert or ignore into videos_tags (video, tag) values (?, ?)",
+            -1, 0, &video_tag, NULL) == SQLITE_OK
+    ))
+        goto end;
+    char v[64], name[64];
+    for(size_t i = 0; i != c->n_tags; ++i) {
+        snprintf(v, sizeof(v), "tag%zu", i);
+        if(!(
+            sqlite3_bind_text(tag, 1, v, -1, SQLITE_TRANSIENT) == SQLITE_OK
+            && step_reset(tag)
+        ))
+            goto end;
+    }
+    for(size_t i = 0; i != c->n_subs; ++i) {
+        snprintf(v, sizeof(v), "sub%zu", i);
+        snprintf(name, sizeof(name), "channel %zu", i);
+        if(!(
+            sqlite3_bind_int(sub, 1, i % 2 ? SUBS_YOUTUBE : SUBS_LBRY)
+                == SQLITE_OK
+            && sqlite3_bind_text(sub, 2, v, -1, SQLITE_TRANSIENT) == SQLITE_OK
+            && sqlite3_bind_text(sub, 3, name, -1, SQLITE_TRANSIENT)
+                == SQLITE_OK
+            && step_reset(sub)
+        ))
+            goto end;
+        for(u64 n = c->n_tags ? rand_next(&x) % 4 : 0; n--;)
+            if(!(
+                sqlite3_bind_int64(sub_tag, 1, (i64)i + 1) == SQLITE_OK
+                && sqlite3_bind_int64(
+                    sub_tag, 2, (i64)(rand_next(&x) % c->n_tags) + 1)
+                    == SQLITE_OK
+                && step_reset(sub_tag)
+            ))
+                goto end;
+    }
+    const i64 t0 = 1600000000;
+    for(size_t i = 0; i != c->n_videos; ++i) {
+        const double r = rand_unit(&x);
+        const i64 s = (i64)((double)c->n_subs * r * r) + 1;
+        snprintf(v, sizeof(v), "video%zu", i);
+        snprintf(name, sizeof(name), "video title %zu", i);
+        if(!(
+            sqlite3_bind_int64(video, 1, s) == SQLITE_OK
+            && sqlite3_bind_text(video, 2, v, -1, SQLITE_TRANSIENT)
+                == SQLITE_OK
+            && sqlite3_bind_text(video, 3, name, -1, SQLITE_TRANSIENT)
+                == SQLITE_OK
+            && sqlite3_bind_int64(
+                video, 4, t0 + (i64)(rand_next(&x) % 100000000)) == SQLITE_OK
+            && sqlite3_bind_int64(
+                video, 5, 60 + (i64)(rand_next(&x) % 7200)) == SQLITE_OK
+            && sqlite3_bind_int(video, 6, rand_next(&x) % 10 < 7)
+                == SQLITE_OK
+            && step_reset(video)
+        ))
+            goto end;
+        if(!c->n_tags || rand_next(&x) % 100)
+            continue;
+        if(!(
+            sqlite3_bind_int64(video_tag, 1, (i64)i + 1) == SQLITE_OK
+            && sqlite3_bind_int64(
+                video_tag, 2, (i64)(rand_next(&x) % c->n_tags) + 1)
+                == SQLITE_OK
+            && step_reset(video_tag)
+        ))
+            goto end;
+    }
+    ret = exec(db, "commit");
+end:
+    if(!ret)
+        sqlite3_exec(db, "rollback", NULL, NULL, NULL);
+    sqlite3_finalize(sub);
+    sqlite3_finalize(tag);
+    sqlite3_finalize(sub_tag);
+    sqlite3_finalize(video);
+    sqlite3_finalize(video_tag);
+    return ret;
+}
+
+/** Builds the responses of an LBRY channel with \c n_pages full pages. */
+static bool fake_channel(
+    size_t n_pages, struct buffer *strs, struct http_fake_response *v)
+{
+    char **const p = strs->p;
+    for(size_t page = 0; page != n_pages; ++page) {
+        struct buffer post = {0}, data = {0};
+        buffer_printf(
+            &post,
+            "{\"method\":\"claim_search\",\"params\":{"
+                "\"channel\":\"bench\",\"order_by\":[\"release_time\"],"
+                "\"page\":%zu}}",
+            page + 1);
+        buffer_append_str(&data, "{\"result\":{\"items\":[");
+        for(size_t i = 0; i != PAGE_SIZE; ++i) {
+            struct buffer item = {0};
+            buffer_printf(
+                &item,
+                "%s{\"claim_id\":\"bench%zu_%zu\",\"value\":{"
+                    "\"title\":\"title %zu\","
+                    "\"release_time\":\"%" PRIu64 "\","
+                    "\"video\":{\"duration\":60}},"
+                    "\"value_type\":\"stream\"}",
+                i ? "," : "", page, i, page * PAGE_SIZE + i,
+                (u64)1700000000 - page * PAGE_SIZE - i);
+            buffer_str_append_str(&data, item.p);
+            free(item.p);
+        }
+        struct buffer tail = {0};
+        buffer_printf(
+            &tail,
+            "],\"page\":%zu,\"page_size\":%d,"
+                "\"total_items\":%zu,\"total_pages\":%zu}}",
+            page + 1, PAGE_SIZE, n_pages * PAGE_SIZE, n_pages);
+        buffer_str_append_str(&data, tail.p);
+        free(tail.p);
+        p[2 * page] = post.p;
+        p[2 * page + 1] = data.p;
+        v[page] = (struct http_fake_response){
+            .method = HTTP_POST,
+            .url = "/",
+            .post_data = post.p,
+            .data = data.p,
+        };
+    }
+    return true;
+}
+
+/**
+ * Generates the pages and videos of a fake YouTube channel.
+ * Strings are added to \c strs to be freed later.
+ */
+static bool fake_youtube_channel(
+    size_t n_pages, struct buffer *strs,
+    const char **pages, struct youtube_fake_video *videos)
+{
+    for(size_t page = 0; page != n_pages; ++page) {
+        struct buffer data = {0};
+        for(size_t i = 0; i != PAGE_SIZE; ++i) {
+            const size_t n = page * PAGE_SIZE + i;
+            char id[64], line[128];
+            snprintf(id, sizeof(id), "benchyt%zu", n);
+            snprintf(line, sizeof(line), "%s title %zu\n", id, n);
+            (data.n ? buffer_str_append_str : buffer_append_str)(&data, line);
+            char *const p = strdup(id);
+            if(!p) {
+                free(data.p);
+                return LOG_ERRNO("strdup", 0), false;
+            }
+            BUFFER_APPEND(strs, &p);
+            videos[n] = (struct youtube_fake_video){
+                .id = p,
+                .timestamp = (i64)1700000000 - (i64)n,
+                .duration_seconds = 60,
+            };
+        }
+        BUFFER_APPEND(strs, &data.p);
+        pages[page] = data.p;
+    }
+    return true;
+}
+
+static bool bench_subs_list(struct bench *b) {
+    return subs_list(&b->s, 0, b->null);
+}
+
+static bool bench_subs_list_videos(struct bench *b) {
+    return subs_list_videos(&b->s, 0, b->null);
+}
+
+static bool bench_videos_query(struct bench *b) {
+    struct videos_query q;
+    if(!videos_query(
+        b->s.db, 0, b->flags, b->tag, b->type, b->sub, 0, &q
+    ))
+        return false;
+    videos_query_free(&q);
+    return true;
+}
+
+static bool bench_source_counts(struct bench *b) {
+    struct source_counts c;
+    return source_bar_query_counts(b->s.db, &c);
+}
+
+static bool bench_list_search(struct bench *b) {
+    list_move(&b->list, 0);
+    /* Nothing matches, so every line is searched. */
+    list_search_next(&b->search, &b->list, 1);
+    return true;
+}
+
+static bool setup_update(struct bench *b) {
+    const char sql[] = "delete from videos where sub == ?";
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(b->s.db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        return false;
+    const bool ret =
+        sqlite3_bind_int64(stmt, 1, b->update_sub) == SQLITE_OK
+        && step_stmt_once(stmt);
+    return sqlite3_finalize(stmt) == SQLITE_OK && ret;
+}
+
+static bool bench_update(struct bench *b) {
+    return subs_update(
+        &b->s, &b->http, UPDATE_NO_CACHE, 0, 0, 0, 1, &b->update_sub);
+}
+
+static bool setup_update_youtube(struct bench *b) {
+    const char sql[] = "delete from videos where sub == ?";
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(b->s.db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        return false;
+    const bool ret =
+        sqlite3_bind_int64(stmt, 1, b->youtube_sub) == SQLITE_OK
+        && step_stmt_once(stmt);
+    return sqlite3_finalize(stmt) == SQLITE_OK && ret;
+}
+
+static bool bench_update_youtube(struct bench *b) {
+    return updater_run(
+        &b->youtube, UPDATE_NO_CACHE, 0, 0, 0, 1, &b->youtube_sub);
+}
+
+static bool bench_update_http(struct bench *b) {
+    const char *const url = b->s.url;
+    b->s.url = b->fake.url;
+    const bool ret = subs_update(
+        &b->s, &b->curl, UPDATE_NO_CACHE, 0, 0, 0, 1, &b->update_sub);
+    b->s.url = url;
+    return ret;
+}
+
+/** Times \c n iterations of \c f and writes the result as a JSON line. */
+static bool run(
+    struct bench *b, const char *name,
+    bool (*setup)(struct bench*), bool (*f)(struct bench*))
+{
+    const size_t n = b->c->iterations;
+    u64 min = UINT64_MAX, max = 0, total = 0;
+    for(size_t i = 0; i != n; ++i) {
+        if(setup && !setup(b))
+            return false;
+        const u64 t = now();
+        if(!f(b))
+            return LOG_ERR("%s failed\n", name), false;
+        const u64 d = now() - t;
+        min = MIN(min, d);
+        max = MAX(max, d);
+        total += d;
+    }
+    printf(
+        "{\"name\":\"%s\",\"iterations\":%zu,"
+            "\"min_ms\":%.3f,\"mean_ms\":%.3f,\"max_ms\":%.3f}\n",
+        name, n, ms(min), ms(total) / (double)n, ms(max));
+    return fflush(stdout) != EOF;
+}
+
+static bool run_all(struct bench *b) {
+    struct {
+        const char *name;
+        int tag, type, sub;
+        u8 flags;
+    } const filters[] = {
+        {.name = "videos_query_all"},
+        {.name = "videos_query_untagged", .flags = VIDEOS_UNTAGGED},
+        {.name = "videos_query_tag", .tag = 1},
+        {.name = "videos_query_type", .type = SUBS_LBRY},
+        {.name = "videos_query_sub", .sub = 1},
+    };
+    if(!(
+        run(b, "subs_list", NULL, bench_subs_list)
+        && run(b, "subs_list_videos", NULL, bench_subs_list_videos)
+    ))
+        return false;
+    for(size_t i = 0; i != ARRAY_SIZE(filters); ++i) {
+        b->tag = filters[i].tag;
+        b->type = filters[i].type;
+        b->sub = filters[i].sub;
+        b->flags = filters[i].flags;
+        if(!run(b, filters[i].name, NULL, bench_videos_query))
+            return false;
+    }
+    struct videos_query q;
+    if(!(
+        run(b, "source_bar_counts", NULL, bench_source_counts)
+        && videos_query(b->s.db, 0, 0, 0, 0, 0, 0, &q)
+        && list_init(
+            &b->list, null_window_new, q.n, q.ids, q.lines, 0, 0, 80, 40)
+    ))
+        return false;
+    search_add_char(&b->search, '\x01');
+    return run(b, "list_search_next", NULL, bench_list_search)
+        && run(b, "update", setup_update, bench_update)
+        && run(b, "update_http", setup_update, bench_update_http)
+        && run(
+            b, "update_youtube", setup_update_youtube, bench_update_youtube);
+}
+
+static bool parse_size(const char *s, size_t *p) {
+    const i64 n = parse_i64(s);
+    if(n == -1)
+        return LOG_ERR("invalid number: %s\n", s), false;
+    *p = (size_t)n;
+    return true;
+}
+
+static bool parse_args(int argc, char **argv, struct config *c) {
+    for(;;)
+        switch(getopt(argc, argv, "f:s:v:t:p:l:n:h")) {
+        case -1: return true;
+        case 'f': c->db_path = optarg; break;
+        case 's': if(!parse_size(optarg, &c->n_subs)) return false; break;
+        case 'v': if(!parse_size(optarg, &c->n_videos)) return false; break;
+        case 't': if(!parse_size(optarg, &c->n_tags)) return false; break;
+        case 'p': if(!parse_size(optarg, &c->n_pages)) return false; break;
+        case 'l': if(!parse_size(optarg, &c->latency)) return false; break;
+        case 'n': if(!parse_size(optarg, &c->iterations)) return false; break;
+        case 'h':
+            printf(
+"Usage: %s [-f DB] [-s SUBS] [-v VIDEOS] [-t TAGS] [-p PAGES] [-l MS]\n"
+"          [-n N]\n"
+"\n"
+"Generates a synthetic database and times common operations on it, N times\n"
+"each.  Results are written as one JSON object per line.  Updates fetch\n"
+"PAGES pages from fake servers, which respond after MS milliseconds.  The\n"
+"LBRY server is also accessed through HTTP on a loopback port.\n",
+                PROG_NAME);
+            exit(0);
+        default: return false;
+        }
+}
+
+int main(int argc, char **argv) {
+    log_set(stderr);
+    struct config c = {
+        .db_path = ":memory:",
+        .n_subs = 1000,
+        .n_videos = 500000,
+        .n_tags = 50,
+        .n_pages = 50,
+        .iterations = 5,
+    };
+    if(!parse_args(argc, argv, &c) || !c.n_subs || !c.iterations)
+        return 1;
+    db_sqlite_init();
+    struct bench b = {.c = &c};
+    strlcpy(b.s.db_path, c.db_path, sizeof(b.s.db_path));
+    struct buffer strs = {0};
+    struct http_fake_response *const responses =
+        checked_calloc(c.n_pages, sizeof(*responses));
+    const char **const yt_pages = checked_calloc(c.n_pages, sizeof(*yt_pages));
+    struct youtube_fake_video *const yt_videos =
+        checked_calloc(c.n_pages * PAGE_SIZE, sizeof(*yt_videos));
+    bool ret = false, has_fake = false, has_youtube = false;
+    if(!(
+        (b.null = fopen("/dev/null", "w"))
+        && (!c.n_pages || (responses && yt_pages && yt_videos))
+        && buffer_resize(&strs, 2 * c.n_pages * sizeof(char*))
+        && subs_init(&b.s)
+    ))
+        goto e0;
+    memset(strs.p, 0, strs.n);
+    const u64 t = now();
+    if(!generate(&c, b.s.db))
+        goto e1;
+    printf(
+        "{\"name\":\"generate\",\"subs\":%zu,\"videos\":%zu,\"tags\":%zu,"
+            "\"ms\":%.3f}\n",
+        c.n_subs, c.n_videos, c.n_tags, ms(now() - t));
+    const struct http_fake_server server = {
+        .responses = responses,
+        .n = c.n_pages,
+        .latency = (unsigned)c.latency,
+    };
+    const struct youtube_fake_channel yt_channel = {
+        .id = "benchyt",
+        .pages = yt_pages,
+        .n_pages = c.n_pages,
+    };
+    const struct youtube_fake_server yt_server = {
+        .channels = &yt_channel,
+        .n_channels = 1,
+        .videos = yt_videos,
+        .n_videos = c.n_pages * PAGE_SIZE,
+        .channel_latency = (unsigned)c.latency,
+        .info_latency = (unsigned)c.latency,
+    };
+    http_client_init(&b.curl, 0);
+    if(!(
+        fake_channel(c.n_pages, &strs, responses)
+        && (has_fake = http_fake_init(&b.fake, &server))
+        && http_fake_listen(&b.fake)
+        && fake_youtube_channel(c.n_pages, &strs, yt_pages, yt_videos)
+        && subs_add(&b.s, SUBS_LBRY, "bench", "bench")
+    ))
+        goto e1;
+    b.update_sub = sqlite3_last_insert_rowid(b.s.db);
+    b.http = http_fake_client(&b.fake);
+    if(!(
+        subs_add(&b.s, SUBS_YOUTUBE, "benchyt", "benchyt")
+        && (has_youtube = updater_init(&b.youtube, &b.s, &b.http))
+    ))
+        goto e1;
+    b.youtube_sub = sqlite3_last_insert_rowid(b.s.db);
+    b.youtube.youtube_backend = update_youtube_fake_init(&yt_server);
+    ret = run_all(&b);
+e1:
+    if(has_youtube)
+        ret = updater_destroy(&b.youtube) && ret;
+    list_destroy(&b.list);
+    free(b.search.b.p);
+    ret = subs_destroy(&b.s) && ret;
+    http_client_destroy(&b.curl);
+    if(has_fake)
+        ret = http_fake_destroy(&b.fake) && ret;
+e0:
+    for(char **p = strs.p, **e = p + strs.n / sizeof(*p); p != e; ++p)
+        free(*p);
+    free(strs.p);
+    free(responses);
+    free(yt_pages);
+    free(yt_videos);
+    if(b.null)
+        fclose(b.null);
+    return !ret;
+}
@@ -0,0 +1,79 @@
+#include "window.h"
+
+#include "util.h"
+
+#include "curses/window/window.h"
+
+static struct window *null_window_derive(
+    struct window *w, int h, int width, int y, int x)
+{
+    (void)w;
+    return null_window_new(h, width, y, x);
+}
+
+static int null_window_int(const struct window *w) { (void)w; return 0; }
+static unsigned null_window_character(const struct window *w) {
+    (void)w;
+    return 0;
+}
+static void null_window_void(struct window *w) { (void)w; }
+static void null_window_move(struct window *w, int y, int x) {
+    (void)w, (void)y, (void)x;
+}
+static void null_window_scroll(struct window *w, int n) {
+    (void)w, (void)n;
+}
+static void null_window_attr(struct window *w, unsigned a) {
+    (void)w, (void)a;
+}
+static void null_window_box(struct window *w, unsigned v, unsigned h) {
+    (void)w, (void)v, (void)h;
+}
+static void null_window_vprint(
+    struct window *w, int y, int x, const char *restrict fmt, va_list args)
+{
+    (void)w, (void)y, (void)x, (void)fmt, (void)args;
+}
+
+struct null_window {
+    struct window base;
+    int h;
+};
+
+static int null_window_height(const struct window *w) {
+    return ((const struct null_window*)w)->h;
+}
+
+static void null_window_destroy(struct window *w) {
+    free(w);
+}
+
+struct window *null_window_new(int h, int w, int y, int x) {
+    (void)w, (void)y, (void)x;
+    struct null_window *const ret = checked_malloc(sizeof(*ret));
+    if(!ret)
+        return NULL;
+    *ret = (struct null_window){
+        .base = {
+            .new = null_window_new,
+            .derive = null_window_derive,
+            .x = null_window_int,
+            .y = null_window_int,
+            .height = null_window_height,
+            .width = null_window_int,
+            .character = null_window_character,
+            .move = null_window_move,
+            .change_attr = null_window_attr,
+            .refresh = null_window_void,
+            .redraw = null_window_void,
+            .clear = null_window_void,
+            .clear_line = null_window_void,
+            .scroll = null_window_scroll,
+            .box = null_window_box,
+            .vprint = null_window_vprint,
+            .destroy = null_window_destroy,
+        },
+        .h = h,
+    };
+    return &ret->base;
+}
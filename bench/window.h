@@ -0,0 +1,9 @@
+#ifndef SUBS_BENCH_WINDOW_H
+#define SUBS_BENCH_WINDOW_H
+
+struct window;
+
+/** A window which draws nothing, so that lists can be used without curses. */
+struct window *null_window_new(int h, int w, int y, int x);
+
+#endif
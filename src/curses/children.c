@@ -0,0 +1,119 @@
+#include "children.h"
+
+#include <sys/wait.h>
+
+#include <lauxlib.h>
+
+#include "../log.h"
+#include "../subs.h"
+#include "../unix.h"
+
+struct child {
+    pid_t pid;
+    /** Lua function called when the process exits, or \c LUA_NOREF. */
+    int ref;
+    int status;
+};
+
+pid_t children_spawn(struct children *c, const char *const *argv, int ref) {
+    const pid_t ret = spawn_process(argv[0], argv);
+    if(ret != -1) {
+        const struct child child = {.pid = ret, .ref = ref};
+        BUFFER_APPEND(&c->v, &child);
+    }
+    return ret;
+}
+
+int children_spawn_lua(lua_State *L, struct children *c, int i) {
+    const char *sh[] = {"sh", "-c", NULL, NULL};
+    const char **argv = sh;
+    switch(lua_type(L, i)) {
+    case LUA_TSTRING: sh[2] = lua_tostring(L, i); break;
+    case LUA_TTABLE: {
+        const lua_Integer n = (lua_Integer)lua_rawlen(L, i);
+        luaL_argcheck(L, 0 < n, i, "empty command");
+        argv = lua_newuserdatauv(L, (size_t)(n + 1) * sizeof(*argv), 0);
+        for(lua_Integer j = 0; j != n; ++j) {
+            /* Read without metamethods, so the table keeps it alive. */
+            if(lua_rawgeti(L, i, j + 1) != LUA_TSTRING)
+                return luaL_argerror(L, i, "expected an array of strings");
+            argv[j] = lua_tostring(L, -1);
+            lua_pop(L, 1);
+        }
+        argv[n] = NULL;
+        break;
+    }
+    default: return luaL_typeerror(L, i, "string or table");
+    }
+    int ref = LUA_NOREF;
+    if(!lua_isnoneornil(L, i + 1)) {
+        luaL_checktype(L, i + 1, LUA_TFUNCTION);
+        lua_pushvalue(L, i + 1);
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    const pid_t pid = children_spawn(c, argv, ref);
+    if(pid == -1) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        return luaL_error(L, "failed to start process");
+    }
+    lua_pushinteger(L, pid);
+    return 1;
+}
+
+/** Calls the callback with the same values that `os.execute` returns. */
+static void child_exited(lua_State *L, const struct child *c) {
+    if(c->ref == LUA_NOREF)
+        return;
+    const int status = c->status;
+    if(WIFEXITED(status)) {
+        if(WEXITSTATUS(status))
+            lua_pushnil(L);
+        else
+            lua_pushboolean(L, true);
+        lua_pushliteral(L, "exit");
+        lua_pushinteger(L, WEXITSTATUS(status));
+    } else {
+        lua_pushnil(L);
+        lua_pushliteral(L, "signal");
+        lua_pushinteger(L, WTERMSIG(status));
+    }
+    /* Errors are reported by the message handler and are not fatal. */
+    subs_lua_call_ref(L, c->ref, 3, 0);
+    luaL_unref(L, LUA_REGISTRYINDEX, c->ref);
+}
+
+/* Callbacks are called after the list is updated, since they can start new
+ * processes. */
+void children_reap(struct children *c) {
+    struct buffer *const b = &c->v;
+    struct buffer done = {0};
+    struct child *const v = b->p;
+    size_t n = b->n / sizeof(*v);
+    for(size_t i = 0; i != n;) {
+        struct child child = v[i];
+        const pid_t p = waitpid(child.pid, &child.status, WNOHANG);
+        if(!p) {
+            ++i;
+            continue;
+        }
+        v[i] = v[--n];
+        if(p != -1)
+            BUFFER_APPEND(&done, &child);
+        else {
+            LOG_ERRNO("waitpid", 0);
+            luaL_unref(c->L, LUA_REGISTRYINDEX, child.ref);
+        }
+    }
+    b->n = n * sizeof(*v);
+    const struct child *const d = done.p;
+    for(size_t i = 0, nd = done.n / sizeof(*d); i != nd; ++i)
+        child_exited(c->L, d + i);
+    free(done.p);
+}
+
+void children_destroy(struct children *c) {
+    const struct child *const v = c->v.p;
+    for(size_t i = 0, n = c->v.n / sizeof(*v); i != n; ++i)
+        luaL_unref(c->L, LUA_REGISTRYINDEX, v[i].ref);
+    free(c->v.p);
+}
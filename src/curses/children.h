@@ -0,0 +1,45 @@
+#ifndef SUBS_CURSES_CHILDREN_H
+#define SUBS_CURSES_CHILDREN_H
+
+#include <sys/types.h>
+
+#include "../buffer.h"
+
+typedef struct lua_State lua_State;
+
+/**
+ * Processes started without waiting for them.
+ * They are collected by \ref children_reap once they exit, which calls their
+ * Lua callbacks in \ref L.
+ */
+struct children {
+    lua_State *L;
+    /** Array of `struct child`. */
+    struct buffer v;
+};
+
+/**
+ * Starts a process without waiting for it.
+ * \c ref is a reference to a Lua function, or \c LUA_NOREF, called by
+ * \ref children_reap once the process exits.  It is released afterwards.
+ * \returns the process ID, or \c -1 on error.
+ */
+pid_t children_spawn(struct children *c, const char *const *argv, int ref);
+/**
+ * Lua interface to \ref children_spawn, with the arguments at index \c i.
+ * The command is either a shell command or an array with the program and its
+ * arguments, optionally followed by the callback, which receives the values
+ * `os.execute` would return.  Pushes and returns the process ID.
+ */
+int children_spawn_lua(lua_State *L, struct children *c, int i);
+/**
+ * Collects the processes which have exited and calls their callbacks.
+ * Only those started by \ref children_spawn are waited for, so that
+ * processes started and waited for elsewhere (e.g. by `os.execute`) are not
+ * affected.
+ */
+void children_reap(struct children *c);
+/** Releases the callbacks, processes still running are not waited for. */
+void children_destroy(struct children *c);
+
+#endif
@@ -10,6 +10,7 @@
 #include "../unix.h"
 #include "../util.h"
 
+#include "children.h"
 #include "input.h"
 #include "message.h"
 #include "source.h"
@@ -25,6 +26,8 @@ static log_fn *log_prev;
 
 struct private {
     struct message *message;
+    /** Processes started by `curses:spawn`. */
+    struct children children;
 };
 
 static void curses_log_fn(const char *fmt, va_list args) {
@@ -45,7 +48,7 @@ static void process_log(void) {
     attron(COLOR_PAIR(1));
     mvprintw(0, 0, "%.*s", (int)p, log);
     attron(COLOR_PAIR(0));
-    refresh();
+    wnoutrefresh(stdscr);
     log_pos = 0;
 }
 
@@ -108,7 +111,7 @@ static bool resize(
     if(!set_terminal_size())
         return false;
     clear();
-    refresh();
+    wnoutrefresh(stdscr);
     if(!update_pos(sc, message, source_bar, subs_bar, videos))
         return false;
     source_bar_resize(source_bar);
@@ -176,7 +179,8 @@ enum subs_curses_key process_key(
         for(size_t i = 0; i != n; ++i)
             if(windows[i].redraw)
                 windows[i].redraw(windows[i].data);
-        doupdate();
+        /* Repaints the whole screen on the next update. */
+        clearok(curscr, TRUE);
         break;
     case 'z' & CTRL: kill(0, SIGTSTP); break;
     case 'J': return subs_bar_next(subs_bar);
@@ -275,6 +279,10 @@ bool add_message(struct subs_curses *s, const char *msg) {
     return p && (*p = strdup(msg));
 }
 
+struct children *curses_children(struct subs_curses *s) {
+    return &P(s)->children;
+}
+
 // XXX delay reload
 bool toggle_watched(struct subs_curses *s) {
     if((s->flags = (u8)(s->flags ^ WATCHED)) & WATCHED)
@@ -322,6 +330,7 @@ bool subs_start_tui(const struct subs *s) {
     struct message message = {0};
     struct private priv = {
         .message = &message,
+        .children = {.L = s->L},
     };
     struct subs_curses sc = {
         .db = s->db,
@@ -334,6 +343,7 @@ bool subs_start_tui(const struct subs *s) {
         .db = subs_new_db_connection(s),
         .input = &input,
         .task_thread = &task_thread,
+        .open_ref = LUA_NOREF,
     };
     struct subs_bar subs_bar = {.s = &sc, .videos = &videos};
     struct source_bar source_bar = {
@@ -367,9 +377,11 @@ bool subs_start_tui(const struct subs *s) {
     sc.windows = windows;
     sc.n_windows = ARRAY_SIZE(windows);
     init_lua(s->L, &sc, &videos);
+    if(!videos_init_lua(&videos))
+        goto end;
     if(!set_terminal_size())
         goto end;
-    refresh();
+    wnoutrefresh(stdscr);
     if(!(
         update_pos(&sc, &message, &source_bar, &subs_bar, &videos)
         && source_bar_reload(&source_bar)
@@ -379,6 +391,10 @@ bool subs_start_tui(const struct subs *s) {
         goto end;
     window_enter(&sc, &windows[sc.cur_window]);
     for(;;) {
+        /* Windows only update the virtual screen, the terminal is written
+         * once all pending events have been handled. */
+        if(!input_pending(&input))
+            doupdate();
         const struct input_event e = input_process(&input);
         switch(e.type) {
         case INPUT_TYPE_QUIT:
@@ -398,6 +414,9 @@ bool subs_start_tui(const struct subs *s) {
             if(!e.task.f(e.task.p))
                 goto end;
             break;
+        case INPUT_TYPE_CHILD:
+            children_reap(&priv.children);
+            break;
         }
         if(!resize(&sc, &message, &source_bar, &subs_bar, &videos))
             goto end;
@@ -406,6 +425,7 @@ bool subs_start_tui(const struct subs *s) {
         process_log();
     }
 end:
+    children_destroy(&priv.children);
     message_destroy(&message);
     videos_destroy(&videos);
     subs_bar_destroy(&subs_bar);
@@ -12,6 +12,7 @@
 
 typedef struct lua_State lua_State;
 
+struct children;
 struct task_thread;
 struct videos;
 
@@ -42,6 +43,8 @@ char *name_with_counts(
     int width, const char *prefix, const char *title, int n0, int n1);
 bool change_window(struct subs_curses *s, size_t i);
 bool add_message(struct subs_curses *s, const char *msg);
+/** Processes started by `curses:spawn`, see children.h. */
+struct children *curses_children(struct subs_curses *s);
 bool toggle_watched(struct subs_curses *s);
 bool toggle_not_watched(struct subs_curses *s);
 void suspend_tui(void);
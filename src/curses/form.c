@@ -94,7 +94,7 @@ void form_destroy(struct form *f) {
 }
 
 void form_refresh(struct form *f) {
-    wrefresh(form_win(P(f)->f));
+    wnoutrefresh(form_win(P(f)->f));
 }
 
 void form_redraw(struct form *f) {
@@ -133,7 +133,7 @@ bool form_input(struct form *f, int c) {
     default: form_driver(cf, c); break;
     }
 end:
-    wrefresh(form_win(cf));
+    wnoutrefresh(form_win(cf));
     return true;
 }
 
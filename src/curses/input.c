@@ -12,7 +12,8 @@
 #include "const.h"
 
 bool input_init(struct input *i) {
-    const int sig_fd = setup_signalfd(make_signal_mask(SIGWINCH, 0));
+    const int sig_fd =
+        setup_signalfd(make_signal_mask(SIGWINCH, SIGCHLD, 0));
     if(sig_fd == -1)
         return false;
     int event_r, event_w;
@@ -63,9 +64,11 @@ struct input_event input_process(const struct input *i) {
         }
     }
     if(fd == sig_fd)
-        return process_signalfd(fd)
-            ? EVENT(RESIZE)
-            : EVENT(ERR);
+        switch(process_signalfd(fd)) {
+        case SIGWINCH: return EVENT(RESIZE);
+        case SIGCHLD: return EVENT(CHILD);
+        default: return EVENT(ERR);
+        }
     if(fd == event_fd) {
         struct input_event e;
         const ssize_t n = read(i->event_r, &e, sizeof(e));
@@ -82,6 +85,12 @@ struct input_event input_process(const struct input *i) {
     assert(!"invalid file descriptor");
 }
 
+bool input_pending(const struct input *i) {
+    const int fds[] = {STDIN_FILENO, i->sig_fd, i->event_r};
+    int fd = -1;
+    return poll_input_timeout(ARRAY_SIZE(fds), fds, 0, &fd) != INPUT_TIMEOUT;
+}
+
 bool input_send_event(struct input *i, struct input_event e) {
     const ssize_t n = write(i->event_w, &e, sizeof(e));
     switch(n) {
@@ -12,6 +12,8 @@ enum input_type {
     INPUT_TYPE_KEY,
     INPUT_TYPE_RESIZE,
     INPUT_TYPE_TASK,
+    /** A child process has changed state, see \ref children_reap. */
+    INPUT_TYPE_CHILD,
     INPUT_TYPE_QUIT,
 };
 
@@ -29,7 +31,10 @@ struct input {
 
 bool input_init(struct input *i);
 bool input_destroy(struct input *i);
+/** Waits for and returns the next event. */
 struct input_event input_process(const struct input *i);
+/** Whether \ref input_process would return an event without waiting. */
+bool input_pending(const struct input *i);
 bool input_send_event(struct input *i, struct input_event e);
 
 #endif
@@ -7,6 +7,7 @@
 #include "../../log.h"
 #include "../../subs.h"
 
+#include "../children.h"
 #include "../curses.h"
 #include "../message.h"
 #include "../subs.h"
@@ -73,6 +74,17 @@ static int add_message_lua(lua_State *L) {
     return 0;
 }
 
+/**
+ * Starts a process without blocking the interface.
+ * `cmd` is either a shell command or an array with the program and its
+ * arguments.  `on_exit`, if given, is called with the values `os.execute`
+ * would return once the process exits.  Returns the process ID.
+ */
+static int spawn_lua(lua_State *L) {
+    struct subs_curses *const s = *(struct subs_curses**)lua_touserdata(L, 1);
+    return children_spawn_lua(L, curses_children(s), 2);
+}
+
 static int videos_cur_item(lua_State *L) {
     struct videos *const v = *(struct videos**)lua_touserdata(L, 1);
     lua_pushinteger(L, v->list.ids[v->list.i]);
@@ -128,6 +140,8 @@ static void init_meta(lua_State *L, struct videos *videos) {
     lua_setfield(L, -2, "KEY_IGNORED");
     lua_pushcfunction(L, add_message_lua);
     lua_setfield(L, -2, "add_message");
+    lua_pushcfunction(L, spawn_lua);
+    lua_setfield(L, -2, "spawn");
     init_videos(L, videos);
     lua_setfield(L, -2, "videos");
     luaL_newmetatable(L, "shell_mode");
@@ -62,7 +62,7 @@ void menu_set_current(struct menu *m, int i) {
 }
 
 void menu_refresh(struct menu *m) {
-    wrefresh(menu_win(M(m)));
+    wnoutrefresh(menu_win(M(m)));
 }
 
 void menu_redraw(struct menu *m) {
@@ -84,6 +84,6 @@ bool menu_input(struct menu *m, int c) {
     case 'G': case KEY_END:   menu_driver(cm, REQ_LAST_ITEM);  break;
     default: return false;
     }
-    wrefresh(menu_sub(cm));
+    wnoutrefresh(menu_sub(cm));
     return true;
 }
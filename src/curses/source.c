@@ -118,15 +118,9 @@ bool source_bar_update_count(struct source_bar *b) {
     return true;
 }
 
-bool source_bar_reload(struct source_bar *b) {
-    struct subs_curses *const s = b->s;
+bool source_bar_query_counts(sqlite3 *db, struct source_counts *c) {
     const int lbry = SUBS_LBRY, youtube = SUBS_YOUTUBE;
-    sqlite3 *const db = s->db;
-    const int n_tags = b->n_tags;
-    int
-        n_videos = 0, n_unwatched = 0, n_untagged = 0, n_untagged_unwatched = 0,
-        n_lbry = 0, n_lbry_unwatched = 0,
-        n_youtube = 0, n_youtube_unwatched = 0;
+    *c = (struct source_counts){0};
     const char count_all[] = "select count(*) from videos";
     const char count_unwatched[] =
         "select count(*) from videos where watched == 0";
@@ -145,25 +139,32 @@ bool source_bar_reload(struct source_bar *b) {
     const char types[] = Q;
     const char types_unwatched[] = Q " and videos.watched == 0";
 #undef Q
-    if(!(
-        query_to_int(db, count_all, sizeof(count_all), NULL, &n_videos)
+    return query_to_int(db, count_all, sizeof(count_all), NULL, &c->videos)
         && query_to_int(
             db, count_unwatched, sizeof(count_unwatched) - 1, NULL,
-            &n_unwatched)
+            &c->unwatched)
         && query_to_int(
-            db, count_untagged, sizeof(count_untagged) - 1, NULL, &n_untagged)
+            db, count_untagged, sizeof(count_untagged) - 1, NULL,
+            &c->untagged)
         && query_to_int(
             db, count_untagged_unwatched, sizeof(count_untagged_unwatched) - 1,
-            NULL, &n_untagged_unwatched)
-        && query_to_int(db, types, sizeof(types) - 1, &lbry, &n_lbry)
-        && query_to_int(db, types, sizeof(types) - 1, &youtube, &n_youtube)
+            NULL, &c->untagged_unwatched)
+        && query_to_int(db, types, sizeof(types) - 1, &lbry, &c->lbry)
+        && query_to_int(db, types, sizeof(types) - 1, &youtube, &c->youtube)
         && query_to_int(
             db, types_unwatched, sizeof(types_unwatched) - 1,
-            &lbry, &n_lbry_unwatched)
+            &lbry, &c->lbry_unwatched)
         && query_to_int(
             db, types_unwatched, sizeof(types_unwatched) - 1,
-            &youtube, &n_youtube_unwatched)
-    ))
+            &youtube, &c->youtube_unwatched);
+}
+
+bool source_bar_reload(struct source_bar *b) {
+    struct subs_curses *const s = b->s;
+    sqlite3 *const db = s->db;
+    const int n_tags = b->n_tags;
+    struct source_counts c;
+    if(!source_bar_query_counts(db, &c))
         return false;
     const int n_special = 2, n_sections = 2, n_types = 2, null_term = 1;
     const int n = n_special + n_sections + n_tags + n_types + null_term;
@@ -175,11 +176,12 @@ bool source_bar_reload(struct source_bar *b) {
         goto err1;
     const int text_width = b->width - 4;
     const int i_tags = UNTAGGED + 1, i_types = i_tags + n_tags + 1;
-    lines[ALL] = name_with_counts(text_width, "", "all", n_unwatched, n_videos);
+    lines[ALL] =
+        name_with_counts(text_width, "", "all", c.unwatched, c.videos);
     lines[TAGS] = strdup("tags");
     lines[UNTAGGED] =
         name_with_counts(text_width, "  ", "[untagged]",
-        n_untagged_unwatched, n_untagged);
+        c.untagged_unwatched, c.untagged);
     const char tags[] =
         "select"
             " tags.id, name, count(tags.id) filter (where videos.watched == 0),"
@@ -197,9 +199,9 @@ bool source_bar_reload(struct source_bar *b) {
         goto err2;
     lines[i_types - 1] = strdup("types");
     lines[i_types + 0] = name_with_counts(
-        text_width, "  ", "lbry", n_lbry_unwatched, n_lbry);
+        text_width, "  ", "lbry", c.lbry_unwatched, c.lbry);
     lines[i_types + 1] = name_with_counts(
-        text_width, "  ", "youtube", n_youtube_unwatched, n_youtube);
+        text_width, "  ", "youtube", c.youtube_unwatched, c.youtube);
     ids[i_types + 0] = SUBS_LBRY;
     ids[i_types + 1] = SUBS_YOUTUBE;
     if(!list_init(
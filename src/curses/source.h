@@ -15,6 +15,12 @@
 struct subs;
 struct subs_curses;
 
+/** Video counts displayed in the fixed entries of the source bar. */
+struct source_counts {
+    int videos, unwatched, untagged, untagged_unwatched;
+    int lbry, lbry_unwatched, youtube, youtube_unwatched;
+};
+
 struct source_bar {
     struct subs_curses *s;
     struct subs_bar *subs_bar;
@@ -26,6 +32,7 @@ struct source_bar {
 
 void source_bar_update_title(struct source_bar *b);
 bool source_bar_update_count(struct source_bar *b);
+bool source_bar_query_counts(sqlite3 *db, struct source_counts *c);
 bool source_bar_reload(struct source_bar *b);
 void source_bar_destroy(struct source_bar *b);
 bool source_bar_leave(void *data);
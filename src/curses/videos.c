@@ -8,6 +8,7 @@
 
 #include "../buffer.h"
 #include "../log.h"
+#include "../query.h"
 #include "../subs.h"
 #include "../task.h"
 
@@ -22,24 +23,20 @@
         " subs.name, videos.title," \
         " videos.timestamp, videos.duration_seconds"
 
-enum order {
-    ORDER_TIMESTAMP, ORDER_ID, ORDER_SUB, ORDER_TITLE, ORDER_DURATION,
-};
-
 static const char *MENU_OPTIONS[] = {
-    [ORDER_TIMESTAMP] = "timestamp",
-    [ORDER_ID] = "id",
-    [ORDER_SUB] = "subscription",
-    [ORDER_TITLE] = "title",
-    [ORDER_DURATION] = "duration",
+    [VIDEO_ORDER_TIMESTAMP] = "timestamp",
+    [VIDEO_ORDER_ID] = "id",
+    [VIDEO_ORDER_SUB] = "subscription",
+    [VIDEO_ORDER_TITLE] = "title",
+    [VIDEO_ORDER_DURATION] = "duration",
 };
 
 static const char *MENU_DESC[] = {
-    [ORDER_TIMESTAMP] = "publication date",
-    [ORDER_ID] = "database ID",
-    [ORDER_SUB] = "subscription name",
-    [ORDER_TITLE] = "video title",
-    [ORDER_DURATION] = "video duration",
+    [VIDEO_ORDER_TIMESTAMP] = "publication date",
+    [VIDEO_ORDER_ID] = "database ID",
+    [VIDEO_ORDER_SUB] = "subscription name",
+    [VIDEO_ORDER_TITLE] = "video title",
+    [VIDEO_ORDER_DURATION] = "video duration",
 };
 
 static bool reload(void *d);
@@ -101,6 +98,7 @@ static char *videos_row_to_str(sqlite3_stmt *stmt, int id_len, i64 id) {
     static const char type_str[] = {
         [SUBS_LBRY] = 'L',
         [SUBS_YOUTUBE] = 'Y',
+        [SUBS_LUA] = 'S',
         [SUBS_TYPE_MAX] = '?',
     };
     static const char watched_str[] = {'N', ' ', '?'};
@@ -134,15 +132,15 @@ static char *videos_row_to_str(sqlite3_stmt *stmt, int id_len, i64 id) {
 }
 
 static bool populate(
-    sqlite3 *db, const char *sql, size_t len, const int *param, int id_len,
-    i64 *ids, char **lines)
+    sqlite3 *db, const char *sql, size_t len, const struct video_filter *f,
+    int id_len, i64 *ids, char **lines)
 {
     bool ret = false;
     sqlite3_stmt *stmt = NULL;
     sqlite3_prepare_v3(db, sql, (int)len, 0, &stmt, NULL);
     if(!stmt)
         return false;
-    if(param && sqlite3_bind_int(stmt, 1, *param) != SQLITE_OK)
+    if(!video_filter_bind(f, stmt))
         goto end;
     for(;;) {
         switch(sqlite3_step(stmt)) {
@@ -237,45 +235,32 @@ static bool next_unwatched(struct videos *v, int count) {
     return false;
 }
 
-static bool open_item(sqlite3 *db, lua_State *L, i64 id) {
+static bool open_item(struct videos *v, i64 id) {
     const char sql[] =
         "select subs.type, videos.ext_id from videos"
         " join subs on subs.id == videos.sub"
         " where videos.id == ?";
+    lua_State *const L = v->s->L;
     sqlite3_stmt *stmt = NULL;
-    sqlite3_prepare_v3(db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    sqlite3_prepare_v3(v->s->db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
     if(!stmt)
         return false;
     bool ret = false;
     if(sqlite3_bind_int64(stmt, 1, id) != SQLITE_OK)
-        goto err0;
-    const int top = lua_gettop(L);
-    lua_pushcfunction(L, subs_lua_msgh);
+        goto end;
     for(;;) {
         switch(sqlite3_step(stmt)) {
         case SQLITE_ROW: break;
         case SQLITE_BUSY: continue;
         case SQLITE_DONE: ret = true; /* fall through */
-        default: goto err1;
-        }
-        const char *src =
-            "return function(...)\n"
-            "    assert(os.execute(table.concat({'d subs open', ...}, ' ')))\n"
-            "end\n";
-        if(luaL_loadstring(L, src) != LUA_OK) {
-            fprintf(stderr, "%s\n", lua_tostring(L, -1));
-            goto err1;
+        default: goto end;
         }
-        if(lua_pcall(L, 0, 1, 1) != LUA_OK)
-            goto err1;
         lua_pushinteger(L, sqlite3_column_int(stmt, 0));
         lua_pushstring(L, (const char*)sqlite3_column_text(stmt, 1));
-        if(lua_pcall(L, 2, 0, 1) != LUA_OK)
-            goto err1;
+        if(!subs_lua_call_ref(L, v->open_ref, 2, 0))
+            goto end;
     }
-err1:
-    lua_settop(L, top);
-err0:
+end:
     ret = (sqlite3_finalize(stmt) == SQLITE_OK) && ret;
     return ret;
 }
@@ -317,7 +302,7 @@ static enum subs_curses_key input(struct videos *v, int c, int count) {
     case 'o':
         if(!l->n)
             return true;
-        if(!open_item(v->s->db, v->s->L, v->list.ids[l->i]))
+        if(!open_item(v, v->list.ids[l->i]))
             return false;
         break;
     case 'r':
@@ -413,90 +398,47 @@ static void show_ordering_menu(struct videos *v) {
     menu_refresh(m);
 }
 
-static void build_query_common(
-    int tag, int type, int sub, u8 global_flags, u8 flags, struct buffer *b)
+static struct video_filter build_filter(
+    int tag, int type, int sub, u8 global_flags, u8 flags, u8 order)
 {
-    const bool untagged = flags & VIDEOS_UNTAGGED;
-    const bool filtered = tag || type || sub || untagged;
-    if(untagged || tag)
-        buffer_str_append_str(b,
-            " left outer join videos_tags on videos.id == videos_tags.video"
-            " left outer join subs_tags on videos.sub == subs_tags.sub");
-    if(untagged)
-        buffer_str_append_str(b,
-            " where (subs_tags.id is null and videos_tags.id is null)");
+    struct video_filter ret = {.order = order};
+    if(flags & VIDEOS_UNTAGGED)
+        ret.flags |= VIDEO_FILTER_UNTAGGED;
     else if(tag)
-        buffer_str_append_str(b,
-            " where (videos_tags.tag == ?1 or subs_tags.tag == ?1)");
+        ret.tag = tag;
     else if(type)
-        buffer_str_append_str(b, " where subs.type == ?");
+        ret.type = type;
     else if(sub)
-        buffer_str_append_str(b, " where sub == ?");
-    if(global_flags & WATCHED) {
-        if(filtered)
-            buffer_str_append_str(b, " and");
-        else
-            buffer_str_append_str(b, " where");
-        buffer_str_append_str(b, " videos.watched == 1");
-    } else if(global_flags & NOT_WATCHED) {
-        if(filtered)
-            buffer_str_append_str(b, " and");
-        else
-            buffer_str_append_str(b, " where");
-        buffer_str_append_str(b, " videos.watched == 0");
-    }
+        ret.sub = sub;
+    if(global_flags & WATCHED)
+        ret.flags |= VIDEO_FILTER_WATCHED;
+    else if(global_flags & NOT_WATCHED)
+        ret.flags |= VIDEO_FILTER_NOT_WATCHED;
+    if(flags & VIDEOS_ORDER_DESC)
+        ret.flags |= VIDEO_FILTER_DESC;
+    return ret;
 }
 
-static void build_query_count(
-    int tag, int type, int sub, u8 global_flags, u8 flags, struct buffer *b)
-{
+static void build_query_count(const struct video_filter *f, struct buffer *b) {
     buffer_append_str(b,
         "select count(*), max(videos.id), sum(videos.duration_seconds)"
         " from videos");
-    if(type)
+    if(f->type)
         buffer_str_append_str(b, " join subs on videos.sub == subs.id");
-    build_query_common(tag, type, sub, global_flags, flags, b);
+    video_filter_where(f, b);
 }
 
-static void build_query_list(
-    int tag, int type, int sub, u8 global_flags, u8 flags, u8 order,
-    struct buffer *b)
-{
+static void build_query_list(const struct video_filter *f, struct buffer *b) {
     buffer_append_str(b,
         FIELDS
         " from videos"
         " join subs on videos.sub == subs.id");
-    build_query_common(tag, type, sub, global_flags, flags, b);
-    buffer_str_append_str(b, " order by ");
-    switch(order) {
-    case ORDER_SUB:
-        buffer_str_append_str(b, "subs.name");
-        if(flags & VIDEOS_ORDER_DESC)
-            buffer_str_append_str(b, " desc");
-        buffer_str_append_str(b, ", ");
-        goto ts;
-    case ORDER_DURATION:
-        buffer_str_append_str(b, "videos.duration_seconds");
-        if(flags & VIDEOS_ORDER_DESC)
-            buffer_str_append_str(b, " desc");
-        buffer_str_append_str(b, ", ");
-        /* fallthrough */
-ts:
-    case ORDER_TIMESTAMP:
-        buffer_str_append_str(b, "videos.timestamp");
-        if(flags & VIDEOS_ORDER_DESC)
-            buffer_str_append_str(b, " desc");
-        buffer_str_append_str(b, ", ");
-        /* fallthrough */
-    case ORDER_ID: buffer_str_append_str(b, "videos.id"); break;
-    case ORDER_TITLE: buffer_str_append_str(b, "videos.title"); break;
-    }
-    if(flags & VIDEOS_ORDER_DESC)
-        buffer_str_append_str(b, " desc");
+    video_filter_where(f, b);
+    video_filter_order(f, b);
 }
 
 static bool query_counts(
-    sqlite3 *db, struct buffer *b, const int *param,
+    sqlite3 *db, struct buffer *b, const struct video_filter *f,
     int *n, int *duration_seconds, int *id_len)
 {
     bool ret = false;
@@ -504,7 +446,7 @@ static bool query_counts(
     sqlite3_prepare_v3(db, b->p, (int)b->n, 0, &stmt, NULL);
     if(!stmt)
         goto end;
-    if(param && sqlite3_bind_int(stmt, 1, *param) != SQLITE_OK)
+    if(!video_filter_bind(f, stmt))
         goto end;
     for(;;)
         switch(sqlite3_step(stmt)) {
@@ -527,17 +469,17 @@ end:
     return ret;
 }
 
-static bool reload(void *p) {
-    struct reload_data *const d = p;
-    struct videos *const v = d->v;
-    const u8 global_flags = d->global_flags, flags = d->flags;
-    const int tag = d->tag, type = d->type, sub = d->sub;
-    const int *const param = tag ? &tag : type ? &type : sub ? &sub : NULL;
-    sqlite3 *const db = v->db;
+bool videos_query(
+    sqlite3 *db, u8 global_flags, u8 flags, int tag, int type, int sub,
+    u8 order, struct videos_query *q)
+{
+    const struct video_filter f =
+        build_filter(tag, type, sub, global_flags, flags, order);
+    *q = (struct videos_query){0};
     struct buffer sql = {0};
-    build_query_count(tag, type, sub, global_flags, flags, &sql);
+    build_query_count(&f, &sql);
     int n = 0, duration_seconds = 0, id_len = 0;
-    if(!query_counts(db, &sql, param, &n, &duration_seconds, &id_len))
+    if(!query_counts(db, &sql, &f, &n, &duration_seconds, &id_len))
         goto err0;
     i64 *const ids = checked_calloc((size_t)n, sizeof(*ids));
     if(n && !ids)
@@ -546,28 +488,21 @@ static bool reload(void *p) {
     if(n && !lines)
         goto err1;
     sql.n = 0;
-    build_query_list(tag, type, sub, global_flags, flags, v->order, &sql);
-    if(!populate(db, sql.p, sql.n - 1, param, id_len, ids, lines))
+    build_query_list(&f, &sql);
+    if(!populate(db, sql.p, sql.n - 1, &f, id_len, ids, lines))
         goto err2;
-    free(d->sql.p);
-    d->n = n;
-    d->id_len = id_len;
-    d->duration_seconds = duration_seconds;
-    d->ids = ids;
-    d->lines = lines;
-    if(!input_send_event(v->input, (struct input_event){
-        .type = INPUT_TYPE_TASK,
-        .task = {.f = reload_finish, .p = d},
-    })) {
-        LOG_ERR("input_post_task_result", 0);
-        goto err3;
-    }
+    free(sql.p);
+    *q = (struct videos_query){
+        .ids = ids,
+        .lines = lines,
+        .n = n,
+        .id_len = id_len,
+        .duration_seconds = duration_seconds,
+    };
     return true;
-err3:
-    free(d);
 err2:
-    for(char **p = lines; *p; ++p)
-        free(*p);
+    for(int i = 0; i != n; ++i)
+        free(lines[i]);
     free(lines);
 err1:
     free(ids);
@@ -576,6 +511,40 @@ err0:
     return false;
 }
 
+void videos_query_free(struct videos_query *q) {
+    for(int i = 0; i != q->n; ++i)
+        free(q->lines[i]);
+    free(q->lines);
+    free(q->ids);
+}
+
+static bool reload(void *p) {
+    struct reload_data *const d = p;
+    struct videos *const v = d->v;
+    struct videos_query q;
+    if(!videos_query(
+        v->db, d->global_flags, d->flags, d->tag, d->type, d->sub, v->order,
+        &q
+    ))
+        return false;
+    free(d->sql.p);
+    d->n = q.n;
+    d->id_len = q.id_len;
+    d->duration_seconds = q.duration_seconds;
+    d->ids = q.ids;
+    d->lines = q.lines;
+    if(!input_send_event(v->input, (struct input_event){
+        .type = INPUT_TYPE_TASK,
+        .task = {.f = reload_finish, .p = d},
+    })) {
+        LOG_ERR("input_post_task_result", 0);
+        free(d);
+        videos_query_free(&q);
+        return false;
+    }
+    return true;
+}
+
 static bool reload_finish(void *p) {
     const struct reload_data d = *(struct reload_data*)p;
     free(p);
@@ -598,7 +567,20 @@ err:
     return false;
 }
 
+bool videos_init_lua(struct videos *v) {
+    const char src[] =
+        "return function(...)\n"
+        "    local cmd = table.concat({'d subs open', ...}, ' ')\n"
+        "    curses:spawn(cmd, function(ok)\n"
+        "        if not ok then curses:add_message('failed: ' .. cmd) end\n"
+        "    end)\n"
+        "end\n";
+    v->open_ref = subs_lua_ref_callback(v->s->L, "open_item", src);
+    return v->open_ref != LUA_NOREF;
+}
+
 void videos_destroy(struct videos *v) {
+    luaL_unref(v->s->L, LUA_REGISTRYINDEX, v->open_ref);
     if(v->menu.m)
         menu_destroy(&v->menu);
     list_destroy(&v->list);
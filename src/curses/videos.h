@@ -22,6 +22,13 @@ enum videos_flags {
     VIDEOS_ORDER_DESC    = 1u << 2,
 };
 
+/** Result of the queries which populate the list. */
+struct videos_query {
+    i64 *ids;
+    char **lines;
+    int n, id_len, duration_seconds;
+};
+
 struct videos {
     sqlite3 *db;
     struct subs_curses *s;
@@ -31,9 +38,17 @@ struct videos {
     struct search search;
     struct menu menu;
     int n, id_len, duration_seconds, x, y, width, height, tag, type, sub;
+    /** Registry reference to the function which opens a video. */
+    int open_ref;
     u8 flags, order;
 };
 
+/**
+ * Looks up the Lua callbacks.
+ * The `open_item(type, ext_id)` function can be defined in `init.lua`.
+ */
+bool videos_init_lua(struct videos *v);
+
 void videos_destroy(struct videos *v);
 void videos_set_untagged(struct videos *v);
 void videos_set_tag(struct videos *v, int t);
@@ -46,5 +61,13 @@ void videos_redraw(void *data);
 enum subs_curses_key videos_input(void *data, int c, int count);
 void videos_resize(struct videos *v);
 bool videos_reload(struct videos *v);
+/**
+ * Executes the queries for a given selection synchronously.
+ * \ref videos_reload does the same in the task thread.
+ */
+bool videos_query(
+    sqlite3 *db, u8 global_flags, u8 flags, int tag, int type, int sub,
+    u8 order, struct videos_query *q);
+void videos_query_free(struct videos_query *q);
 
 #endif
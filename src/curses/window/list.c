@@ -1,5 +1,8 @@
 #include "list.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <curses.h>
 
 #include "../../log.h"
@@ -32,15 +35,29 @@ static int limit_idx(const struct list *l, int i) {
     return CLAMP(i, 0, l->n - 1);
 }
 
+/** Forgets what is displayed, so that every line is written again. */
+static void invalidate_rows(struct list *l) {
+    const int h = window_height(l->sub);
+    memset(l->rows, 0, (size_t)h * sizeof(*l->rows));
+}
+
+/**
+ * Creates the windows if the geometry changed.
+ * Otherwise, the contents are kept unless \c clear is set.
+ */
 static void resize(
     struct list *l, struct window *(*window_new)(int, int, int, int),
-    int x, int y, int w, int h)
+    int x, int y, int w, int h, bool clear)
 {
     if(l->w) {
         if(l->x == x && l->y == y && l->width == w && l->height == h) {
-            window_clear(l->w);
+            if(clear) {
+                window_clear(l->w);
+                invalidate_rows(l);
+            }
             return;
         }
+        window_destroy(l->sub);
         window_destroy(l->w);
     }
     const int sh = h - 2 * BORDER_SIZE;
@@ -50,6 +67,8 @@ static void resize(
     l->w = window_new(h, w, y, x);
     l->sub = window_derive(
         l->w, sh, sw, BORDER_SIZE, BORDER_SIZE + INNER_SPACE);
+    free(l->rows);
+    l->rows = checked_calloc((size_t)MAX(sh, 1), sizeof(*l->rows));
     l->x = x;
     l->y = y;
     l->width = w;
@@ -62,40 +81,86 @@ static void limit_offset_after_resize(struct list *l) {
         ? o : offset_for_bottom_idx(l, l->i);
 }
 
-static void set_line_attr(struct window *w, int y, attr_t a) {
-    window_move(w, y, 0);
-    window_change_attr(w, (window_character(w) & A_ATTRIBUTES) | a);
+static unsigned item_attr(const struct list *l, int i) {
+    unsigned ret = 0;
+    if(i == l->i)
+        ret |= l->selected_attr;
+    if(i == l->cur)
+        ret |= A_BOLD;
+    return ret;
 }
 
-static void clear_line_attr(struct window *w, int y, attr_t a) {
+/** Updates line \c y of \ref list::sub if it is not already displayed. */
+static void draw_row(struct list *l, int y) {
+    struct window *const w = l->sub;
+    const int h = window_height(w);
+    if(y < 0 || h <= y)
+        return;
+    const int i = l->offset + y;
+    const char *const s = i < l->n ? l->lines[i] : "";
+    const size_t len = strlen(s);
+    const struct list_row r = {
+        .hash = hash_fnv1a(HASH_FNV1A_INIT, s, len),
+        .attr = i < l->n ? item_attr(l, i) : 0,
+    };
+    struct list_row *const p = l->rows + y;
+    const bool print = p->hash != r.hash;
+    if(!print && p->attr == r.attr)
+        return;
+    *p = r;
+    if(print) {
+        window_print(w, y, 0, "%s", s);
+        window_clear_line(w);
+        /* Long lines wrap into the following ones, which must be written
+         * again.  The length in bytes is a bound on the number of columns. */
+        const size_t width = (size_t)MAX(window_width(w), 1);
+        const int n = len ? (int)MIN((len - 1) / width, (size_t)h) : 0;
+        for(int j = y + 1; j <= y + n && j < h; ++j)
+            l->rows[j].hash = 0;
+        if(!r.attr)
+            return;
+    }
     window_move(w, y, 0);
-    window_change_attr(w, (window_character(w) & A_ATTRIBUTES) & ~a);
+    window_change_attr(w, r.attr);
 }
 
-static void redraw(const struct list *l) {
+static void redraw(struct list *l) {
     struct window *const w = l->sub;
-    const char *const *lines = (const char**)l->lines;
-    const int offset = l->offset;
-    const int src_height = l->n;
-    const int dst_height = window_height(w);
-    const int height = MIN(src_height, dst_height);
-    for(int i = 0; i != height; ++i) {
-        window_print(w, i, 0, "%s", lines[offset + i]);
-        window_clear_line(w);
-    }
-    set_line_attr(w, l->i - offset, l->selected_attr);
-    const int cur = l->cur;
-    if(offset <= cur && cur < l->offset + height)
-        set_line_attr(w, cur - offset, A_BOLD);
+    const int h = window_height(w);
+    for(int y = 0; y != h; ++y)
+        draw_row(l, y);
     window_refresh(w);
 }
 
+/**
+ * Changes the first item displayed.
+ * Lines still visible are scrolled instead of written again, the caller
+ * then draws the rest with \ref redraw.
+ */
+static void set_offset(struct list *l, int o) {
+    const int d = o - l->offset;
+    const int h = window_height(l->sub);
+    l->offset = o;
+    if(!d || h <= abs(d))
+        return;
+    struct list_row *const r = l->rows;
+    const size_t n = (size_t)(h - abs(d)), nd = (size_t)abs(d);
+    window_scroll(l->sub, d);
+    if(0 < d) {
+        memmove(r, r + d, n * sizeof(*r));
+        memset(r + n, 0, nd * sizeof(*r));
+    } else {
+        memmove(r + nd, r, n * sizeof(*r));
+        memset(r, 0, nd * sizeof(*r));
+    }
+}
+
 static void move_idx(struct list *l, int i) {
-    struct window *const w = l->sub;
-    clear_line_attr(w, l->i - l->offset, l->selected_attr);
-    set_line_attr(w, i - l->offset, l->selected_attr);
-    window_refresh(w);
+    const int prev = l->i;
     l->i = i;
+    draw_row(l, prev - l->offset);
+    draw_row(l, i - l->offset);
+    window_refresh(l->sub);
 }
 
 static void select_id(struct list *l, i64 id) {
@@ -133,7 +198,7 @@ static void offset(struct list *l, int d) {
     if(src == dst)
         move_idx(l, limit_idx(l, l->i + d));
     else {
-        l->offset = dst;
+        set_offset(l, dst);
         l->i += d;
         redraw(l);
     }
@@ -154,7 +219,7 @@ bool list_init(
     l->n = n;
     if(!l->selected_attr)
         l->selected_attr = NOT_SELECTED_ATTR;
-    resize(l, window_new, x, y, width, height);
+    resize(l, window_new, x, y, width, height, false);
     l->i = n ? limit_idx(l, l->i) : 0;
     l->cur = -1;
     limit_offset_after_resize(l);
@@ -163,8 +228,8 @@ bool list_init(
         select_id(l, prev_id);
         if(prev_cur != -1)
             restore_cur(l, prev_cur);
-        redraw(l);
     }
+    redraw(l);
     window_box(l->w, 0, 0);
     return true;
 }
@@ -172,8 +237,10 @@ bool list_init(
 void list_destroy(struct list *l) {
     free(l->ids);
     free(l->lines);
+    free(l->rows);
     l->ids = NULL;
     l->lines = NULL;
+    l->rows = NULL;
     if(l->w) {
         window_destroy(l->w), l->w = NULL;
         window_destroy(l->sub), l->sub = NULL;
@@ -199,10 +266,9 @@ void list_resize(
     window_new = window_new ? window_new
         : l->w ? l->w->new
         : NULL;
-    resize(l, window_new, x, y, width, height);
+    resize(l, window_new, x, y, width, height, true);
     limit_offset_after_resize(l);
-    if(l->n)
-        redraw(l);
+    redraw(l);
     window_box(l->w, 0, 0);
 }
 
@@ -214,7 +280,7 @@ void list_move(struct list *l, int i) {
     if(o <= i && i < o + h)
         move_idx(l, i);
     else {
-        l->offset = (i < o) ? i : offset_for_bottom_idx(l, i);
+        set_offset(l, (i < o) ? i : offset_for_bottom_idx(l, i));
         l->i = i;
         redraw(l);
     }
@@ -242,12 +308,9 @@ enum subs_curses_key list_input(struct list *l, int c, int count) {
 }
 
 void list_set_active(struct list *l, bool a) {
-    struct window *const w = l->sub;
-    const int i = l->i;
-    clear_line_attr(w, i, l->selected_attr);
     l->selected_attr = a ? SELECTED_ATTR : NOT_SELECTED_ATTR;
-    set_line_attr(w, i, l->selected_attr);
-    window_refresh(w);
+    draw_row(l, l->i - l->offset);
+    window_refresh(l->sub);
 }
 
 void list_set_name(struct list *l, const char *restrict fmt, ...) {
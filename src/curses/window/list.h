@@ -13,6 +13,13 @@ enum {
     LIST_BORDER_SIZE = 1,
 };
 
+/** State of a line of the screen, see \ref list::rows. */
+struct list_row {
+    /** Hash of the text, \c 0 if unknown. */
+    u64 hash;
+    unsigned attr;
+};
+
 /**
  * A list containing one text item per line.
  *
@@ -53,6 +60,12 @@ struct list {
     int height;
     /** Attribute used to highlight the selected item. */
     unsigned selected_attr;
+    /**
+     * What is currently displayed in each line of \ref sub.
+     * Only lines which differ from the items they should display are
+     * written.
+     */
+    struct list_row *rows;
 };
 
 bool list_init(
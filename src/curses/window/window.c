@@ -59,12 +59,18 @@ static void window_curses_change_attr(struct window *w, unsigned c) {
     wchgat(window_curses_handle(w), -1, c, 0, NULL);
 }
 
+/** Updates the virtual screen, which the main loop writes once per frame. */
 static void window_curses_refresh(struct window *w) {
-    wrefresh(window_curses_handle(w));
+    wnoutrefresh(window_curses_handle(w));
 }
 
+/**
+ * Marks the whole window as changed, e.g. after an overlapping window is
+ * removed.  Only the cells which differ from the screen are sent on the next
+ * refresh (unlike `redrawwin`, which assumes the screen is corrupted).
+ */
 static void window_curses_redraw(struct window *w) {
-    redrawwin((WINDOW*)window_curses_handle(w));
+    touchwin((WINDOW*)window_curses_handle(w));
 }
 
 static void window_curses_clear(struct window *w) {
@@ -75,6 +81,13 @@ static void window_curses_clear_line(struct window *w) {
     wclrtoeol(window_curses_handle(w));
 }
 
+static void window_curses_scroll(struct window *w, int n) {
+    WINDOW *const cw = window_curses_handle(w);
+    scrollok(cw, TRUE);
+    wscrl(cw, n);
+    scrollok(cw, FALSE);
+}
+
 static void window_curses_box(struct window *w, unsigned v_ch, unsigned h_ch) {
     box(window_curses_handle(w), v_ch, h_ch);
 }
@@ -94,6 +107,8 @@ static void window_curses_destroy(struct window *w) {
 
 static struct window_curses window_curses_new(WINDOW *w) {
     assert(w);
+    /* Allows scrolling to use the terminal's line insertion/deletion. */
+    idlok(w, TRUE);
     return (struct window_curses){
         .w = {
             .new = window_new_curses,
@@ -110,6 +125,7 @@ static struct window_curses window_curses_new(WINDOW *w) {
             .redraw = window_curses_redraw,
             .clear = window_curses_clear,
             .clear_line = window_curses_clear_line,
+            .scroll = window_curses_scroll,
             .box = window_curses_box,
             .vprint = window_curses_vprint,
             .destroy = window_curses_destroy,
@@ -18,6 +18,7 @@ struct window {
     void (*redraw)(struct window*);
     void (*clear)(struct window*);
     void (*clear_line)(struct window*);
+    void (*scroll)(struct window*, int);
     void (*box)(struct window*, unsigned, unsigned);
     void (*vprint)(
         struct window*, int, int, const char *restrict, va_list args);
@@ -44,6 +45,9 @@ static inline void window_refresh(struct window *w) { (w->refresh)(w); }
 static inline void window_redraw(struct window *w) { (w->redraw)(w); }
 static inline void window_clear(struct window *w) { (w->clear)(w); }
 static inline void window_clear_line(struct window *w) { w->clear_line(w); }
+static inline void window_scroll(struct window *w, int n) {
+    (w->scroll)(w, n);
+}
 static inline void window_destroy(struct window *w) { w->destroy(w); }
 
 static inline struct window *window_derive(
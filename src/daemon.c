@@ -0,0 +1,324 @@
+#include "subs.h"
+
+#include <limits.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "buffer.h"
+#include "http.h"
+#include "log.h"
+#include "unix.h"
+#include "update.h"
+#include "util.h"
+
+enum {
+    /** Maximum length of a request, including the terminating new line. */
+    MAX_REQUEST = 256,
+    /** Minimum time before a failed update is retried. */
+    RETRY_DELAY = 5 * 60,
+};
+
+struct daemon {
+    const struct subs *s;
+    struct http_client http;
+    struct updater u;
+    sqlite3_stmt *next_stmt;
+    int sig_fd, sock_fd, interval;
+    size_t n_runs, n_errors;
+    time_t last_run, next_run, retry;
+    bool quit, running, err;
+};
+
+static bool daemon_init(
+    struct daemon *d, const struct subs *s, const char *path, int interval,
+    const struct rate_limiter *rate);
+static bool daemon_destroy(struct daemon *d, const char *path);
+static bool daemon_schedule(struct daemon *d);
+static bool daemon_run(struct daemon *d, u32 flags);
+static enum input_result daemon_wait(struct daemon *d, int timeout);
+static bool daemon_accept(struct daemon *d);
+
+const char *subs_daemon_socket_path(
+    char v[static SUBS_MAX_PATH], const char *path)
+{
+    if(path)
+        return path;
+    const char *const dir = getenv("XDG_RUNTIME_DIR");
+    if(!dir) {
+        log_err("XDG_RUNTIME_DIR not set, socket path must be specified\n");
+        return NULL;
+    }
+    return join_path(v, 2, dir, "/subs.sock");
+}
+
+bool subs_daemon(
+    const struct subs *s, const char *path, int interval,
+    const struct rate_limiter rate[static SUBS_TYPE_MAX])
+{
+    struct daemon d;
+    if(!daemon_init(&d, s, path, interval, rate))
+        return false;
+    bool ret = false;
+    while(!d.quit) {
+        if(!daemon_schedule(&d))
+            goto end;
+        const time_t now = time(NULL);
+        const i64 wait = d.next_run <= now ? 0 : (i64)(d.next_run - now);
+        const int timeout = (int)MIN(wait, INT_MAX / 1000) * 1000;
+        switch(daemon_wait(&d, timeout)) {
+        case INPUT_TIMEOUT: daemon_run(&d, UPDATE_SCHEDULE); break;
+        case INPUT_FD: break;
+        default: goto end;
+        }
+        if(d.err)
+            goto end;
+    }
+    ret = true;
+end:
+    ret = daemon_destroy(&d, path) && ret;
+    return ret;
+}
+
+/**
+ * Handles signals and requests which arrive while an update is running.
+ * Updates are stopped when the daemon is asked to quit.
+ */
+static bool daemon_poll(void *p) {
+    struct daemon *const d = p;
+    for(;;)
+        switch(daemon_wait(d, 0)) {
+        case INPUT_TIMEOUT: return !d->quit;
+        case INPUT_FD: continue;
+        default: d->err = true; return false;
+        }
+}
+
+static bool daemon_init(
+    struct daemon *d, const struct subs *s, const char *path, int interval,
+    const struct rate_limiter *rate)
+{
+    *d = (struct daemon){.s = s, .interval = interval};
+    const char sql[] =
+        "select min(next_update) from subs where disabled == 0";
+    sqlite3_prepare_v3(
+        s->db, sql, sizeof(sql) - 1, SQLITE_PREPARE_PERSISTENT,
+        &d->next_stmt, NULL);
+    if(!d->next_stmt)
+        return false;
+    http_client_init(&d->http, 0);
+    if(!updater_init(&d->u, s, &d->http))
+        goto e0;
+    memcpy(d->u.rate, rate, sizeof(d->u.rate));
+    d->u.poll = daemon_poll;
+    d->u.poll_data = d;
+    d->sig_fd = setup_signalfd(make_signal_mask(SIGINT, SIGTERM, 0));
+    if(d->sig_fd == -1)
+        goto e1;
+    if((d->sock_fd = unix_socket_listen(path)) == -1)
+        goto e2;
+    if(s->log_level)
+        fprintf(stderr, "listening on %s\n", path);
+    return true;
+e2:
+    if(close(d->sig_fd) == -1)
+        LOG_ERRNO("close", 0);
+e1:
+    updater_destroy(&d->u);
+e0:
+    http_client_destroy(&d->http);
+    sqlite3_finalize(d->next_stmt);
+    return false;
+}
+
+static bool daemon_destroy(struct daemon *d, const char *path) {
+    bool ret = true;
+    if(close(d->sock_fd) == -1)
+        LOG_ERRNO("close", 0), ret = false;
+    if(unlink(path) == -1)
+        LOG_ERRNO("unlink", 0), ret = false;
+    if(close(d->sig_fd) == -1)
+        LOG_ERRNO("close", 0), ret = false;
+    ret = updater_destroy(&d->u) && ret;
+    http_client_destroy(&d->http);
+    ret = sqlite3_finalize(d->next_stmt) == SQLITE_OK && ret;
+    return ret;
+}
+
+/**
+ * Determines when the next update should happen.
+ * That is when the first subscription becomes due, but at least every
+ * `interval` seconds so that new subscriptions are eventually picked up.
+ * Subscriptions which fail are rescheduled individually, a run which fails as
+ * a whole is not retried immediately.
+ */
+static bool daemon_schedule(struct daemon *d) {
+    sqlite3_stmt *const stmt = d->next_stmt;
+    time_t next = time(NULL) + d->interval;
+    bool ret = false;
+    for(;;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_ROW:
+            if(sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+                next = MIN(next, (time_t)sqlite3_column_int64(stmt, 0));
+            ret = true;
+            goto end;
+        default: goto end;
+        }
+end:
+    ret = sqlite3_reset(stmt) == SQLITE_OK && ret;
+    if(ret)
+        d->next_run = MAX(next, d->retry);
+    return ret;
+}
+
+/**
+ * Runs one update pass, failures are recorded but do not stop the daemon.
+ * \returns whether every subscription was updated
+ */
+static bool daemon_run(struct daemon *d, u32 flags) {
+    d->running = true;
+    const bool ret =
+        updater_run(&d->u, flags | UPDATE_KEEP_GOING, -1, 0, 0, 0, NULL);
+    d->running = false;
+    d->last_run = time(NULL);
+    ++d->n_runs;
+    d->retry = ret ? 0 : d->last_run + MIN(d->interval, RETRY_DELAY);
+    if(ret && !d->u.n_failed)
+        return true;
+    ++d->n_errors;
+    return false;
+}
+
+/**
+ * Waits up to `timeout` milliseconds for a signal or a request and handles it.
+ * \returns \c INPUT_TIMEOUT if nothing arrived, \c INPUT_FD if an event was
+ * handled, another value on fatal errors
+ */
+static enum input_result daemon_wait(struct daemon *d, int timeout) {
+    const int fds[] = {d->sig_fd, d->sock_fd};
+    int fd = -1;
+    const enum input_result ret =
+        poll_input_timeout(ARRAY_SIZE(fds), fds, timeout, &fd);
+    if(ret != INPUT_FD)
+        return ret;
+    if(fd == d->sig_fd) {
+        if(!process_signalfd(fd))
+            return INPUT_ERR;
+        d->quit = true;
+    } else if(!daemon_accept(d))
+        return INPUT_ERR;
+    return ret;
+}
+
+static bool send_str(int fd, const char *s) {
+    const size_t n = strlen(s);
+    const ssize_t nw = send(fd, s, n, MSG_NOSIGNAL);
+    if(nw == -1)
+        return LOG_ERRNO("send", 0), false;
+    if((size_t)nw != n)
+        return LOG_ERR("short write: %zd != %zu\n", nw, n), false;
+    return true;
+}
+
+static bool read_request(int fd, char v[static MAX_REQUEST]) {
+    size_t n = 0;
+    for(;;) {
+        const ssize_t nr = recv(fd, v + n, MAX_REQUEST - n, 0);
+        if(nr == -1)
+            return LOG_ERRNO("recv", 0), false;
+        char *const nl = memchr(v + n, '\n', (size_t)nr);
+        n += (size_t)nr;
+        if(nl) {
+            *nl = 0;
+            return true;
+        }
+        if(!nr || n == MAX_REQUEST)
+            return LOG_ERR("invalid request\n", 0), false;
+    }
+}
+
+static bool handle_request(struct daemon *d, int fd, const char *req) {
+    char v[MAX_REQUEST + 64];
+    if(strcmp(req, "update now") == 0) {
+        if(d->running)
+            return send_str(fd, "error: update in progress\n");
+        return send_str(fd, daemon_run(d, 0) ? "ok\n" : "error\n");
+    }
+    if(strcmp(req, "status") == 0) {
+        snprintf(
+            v, sizeof(v),
+            "running: %d\nruns: %zu\nerrors: %zu\n"
+            "last run: %jd\nnext run: %jd\n",
+            d->running, d->n_runs, d->n_errors,
+            (intmax_t)d->last_run, (intmax_t)d->next_run);
+        return send_str(fd, v);
+    }
+    if(strcmp(req, "stop") == 0) {
+        d->quit = true;
+        return send_str(fd, "ok\n");
+    }
+    snprintf(v, sizeof(v), "error: invalid request: %s\n", req);
+    return send_str(fd, v);
+}
+
+/**
+ * Processes a single request from a client.
+ * Errors in the connection are logged and the client is dropped, only errors
+ * in the listening socket itself are fatal.
+ */
+static bool daemon_accept(struct daemon *d) {
+    const int fd = accept(d->sock_fd, NULL, NULL);
+    if(fd == -1)
+        return LOG_ERRNO("accept", 0), false;
+    /* Do not let a misbehaving client block updates. */
+    const struct timeval timeout = {.tv_sec = 1};
+    if(setsockopt(
+        fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1
+    )
+        LOG_ERRNO("setsockopt", 0);
+    char req[MAX_REQUEST];
+    if(read_request(fd, req))
+        handle_request(d, fd, req);
+    if(close(fd) == -1)
+        LOG_ERRNO("close", 0);
+    return true;
+}
+
+bool subs_daemon_send(const char *path, const char *req, FILE *f) {
+    const int fd = unix_socket_connect(path);
+    if(fd == -1)
+        return false;
+    bool ret = false;
+    char v[MAX_REQUEST];
+    const int n = snprintf(v, sizeof(v), "%s\n", req);
+    if(n < 0 || sizeof(v) <= (size_t)n) {
+        LOG_ERR("request too long: %s\n", req);
+        goto end;
+    }
+    if(!send_str(fd, v))
+        goto end;
+    bool error = false;
+    for(bool first = true;; first = false) {
+        const ssize_t nr = recv(fd, v, sizeof(v), 0);
+        if(nr == -1) {
+            LOG_ERRNO("recv", 0);
+            goto end;
+        }
+        if(!nr)
+            break;
+        if(first)
+            error = strncmp(v, "error", MIN((size_t)nr, 5)) == 0;
+        if(fwrite(v, 1, (size_t)nr, f) != (size_t)nr) {
+            LOG_ERRNO("fwrite", 0);
+            goto end;
+        }
+    }
+    ret = !error;
+end:
+    if(close(fd) == -1)
+        LOG_ERRNO("close", 0), ret = false;
+    return ret;
+}
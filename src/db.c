@@ -26,6 +26,59 @@ bool db_sqlite_init(void) {
     return true;
 }
 
+static int user_version(sqlite3 *db) {
+    const char sql[] = "pragma user_version";
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        return -1;
+    int ret = -1;
+    for(;;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_ROW: ret = sqlite3_column_int(stmt, 0); /* fallthrough */
+        default: goto end;
+        }
+end:
+    if(sqlite3_finalize(stmt) != SQLITE_OK)
+        ret = -1;
+    return ret;
+}
+
+/**
+ * Applies schema changes which cannot be expressed as `if not exists`.
+ * Each entry is executed once, in order, and the number of entries applied is
+ * recorded in `user_version`.
+ */
+static bool migrate(sqlite3 *db) {
+    static const char *const migrations[] = {
+        "alter table subs"
+            " add column next_update integer not null default(0);",
+        "alter table subs"
+            " add column failures integer not null default(0);",
+    };
+    const int n = (int)ARRAY_SIZE(migrations);
+    const int version = user_version(db);
+    if(version == -1)
+        return false;
+    if(n < version) {
+        LOG_ERR("unknown database version: %d\n", version);
+        return false;
+    }
+    if(version == n)
+        return true;
+    struct buffer b = {0};
+    buffer_append_str(&b, "begin;");
+    for(int i = version; i != n; ++i)
+        buffer_str_append_str(&b, migrations[i]);
+    char end[64];
+    snprintf(end, sizeof(end), "pragma user_version = %d; commit;", n);
+    buffer_str_append_str(&b, end);
+    const bool ret = sqlite3_exec(db, b.p, NULL, NULL, NULL) == SQLITE_OK;
+    free(b.p);
+    return ret;
+}
+
 sqlite3 *db_init(const char *path) {
     sqlite3 *ret = NULL;
     if(sqlite3_open(path, &ret) != SQLITE_OK)
@@ -55,6 +108,8 @@ sqlite3 *db_init(const char *path) {
         ");"
         " create unique index if not exists videos_sub_ext_id"
             " on videos (sub, ext_id);"
+        " create index if not exists videos_timestamp"
+            " on videos (timestamp);"
         " create table if not exists tags ("
             "id integer primary key autoincrement not null,"
             " name text not null"
@@ -75,6 +130,33 @@ sqlite3 *db_init(const char *path) {
             " foreign key(tag) references tags(id)"
             " constraint unique_videos_tags_video_tag unique(video, tag)"
         ");"
+        " create table if not exists update_cache ("
+            "sub integer not null,"
+            " page integer not null,"
+            " hash integer not null,"
+            " foreign key(sub) references subs(id),"
+            " constraint unique_update_cache_sub_page unique(sub, page)"
+        ");"
+        " create table if not exists update_progress ("
+            "sub integer primary key not null,"
+            " depth integer not null,"
+            " page integer not null,"
+            " n_pages integer not null,"
+            " foreign key(sub) references subs(id)"
+        ");"
+        " create table if not exists update_runs ("
+            "id integer primary key,"
+            " time integer not null,"
+            " wall_ms real not null,"
+            " fetch_ms real not null,"
+            " parse_ms real not null,"
+            " probe_ms real not null,"
+            " insert_ms real not null,"
+            " n_subs integer not null,"
+            " n_requests integer not null,"
+            " n_statements integer not null,"
+            " stats text not null"
+        ");"
         " create index if not exists subs_tags_sub"
             " on subs_tags (sub);"
         " create index if not exists subs_tags_tag"
@@ -87,7 +169,10 @@ sqlite3 *db_init(const char *path) {
             " on videos_tags (tag);"
         " create unique index if not exists videos_tags_video_tag"
             " on videos_tags (video, tag);";
-    if(sqlite3_exec(ret, tables, NULL, NULL, NULL) != SQLITE_OK) {
+    if(
+        sqlite3_exec(ret, tables, NULL, NULL, NULL) != SQLITE_OK
+        || !migrate(ret)
+    ) {
         if(sqlite3_close(ret) != SQLITE_OK)
             LOG_ERR("failed to close sqlite database\n", 0);
         return NULL;
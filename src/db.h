@@ -8,12 +8,13 @@
 #include <sqlite3.h>
 
 struct buffer;
+struct output;
 
 void query_add_param_list(struct buffer *b, size_t n);
 static bool step_stmt_once(sqlite3_stmt *stmt);
-static int db_print_row(void *data, int n, char **cols, char **names);
 static bool write_stmt(
-    sqlite3_stmt *stmt, FILE *f, void fmt(sqlite3_stmt*, FILE*));
+    sqlite3_stmt *stmt, struct output *o,
+    void fmt(sqlite3_stmt*, struct output*));
 bool db_sqlite_init(void);
 sqlite3 *db_init(const char *path);
 int exists_query(sqlite3 *db, const char *sql, int len, const int *param);
@@ -29,24 +30,13 @@ static inline bool step_stmt_once(sqlite3_stmt *stmt) {
         }
 }
 
-static inline int db_print_row(void *data, int n, char **cols, char **names) {
-    (void)names;
-    if(!n)
-        return SQLITE_OK;
-    FILE *const f = data;
-    fputs(*cols, f);
-    for(int i = 1; i != n; ++i)
-        fputs(" ", f), fputs(cols[i], f);
-    putc('\n', f);
-    return SQLITE_OK;
-}
-
 static inline bool write_stmt(
-    sqlite3_stmt *stmt, FILE *f, void fmt(sqlite3_stmt*, FILE*))
+    sqlite3_stmt *stmt, struct output *o,
+    void fmt(sqlite3_stmt*, struct output*))
 {
     for(;;)
         switch(sqlite3_step(stmt)) {
-        case SQLITE_ROW: fmt(stmt, f); break;
+        case SQLITE_ROW: fmt(stmt, o); break;
         case SQLITE_BUSY: continue;
         case SQLITE_DONE: return true;
         default: return false;
@@ -0,0 +1,254 @@
+#include "export.h"
+
+#include <string.h>
+
+#include "buffer.h"
+#include "db.h"
+#include "log.h"
+#include "output.h"
+#include "subs.h"
+#include "util.h"
+
+enum column {
+    ID, SUB, TYPE, WATCHED, TIMESTAMP, DURATION_SECONDS, EXT_ID, TITLE,
+    N_COLUMNS,
+};
+
+static const struct {
+    const char *name;
+    enum export_column_type type;
+} COLUMNS[] = {
+    [ID] = {"id", EXPORT_COLUMN_I64},
+    [SUB] = {"sub", EXPORT_COLUMN_I64},
+    [TYPE] = {"type", EXPORT_COLUMN_U8},
+    [WATCHED] = {"watched", EXPORT_COLUMN_U8},
+    [TIMESTAMP] = {"timestamp", EXPORT_COLUMN_I64},
+    [DURATION_SECONDS] = {"duration_seconds", EXPORT_COLUMN_I64},
+    [EXT_ID] = {"ext_id", EXPORT_COLUMN_STR},
+    [TITLE] = {"title", EXPORT_COLUMN_STR},
+};
+
+static void put_json_str(struct output *o, const char *s, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    output_char(o, '"');
+    const char *const e = s + n;
+    for(const char *p = s; p != e; ++p) {
+        const unsigned char c = (unsigned char)*p;
+        if(c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        output_write(o, s, (size_t)(p - s));
+        s = p + 1;
+        switch(c) {
+        case '"': output_write(o, "\\\"", 2); break;
+        case '\\': output_write(o, "\\\\", 2); break;
+        case '\n': output_write(o, "\\n", 2); break;
+        case '\t': output_write(o, "\\t", 2); break;
+        default:
+            output_write(
+                o, (char[]){'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]}, 6);
+        }
+    }
+    output_write(o, s, (size_t)(e - s));
+    output_char(o, '"');
+}
+
+/** Writes a field, quoted only if necessary (RFC 4180). */
+static void put_csv_str(struct output *o, const char *s, size_t n) {
+    const char *const e = s + n;
+    const char *p = s;
+    while(p != e && !strchr(",\"\r\n", *p))
+        ++p;
+    if(p == e) {
+        output_write(o, s, n);
+        return;
+    }
+    output_char(o, '"');
+    for(p = s; p != e; ++p)
+        if(*p == '"') {
+            output_write(o, s, (size_t)(p + 1 - s));
+            s = p;
+        }
+    output_write(o, s, (size_t)(e - s));
+    output_char(o, '"');
+}
+
+static void text(sqlite3_stmt *stmt, int i, const char **p, size_t *n) {
+    const unsigned char *const s = sqlite3_column_text(stmt, i);
+    *p = s ? (const char*)s : "";
+    *n = (size_t)sqlite3_column_bytes(stmt, i);
+}
+
+static void write_ndjson(struct output *o, sqlite3_stmt *stmt) {
+    const char *s;
+    size_t n;
+    output_str(o, "{\"id\":");
+    output_i64(o, sqlite3_column_int64(stmt, ID));
+    output_str(o, ",\"sub\":");
+    output_i64(o, sqlite3_column_int64(stmt, SUB));
+    output_str(o, ",\"type\":\"");
+    output_str(o, subs_type_name(sqlite3_column_int(stmt, TYPE)));
+    output_str(o, "\",\"watched\":");
+    output_str(o, sqlite3_column_int(stmt, WATCHED) ? "true" : "false");
+    output_str(o, ",\"timestamp\":");
+    output_i64(o, sqlite3_column_int64(stmt, TIMESTAMP));
+    output_str(o, ",\"duration_seconds\":");
+    output_i64(o, sqlite3_column_int64(stmt, DURATION_SECONDS));
+    output_str(o, ",\"ext_id\":");
+    text(stmt, EXT_ID, &s, &n);
+    put_json_str(o, s, n);
+    output_str(o, ",\"title\":");
+    text(stmt, TITLE, &s, &n);
+    put_json_str(o, s, n);
+    output_str(o, "}\n");
+}
+
+static void write_csv(struct output *o, sqlite3_stmt *stmt) {
+    const char *s;
+    size_t n;
+    output_i64(o, sqlite3_column_int64(stmt, ID));
+    output_char(o, ',');
+    output_i64(o, sqlite3_column_int64(stmt, SUB));
+    output_char(o, ',');
+    output_str(o, subs_type_name(sqlite3_column_int(stmt, TYPE)));
+    output_char(o, ',');
+    output_write(o, sqlite3_column_int(stmt, WATCHED) ? "1," : "0,", 2);
+    output_i64(o, sqlite3_column_int64(stmt, TIMESTAMP));
+    output_char(o, ',');
+    output_i64(o, sqlite3_column_int64(stmt, DURATION_SECONDS));
+    output_char(o, ',');
+    text(stmt, EXT_ID, &s, &n);
+    put_csv_str(o, s, n);
+    output_char(o, ',');
+    text(stmt, TITLE, &s, &n);
+    put_csv_str(o, s, n);
+    output_char(o, '\n');
+}
+
+/**
+ * Columns of the binary format, accumulated in memory.
+ * String columns are kept as offsets and data, which are written together.
+ */
+struct columns {
+    struct buffer v[N_COLUMNS], str_data[N_COLUMNS];
+    u64 n_rows;
+};
+
+static void add_row(struct columns *c, sqlite3_stmt *stmt) {
+    for(int i = 0; i != N_COLUMNS; ++i) {
+        struct buffer *const b = c->v + i;
+        switch(COLUMNS[i].type) {
+        case EXPORT_COLUMN_I64:
+            BUFFER_APPEND(b, &(i64){sqlite3_column_int64(stmt, i)});
+            break;
+        case EXPORT_COLUMN_U8:
+            BUFFER_APPEND(b, &(u8){(u8)sqlite3_column_int(stmt, i)});
+            break;
+        case EXPORT_COLUMN_STR: {
+            struct buffer *const data = c->str_data + i;
+            const char *s;
+            size_t n;
+            text(stmt, i, &s, &n);
+            if(!b->n)
+                BUFFER_APPEND(b, &(u64){0});
+            buffer_append(data, s, n);
+            BUFFER_APPEND(b, &(u64){data->n});
+            break;
+        }
+        }
+    }
+    ++c->n_rows;
+}
+
+static size_t align(size_t n) {
+    return (n + EXPORT_ALIGN - 1) & ~(size_t)(EXPORT_ALIGN - 1);
+}
+
+/** Writes the header, the column descriptions, and the data of each column. */
+static bool write_columns(struct output *o, struct columns *c) {
+    static const char zeros[EXPORT_ALIGN] = {0};
+    struct export_header h = {
+        .version = EXPORT_VERSION,
+        .byte_order = EXPORT_BYTE_ORDER,
+        .n_rows = c->n_rows,
+        .n_columns = N_COLUMNS,
+    };
+    memcpy(h.magic, EXPORT_MAGIC, sizeof(h.magic));
+    struct export_column v[N_COLUMNS] = {0};
+    size_t offset = sizeof(h) + sizeof(v);
+    for(int i = 0; i != N_COLUMNS; ++i) {
+        if(COLUMNS[i].type == EXPORT_COLUMN_STR && !c->v[i].n)
+            BUFFER_APPEND(&c->v[i], &(u64){0});
+        strlcpy(v[i].name, COLUMNS[i].name, sizeof(v[i].name));
+        v[i].type = COLUMNS[i].type;
+        v[i].offset = offset;
+        v[i].size = c->v[i].n + c->str_data[i].n;
+        offset = align(offset + v[i].size);
+    }
+    output_write(o, &h, sizeof(h));
+    output_write(o, v, sizeof(v));
+    for(int i = 0; i != N_COLUMNS; ++i) {
+        output_write(o, c->v[i].p, c->v[i].n);
+        output_write(o, c->str_data[i].p, c->str_data[i].n);
+        output_write(o, zeros, align(v[i].size) - v[i].size);
+    }
+    return !o->err;
+}
+
+enum subs_export_format subs_parse_export_format(const char *s) {
+    if(strcmp(s, "ndjson") == 0)
+        return SUBS_EXPORT_NDJSON;
+    if(strcmp(s, "csv") == 0)
+        return SUBS_EXPORT_CSV;
+    if(strcmp(s, "binary") == 0)
+        return SUBS_EXPORT_BINARY;
+    log_err("invalid export format: %s\n", s);
+    return 0;
+}
+
+bool subs_export(
+    const struct subs *s, enum subs_export_format format, FILE *f)
+{
+    const char sql[] =
+        "select"
+            " videos.id, videos.sub, subs.type, watched,"
+            " timestamp, duration_seconds, videos.ext_id, title"
+        " from videos"
+        " join subs on subs.id == videos.sub"
+        " order by videos.id";
+    struct output o;
+    if(!output_init(&o, f))
+        return false;
+    struct columns c = {0};
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(s->db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    bool ret = false;
+    if(!stmt)
+        goto end;
+    if(format == SUBS_EXPORT_CSV)
+        output_str(
+            &o,
+            "id,sub,type,watched,timestamp,duration_seconds,ext_id,title\n");
+    for(bool done = false; !done && !o.err;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_ROW:
+            switch(format) {
+            case SUBS_EXPORT_NDJSON: write_ndjson(&o, stmt); break;
+            case SUBS_EXPORT_CSV: write_csv(&o, stmt); break;
+            case SUBS_EXPORT_BINARY: add_row(&c, stmt); break;
+            }
+            break;
+        case SQLITE_BUSY: continue;
+        case SQLITE_DONE: done = true; break;
+        default: goto end;
+        }
+    if(format == SUBS_EXPORT_BINARY && !write_columns(&o, &c))
+        goto end;
+    ret = true;
+end:
+    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
+    for(size_t i = 0; i != N_COLUMNS; ++i) {
+        free(c.v[i].p);
+        free(c.str_data[i].p);
+    }
+    return output_destroy(&o) && ret;
+}
@@ -0,0 +1,48 @@
+#ifndef SUBS_EXPORT_H
+#define SUBS_EXPORT_H
+
+#include "def.h"
+
+/**
+ * Layout of the binary export format.
+ * The file starts with an \ref export_header, followed by one
+ * \ref export_column for each column, followed by the column data.  Each
+ * column starts at a multiple of eight bytes, so that a mapped file can be
+ * accessed directly.  All integers are in the byte order of the machine that
+ * wrote the file, see \ref export_header::byte_order.
+ */
+#define EXPORT_MAGIC "SUBSVIDS"
+
+enum {
+    EXPORT_VERSION = 1,
+    EXPORT_BYTE_ORDER = 0x01020304,
+    EXPORT_ALIGN = 8,
+};
+
+enum export_column_type {
+    /** \c n_rows 64-bit integers. */
+    EXPORT_COLUMN_I64 = 1,
+    /** \c n_rows bytes. */
+    EXPORT_COLUMN_U8,
+    /**
+     * `n_rows + 1` 64-bit offsets followed by the concatenated strings.
+     * String \c i is in `[off[i], off[i + 1])`, relative to the end of the
+     * offsets, and is not null-terminated.
+     */
+    EXPORT_COLUMN_STR,
+};
+
+struct export_header {
+    char magic[8];
+    u32 version, byte_order;
+    u64 n_rows, n_columns;
+};
+
+struct export_column {
+    char name[24];
+    u32 type, reserved;
+    /** Position in the file and size of the data, in bytes. */
+    u64 offset, size;
+};
+
+#endif
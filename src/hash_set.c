@@ -0,0 +1,58 @@
+#include "hash_set.h"
+
+#include <string.h>
+
+#include "util.h"
+
+/* `0` is reserved for empty slots. */
+static u64 key(u64 h) {
+    return h ? h : 1;
+}
+
+static size_t find(const u64 *v, size_t cap, u64 h) {
+    size_t i = (size_t)h & (cap - 1);
+    while(v[i] && v[i] != h)
+        i = (i + 1) & (cap - 1);
+    return i;
+}
+
+static bool grow(struct hash_set *s) {
+    const size_t cap = s->cap ? 2 * s->cap : 64;
+    u64 *const v = checked_calloc(cap, sizeof(*v));
+    if(!v)
+        return false;
+    for(size_t i = 0; i != s->cap; ++i)
+        if(s->v[i])
+            v[find(v, cap, s->v[i])] = s->v[i];
+    free(s->v);
+    s->v = v;
+    s->cap = cap;
+    return true;
+}
+
+void hash_set_destroy(struct hash_set *s) {
+    free(s->v);
+    *s = (struct hash_set){0};
+}
+
+void hash_set_clear(struct hash_set *s) {
+    if(s->v)
+        memset(s->v, 0, s->cap * sizeof(*s->v));
+    s->n = 0;
+}
+
+bool hash_set_insert(struct hash_set *s, u64 h) {
+    h = key(h);
+    if(s->cap <= 2 * (s->n + 1) && !grow(s))
+        return false;
+    const size_t i = find(s->v, s->cap, h);
+    if(!s->v[i]) {
+        s->v[i] = h;
+        ++s->n;
+    }
+    return true;
+}
+
+bool hash_set_contains(const struct hash_set *s, u64 h) {
+    return s->cap && s->v[find(s->v, s->cap, key(h))];
+}
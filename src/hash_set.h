@@ -0,0 +1,29 @@
+#ifndef SUBS_HASH_SET_H
+#define SUBS_HASH_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "def.h"
+
+/**
+ * Set of 64-bit hashes.
+ * Only the hashes are stored, so membership is subject to (very unlikely)
+ * collisions between different keys.  Uses open addressing with linear
+ * probing, \c 0 marks an empty slot.
+ */
+struct hash_set {
+    u64 *v;
+    /** Number of elements. */
+    size_t n;
+    /** Number of slots, a power of two. */
+    size_t cap;
+};
+
+void hash_set_destroy(struct hash_set *s);
+/** Removes all elements, keeping the allocated memory. */
+void hash_set_clear(struct hash_set *s);
+bool hash_set_insert(struct hash_set *s, u64 h);
+bool hash_set_contains(const struct hash_set *s, u64 h);
+
+#endif
@@ -13,8 +13,16 @@ static size_t write_function(char *p, size_t size, size_t n, void *data) {
     return n;
 }
 
-static CURL *init_curl(const char *url, struct buffer *buffer, bool verbose) {
-    CURL *curl = curl_easy_init();
+static CURL *init_curl(
+    struct http_client *http, const char *url, struct buffer *buffer,
+    bool verbose)
+{
+    /* Reusing the handle keeps connections alive between requests. */
+    CURL *curl = http->handle;
+    if(curl)
+        curl_easy_reset(curl);
+    else if(!(http->handle = curl = curl_easy_init()))
+        return log_err("curl_easy_init failed\n"), NULL;
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "machinatrix");
     curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
@@ -28,8 +36,6 @@ static CURL *init_curl(const char *url, struct buffer *buffer, bool verbose) {
 static bool request(
     CURL *curl, const char *url, struct buffer *buffer, bool verbose)
 {
-    if(!curl)
-        curl = init_curl(url, buffer, verbose);
     char err[CURL_ERROR_SIZE] = {0};
     curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, err);
     if(verbose)
@@ -39,13 +45,20 @@ static bool request(
         log_err("%d: %s: %s\n", ret, err, *err ? err : curl_easy_strerror(ret));
     else if(verbose)
         printf("Response:\n%s\n", (const char*)buffer->p);
-    curl_easy_cleanup(curl);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, NULL);
     return ret == CURLE_OK;
 }
 
+void http_client_destroy(struct http_client *c) {
+    curl_easy_cleanup(c->handle);
+    c->handle = NULL;
+}
+
 bool http_get(void *p, const char *url, struct buffer *buffer) {
     struct http_client *const http = p;
-    return request(NULL, url, buffer, http->flags & HTTP_VERBOSE);
+    const bool verbose = http->flags & HTTP_VERBOSE;
+    CURL *const curl = init_curl(http, url, buffer, verbose);
+    return curl && request(curl, url, buffer, verbose);
 }
 
 bool http_post(
@@ -53,7 +66,9 @@ bool http_post(
 {
     struct http_client *const http = p;
     const bool verbose = http->flags & HTTP_VERBOSE;
-    CURL *const curl = init_curl(url, buffer, verbose);
+    CURL *const curl = init_curl(http, url, buffer, verbose);
+    if(!curl)
+        return false;
     curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, /*XXX*/strlen(post_data));
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data);
     return request(curl, url, buffer, false);
@@ -26,10 +26,14 @@ struct http_client {
     u32 flags;
     http_get_fn *get;
     http_post_fn *post;
+    /** Reused connection handle, see \ref http_client_destroy. */
+    void *handle;
 };
 
 static const char *http_method_str(enum http_method m);
 static void http_client_init(struct http_client *c, u32 flags);
+/** Releases the connection handle kept by the client, if any. */
+void http_client_destroy(struct http_client *c);
 bool http_get(void *p, const char *url, struct buffer *buffer);
 bool http_post(
     void *p, const char *url, const char *post_data, struct buffer *buffer);
@@ -1,64 +1,195 @@
 #include "http_fake.h"
 
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "buffer.h"
 #include "log.h"
 #include "util.h"
 
+/** A connection to the loopback server. */
+struct conn {
+    struct http_fake *f;
+    /** Closed by the connection thread, \c -1 afterwards. */
+    int fd;
+    thrd_t t;
+};
+
+/** Extracts the path from a URL, which is all the fake server matches. */
+static const char *url_path(const char *url) {
+    const char *const scheme = strstr(url, "://");
+    if(scheme)
+        url = scheme + 3;
+    const char *const slash = strchr(url, '/');
+    return slash ? slash : "/";
+}
+
+static bool matches(
+    const struct http_fake_response *p,
+    enum http_method method, const char *path, const char *post_data)
+{
+    if(p->method != method || strcmp(p->url, path) != 0)
+        return false;
+    if(method == HTTP_GET)
+        return true;
+    if(!post_data || !p->post_data)
+        return !post_data && !p->post_data;
+    return strcmp(p->post_data, post_data) == 0;
+}
+
 static const struct http_fake_response *match(
     const struct http_fake_server *s,
-    enum http_method method, const char *url, const char *post_data)
+    enum http_method method, const char *path, const char *post_data)
 {
-    const char *const slash = strchr(url, '/');
-    if(slash)
-        url = slash + 1;
-    else
-        url = "/";
     const struct http_fake_response *p = s->responses;
     const struct http_fake_response *const e = p + s->n;
-    for(; p != e; ++p) {
-        if(p->method != method)
-            continue;
-        if(strcmp(p->url, url) != 0)
-            continue;
-        if(method == HTTP_GET)
+    for(; p != e; ++p)
+        if(matches(p, method, path, post_data))
             return p;
-        if(post_data) {
-            if(!p->post_data)
-                continue;
-            if(strcmp(p->post_data, post_data) != 0)
-                continue;
-        } else if(p->post_data)
-            continue;
-        return p;
+    return NULL;
+}
+
+static u64 request_hash(
+    enum http_method method, const char *path, const char *post_data)
+{
+    u64 h = hash_fnv1a(HASH_FNV1A_INIT, &(u8){(u8)method}, 1);
+    h = hash_fnv1a(h, path, strlen(path) + 1);
+    /* Post data are ignored in GET requests, see \ref matches. */
+    if(method == HTTP_POST && post_data)
+        h = hash_fnv1a(h, post_data, strlen(post_data) + 1);
+    return h;
+}
+
+static bool build_index(struct http_fake *f) {
+    const struct http_fake_server *const s = f->s;
+    size_t cap = 8;
+    while(cap < 2 * s->n)
+        cap *= 2;
+    size_t *const v = checked_malloc(cap * sizeof(*v));
+    if(!v)
+        return false;
+    memset(v, 0xff, cap * sizeof(*v));
+    /* Duplicates are probed in table order, so the first one is found
+     * first, as in \ref match. */
+    for(size_t i = 0; i != s->n; ++i) {
+        const struct http_fake_response *const p = s->responses + i;
+        size_t j = request_hash(p->method, p->url, p->post_data) & (cap - 1);
+        while(v[j] != SIZE_MAX)
+            j = (j + 1) & (cap - 1);
+        v[j] = i;
     }
+    f->index = v;
+    f->index_cap = cap;
+    return true;
+}
+
+static const struct http_fake_response *lookup(
+    const struct http_fake *f,
+    enum http_method method, const char *path, const char *post_data)
+{
+    const struct http_fake_response *const v = f->s->responses;
+    const size_t mask = f->index_cap - 1;
+    size_t i = request_hash(method, path, post_data) & mask;
+    for(; f->index[i] != SIZE_MAX; i = (i + 1) & mask)
+        if(matches(v + f->index[i], method, path, post_data))
+            return v + f->index[i];
     return NULL;
 }
 
-static bool serve(
-    const struct http_fake_server *s,
-    enum http_method method, const char *url, const char *post_data,
-    struct buffer *b)
+/** splitmix64, which gives independent values for consecutive inputs. */
+static u64 next_random(struct http_fake *f) {
+    const u64 n = atomic_fetch_add(&f->n_requests, 1);
+    u64 x = f->s->seed + (n + 1) * 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+static void sleep_ms(unsigned ms) {
+    struct timespec t = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long)(ms % 1000) * 1000000,
+    };
+    while(nanosleep(&t, &t) == -1 && errno == EINTR);
+}
+
+/**
+ * Finds the response to a request and waits for its latency.
+ * \param f
+ *     Stateful server, or null to use only \c s.
+ * \param fail
+ *     Set if the request should fail, either explicitly or at random.
+ */
+static const struct http_fake_response *serve(
+    const struct http_fake_server *s, struct http_fake *f,
+    enum http_method method, const char *path, const char *post_data,
+    bool *fail)
 {
-    const struct http_fake_response *const ret =
-        match(s, method, url, post_data);
+    const u64 r = f ? next_random(f) : 0;
+    const struct http_fake_response *const ret = f
+        ? lookup(f, method, path, post_data)
+        : match(s, method, path, post_data);
     if(!ret) {
         log_err(
             "%s: unexpected request: %s %s (post data: %s)\n",
-            __func__, http_method_str(method), url, post_data);
-        return false;
+            __func__, http_method_str(method), path, post_data);
+        return NULL;
     }
+    unsigned ms = s->latency + ret->latency;
+    if(f && s->jitter)
+        ms += (unsigned)(r % (s->jitter + 1));
+    if(ms)
+        sleep_ms(ms);
+    *fail = ret->fail
+        || (f && s->failure_rate && (r >> 32) % 100 < s->failure_rate);
+    if(*fail)
+        log_err(
+            "%s: injected failure: %s %s\n",
+            __func__, http_method_str(method), path);
+    return ret;
+}
+
+static bool serve_direct(
+    const struct http_fake_server *s, struct http_fake *f,
+    enum http_method method, const char *url, const char *post_data,
+    struct buffer *b)
+{
+    const char *const path = url_path(url);
+    bool fail = false;
+    const struct http_fake_response *const ret =
+        serve(s, f, method, path, post_data, &fail);
+    if(!ret || fail)
+        return false;
     buffer_append_str(b, ret->data);
     return true;
 }
 
 static bool get(void *p, const char *url, struct buffer *b) {
-    return serve(p, HTTP_GET, url, NULL, b);
+    return serve_direct(p, NULL, HTTP_GET, url, NULL, b);
 }
 
 static bool post(void *p, const char *url, const char *data, struct buffer *b) {
-    return serve(p, HTTP_POST, url, data, b);
+    return serve_direct(p, NULL, HTTP_POST, url, data, b);
+}
+
+static bool fake_get(void *p, const char *url, struct buffer *b) {
+    struct http_fake *const f = p;
+    return serve_direct(f->s, f, HTTP_GET, url, NULL, b);
+}
+
+static bool fake_post(
+    void *p, const char *url, const char *data, struct buffer *b)
+{
+    struct http_fake *const f = p;
+    return serve_direct(f->s, f, HTTP_POST, url, data, b);
 }
 
 struct http_client http_client_fake_init(const struct http_fake_server *s) {
@@ -68,3 +199,253 @@ struct http_client http_client_fake_init(const struct http_fake_server *s) {
         .post = post,
     };
 }
+
+bool http_fake_init(struct http_fake *f, const struct http_fake_server *s) {
+    *f = (struct http_fake){.s = s, .listen_fd = -1};
+    return build_index(f);
+}
+
+struct http_client http_fake_client(struct http_fake *f) {
+    return (struct http_client){
+        .data = f,
+        .get = fake_get,
+        .post = fake_post,
+    };
+}
+
+/** Reads more data, keeping the buffer null-terminated. */
+static bool recv_more(int fd, struct buffer *b) {
+    enum { N = 4096 };
+    if(!buffer_reserve(b, b->n + N + 1))
+        return false;
+    ssize_t n;
+    while((n = recv(fd, (char*)b->p + b->n, N, 0)) == -1 && errno == EINTR);
+    if(n == -1 && errno != ECONNRESET)
+        LOG_ERRNO("recv", 0);
+    if(n <= 0)
+        return false;
+    b->n += (size_t)n;
+    ((char*)b->p)[b->n] = 0;
+    return true;
+}
+
+static bool send_all(int fd, const void *p, size_t n) {
+    while(n) {
+        const ssize_t nw = send(fd, p, n, MSG_NOSIGNAL);
+        if(nw == -1) {
+            if(errno == EINTR)
+                continue;
+            return LOG_ERRNO("send", 0), false;
+        }
+        p = (const char*)p + nw;
+        n -= (size_t)nw;
+    }
+    return true;
+}
+
+static bool send_str(int fd, const char *s) {
+    return send_all(fd, s, strlen(s));
+}
+
+/**
+ * Parses the request line and the relevant headers.
+ * Headers are modified in place, \c path points into them.
+ */
+static bool parse_headers(
+    char *p, enum http_method *method, char **path, size_t *len,
+    bool *expect)
+{
+    if(strncmp(p, "GET ", 4) == 0)
+        *method = HTTP_GET, p += 4;
+    else if(strncmp(p, "POST ", 5) == 0)
+        *method = HTTP_POST, p += 5;
+    else
+        return LOG_ERR("unsupported request: %.16s\n", p), false;
+    char *const space = strchr(p, ' ');
+    char *line = strstr(p, "\r\n");
+    if(!space || !line || line < space)
+        return LOG_ERR("invalid request line\n", 0), false;
+    *space = 0;
+    *path = p;
+    *len = 0;
+    *expect = false;
+    while(line && *(line += 2)) {
+        char *const end = strstr(line, "\r\n");
+        if(end)
+            *end = 0;
+        if(strncasecmp(line, "content-length:", 15) == 0) {
+            const i64 n = parse_i64(line + 15 + strspn(line + 15, " "));
+            if(n == -1)
+                return false;
+            *len = (size_t)n;
+        } else if(strncasecmp(line, "expect:", 7) == 0)
+            *expect = true;
+        line = end;
+    }
+    return true;
+}
+
+/**
+ * Reads and answers one request.
+ * \returns whether the connection should be kept open.
+ */
+static bool serve_request(
+    struct http_fake *f, int fd, struct buffer *in, struct buffer *out)
+{
+    char *end = NULL;
+    while(!in->n || !(end = strstr(in->p, "\r\n\r\n")))
+        if(!recv_more(fd, in))
+            return false;
+    *end = 0;
+    const size_t header_len = (size_t)(end + 4 - (char*)in->p);
+    enum http_method method;
+    char *path;
+    size_t len;
+    bool expect;
+    if(!parse_headers(in->p, &method, &path, &len, &expect))
+        return false;
+    if(expect && !send_str(fd, "HTTP/1.1 100 Continue\r\n\r\n"))
+        return false;
+    while(in->n < header_len + len)
+        if(!recv_more(fd, in))
+            return false;
+    out->n = 0;
+    if(method == HTTP_POST) {
+        buffer_append(out, (char*)in->p + header_len, len);
+        buffer_append(out, "", 1);
+    }
+    bool fail = false;
+    const struct http_fake_response *const r = serve(
+        f->s, f, method, path, method == HTTP_POST ? out->p : NULL, &fail);
+    if(fail)
+        return false;
+    /* Sent in a single call, a separate header would be delayed by the
+     * interaction between Nagle's algorithm and delayed acknowledgements. */
+    const char *const data = r ? r->data : "";
+    out->n = 0;
+    buffer_printf(
+        out, "HTTP/1.1 %s\r\nContent-Length: %zu\r\n\r\n",
+        r ? "200 OK" : "404 Not Found", strlen(data));
+    buffer_str_append_str(out, data);
+    if(!send_all(fd, out->p, out->n - 1))
+        return false;
+    const size_t n = header_len + len;
+    memmove(in->p, (char*)in->p + n, in->n - n + 1);
+    in->n -= n;
+    return true;
+}
+
+static int serve_conn(void *p) {
+    struct conn *const c = p;
+    struct http_fake *const f = c->f;
+    struct buffer in = {0}, out = {0};
+    while(serve_request(f, c->fd, &in, &out));
+    free(in.p);
+    free(out.p);
+    mtx_lock(&f->mtx);
+    if(close(c->fd) == -1)
+        LOG_ERRNO("close", 0);
+    c->fd = -1;
+    mtx_unlock(&f->mtx);
+    return 0;
+}
+
+static int accept_conns(void *p) {
+    struct http_fake *const f = p;
+    for(;;) {
+        const int fd = accept(f->listen_fd, NULL, NULL);
+        if(fd == -1) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            /* Woken up by \ref http_fake_destroy. */
+            if(!atomic_load(&f->stopping))
+                LOG_ERRNO("accept", 0);
+            break;
+        }
+        struct conn *const c = checked_malloc(sizeof(*c));
+        if(!c) {
+            close(fd);
+            continue;
+        }
+        *c = (struct conn){.f = f, .fd = fd};
+        mtx_lock(&f->mtx);
+        if(thrd_create(&c->t, serve_conn, c) == thrd_success)
+            BUFFER_APPEND(&f->conns, &c);
+        else {
+            LOG_ERR("failed to create thread\n", 0);
+            close(fd);
+            free(c);
+        }
+        mtx_unlock(&f->mtx);
+    }
+    return 0;
+}
+
+bool http_fake_listen(struct http_fake *f) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd == -1)
+        return LOG_ERRNO("socket", 0), false;
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if(bind(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        LOG_ERRNO("bind", 0);
+        goto err;
+    }
+    if(listen(fd, 16) == -1) {
+        LOG_ERRNO("listen", 0);
+        goto err;
+    }
+    if(getsockname(fd, (struct sockaddr*)&addr, &addr_len) == -1) {
+        LOG_ERRNO("getsockname", 0);
+        goto err;
+    }
+    snprintf(f->url, sizeof(f->url), "127.0.0.1:%u", ntohs(addr.sin_port));
+    if(mtx_init(&f->mtx, mtx_plain) != thrd_success) {
+        LOG_ERR("failed to create mutex\n", 0);
+        goto err;
+    }
+    f->listen_fd = fd;
+    if(thrd_create(&f->thread, accept_conns, f) != thrd_success) {
+        LOG_ERR("failed to create thread\n", 0);
+        mtx_destroy(&f->mtx);
+        f->listen_fd = -1;
+        goto err;
+    }
+    atomic_store(&f->listening, true);
+    return true;
+err:
+    if(close(fd) == -1)
+        LOG_ERRNO("close", 0);
+    return false;
+}
+
+bool http_fake_destroy(struct http_fake *f) {
+    bool ret = true;
+    if(atomic_load(&f->listening)) {
+        atomic_store(&f->stopping, true);
+        if(shutdown(f->listen_fd, SHUT_RDWR) == -1)
+            LOG_ERRNO("shutdown", 0), ret = false;
+        thrd_join(f->thread, NULL);
+        struct conn **const v = f->conns.p;
+        const size_t n = f->conns.n / sizeof(*v);
+        /* Idle connections are kept alive by clients, wake them up. */
+        mtx_lock(&f->mtx);
+        for(size_t i = 0; i != n; ++i)
+            if(v[i]->fd != -1)
+                shutdown(v[i]->fd, SHUT_RDWR);
+        mtx_unlock(&f->mtx);
+        for(size_t i = 0; i != n; ++i) {
+            thrd_join(v[i]->t, NULL);
+            free(v[i]);
+        }
+        free(f->conns.p);
+        mtx_destroy(&f->mtx);
+        if(close(f->listen_fd) == -1)
+            LOG_ERRNO("close", 0), ret = false;
+    }
+    free(f->index);
+    return ret;
+}
@@ -1,20 +1,74 @@
 #ifndef SUBS_HTTP_FAKE_H
 #define SUBS_HTTP_FAKE_H
 
+#include <stdatomic.h>
 #include <stddef.h>
+#include <threads.h>
 
+#include "buffer.h"
+#include "def.h"
 #include "http.h"
 
 struct http_fake_response {
     enum http_method method;
     const char *url, *post_data, *data;
+    /** Delay before the response is sent, in milliseconds. */
+    unsigned latency;
+    /** Fails the request instead of responding. */
+    bool fail;
 };
 
 struct http_fake_server {
     const struct http_fake_response *responses;
     size_t n;
+    /** Added to the latency of every response, in milliseconds. */
+    unsigned latency;
+    /**
+     * Maximum random delay added to each response, in milliseconds.
+     * Only used by \ref http_fake, like \ref failure_rate.
+     */
+    unsigned jitter;
+    /** Percentage of requests which fail at random. */
+    unsigned failure_rate;
+    /** Seed for random values, so that runs can be reproduced. */
+    u64 seed;
 };
 
+/**
+ * Stateful fake server.
+ * Responses are found with a hash table instead of a linear search, and
+ * random delays and failures are drawn from a sequence shared by all threads.
+ * The server can also listen on a loopback port, so that requests go through
+ * the real HTTP client.
+ */
+struct http_fake {
+    const struct http_fake_server *s;
+    /** Indices into the response table, \c SIZE_MAX for empty slots. */
+    size_t *index;
+    /** Number of slots in \ref index, a power of two. */
+    size_t index_cap;
+    atomic_uint_fast64_t n_requests;
+    /** Address of the loopback server, see \ref http_fake_listen. */
+    char url[32];
+    int listen_fd;
+    thrd_t thread;
+    mtx_t mtx;
+    /** Pointers to each connection, protected by \ref mtx. */
+    struct buffer conns;
+    atomic_bool listening, stopping;
+};
+
+/** Serves requests from \c s with a linear search and no random values. */
 struct http_client http_client_fake_init(const struct http_fake_server *s);
+bool http_fake_init(struct http_fake *f, const struct http_fake_server *s);
+bool http_fake_destroy(struct http_fake *f);
+/** Client which calls into the server directly. */
+struct http_client http_fake_client(struct http_fake *f);
+/**
+ * Starts serving HTTP/1.1 at \ref http_fake::url, an ephemeral loopback port.
+ * Each connection is served by a separate thread, so concurrent requests are
+ * delayed in parallel.  Failed requests close the connection.
+ */
+bool http_fake_listen(struct http_fake *f);
 
 #endif
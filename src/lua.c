@@ -1,6 +1,11 @@
 #include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
 
 #include <glob.h>
 
@@ -8,7 +13,9 @@
 #include <lua.h>
 #include <lualib.h>
 
+#include "buffer.h"
 #include "log.h"
+#include "queue.h"
 #include "subs.h"
 #include "util.h"
 
@@ -89,36 +96,286 @@ static int get_video_info(lua_State *L) {
     return get_info(L, sql, sizeof(sql) - 1);
 }
 
-static int db(lua_State *L) {
-    const struct subs *const s = from_state(L);
-    const char *const sql = lua_tostring(L, 1);
-    sqlite3_stmt *stmt = NULL;
-    sqlite3_prepare_v3(s->db, sql, -1, 0, &stmt, NULL);
-    if(!stmt)
-        return false;
-    lua_pushcfunction(L, subs_lua_msgh);
-    const int msgh = lua_gettop(L);
-    for(;;) {
+/** Statement owned by a `subs_stmt` userdata, finalized by `__gc`. */
+struct stmt {
+    sqlite3_stmt *p;
+};
+
+static void close_stmt(struct stmt *s) {
+    sqlite3_finalize(s->p);
+    s->p = NULL;
+}
+
+static sqlite3_stmt *check_stmt(lua_State *L, int i) {
+    struct stmt *const s = luaL_checkudata(L, i, "subs_stmt");
+    if(!s->p)
+        luaL_error(L, "statement is closed");
+    return s->p;
+}
+
+/**
+ * Prepares \c sql and pushes the statement.
+ * The userdata is created first, so that the statement is finalized even if
+ * a later error is raised.
+ */
+static sqlite3_stmt *new_stmt(
+    lua_State *L, sqlite3 *db, const char *sql, unsigned flags)
+{
+    struct stmt *const s = lua_newuserdatauv(L, sizeof(*s), 0);
+    s->p = NULL;
+    luaL_setmetatable(L, "subs_stmt");
+    sqlite3_prepare_v3(db, sql, -1, flags, &s->p, NULL);
+    if(!s->p)
+        luaL_error(L, "%s", sqlite3_errmsg(db));
+    return s->p;
+}
+
+static void bind_value(lua_State *L, sqlite3_stmt *stmt, int param, int i) {
+    int r = SQLITE_OK;
+    switch(lua_type(L, i)) {
+    case LUA_TNIL: r = sqlite3_bind_null(stmt, param); break;
+    case LUA_TBOOLEAN:
+        r = sqlite3_bind_int(stmt, param, lua_toboolean(L, i));
+        break;
+    case LUA_TNUMBER:
+        r = lua_isinteger(L, i)
+            ? sqlite3_bind_int64(stmt, param, (i64)lua_tointeger(L, i))
+            : sqlite3_bind_double(stmt, param, lua_tonumber(L, i));
+        break;
+    case LUA_TSTRING: {
+        size_t n = 0;
+        const char *const p = lua_tolstring(L, i, &n);
+        r = sqlite3_bind_text64(
+            stmt, param, p, n, SQLITE_TRANSIENT, SQLITE_UTF8);
+        break;
+    }
+    default:
+        luaL_argerror(L, i, "cannot bind value");
+    }
+    if(r != SQLITE_OK)
+        luaL_error(L, "%s", sqlite3_errmsg(sqlite3_db_handle(stmt)));
+}
+
+/** Binds arguments `[first, top]` to the positional parameters. */
+static void bind_args(lua_State *L, sqlite3_stmt *stmt, int first) {
+    const int top = lua_gettop(L);
+    for(int i = first; i <= top; ++i)
+        bind_value(L, stmt, i - first + 1, i);
+}
+
+/**
+ * Binds the fields of the table at \c i.
+ * Integer keys are parameter positions, string keys are parameter names,
+ * with or without the `:`, `@`, or `$` prefix.
+ */
+static void bind_table(lua_State *L, sqlite3_stmt *stmt, int i) {
+    lua_pushnil(L);
+    while(lua_next(L, i)) {
+        int param = 0;
+        if(lua_type(L, -2) == LUA_TNUMBER)
+            param = (int)lua_tointeger(L, -2);
+        else if(lua_type(L, -2) == LUA_TSTRING) {
+            const char *const name = lua_tostring(L, -2);
+            if(!(param = sqlite3_bind_parameter_index(stmt, name)))
+                for(const char *p = ":@$"; *p && !param; ++p) {
+                    char v[64];
+                    snprintf(v, sizeof(v), "%c%s", *p, name);
+                    param = sqlite3_bind_parameter_index(stmt, v);
+                }
+        }
+        if(param <= 0)
+            luaL_error(L, "invalid parameter: %s", luaL_tolstring(L, -2, NULL));
+        bind_value(L, stmt, param, lua_gettop(L));
+        lua_pop(L, 1);
+    }
+}
+
+static bool step(lua_State *L, sqlite3_stmt *stmt) {
+    for(;;)
         switch(sqlite3_step(stmt)) {
-        case SQLITE_ROW: break;
+        case SQLITE_ROW: return true;
+        case SQLITE_DONE: return false;
         case SQLITE_BUSY: continue;
-        case SQLITE_DONE: goto end;
-        default: goto err;
+        default:
+            luaL_error(L, "%s", sqlite3_errmsg(sqlite3_db_handle(stmt)));
         }
+}
+
+static void push_column(lua_State *L, sqlite3_stmt *stmt, int i) {
+    switch(sqlite3_column_type(stmt, i)) {
+    case SQLITE_INTEGER:
+        lua_pushinteger(L, sqlite3_column_int64(stmt, i));
+        break;
+    case SQLITE_FLOAT: lua_pushnumber(L, sqlite3_column_double(stmt, i)); break;
+    case SQLITE_NULL: lua_pushnil(L); break;
+    default:
+        lua_pushlstring(L,
+            (const char*)sqlite3_column_text(stmt, i),
+            (size_t)sqlite3_column_bytes(stmt, i));
+    }
+}
+
+/** Pushes the current row as an array. */
+static void push_row(lua_State *L, sqlite3_stmt *stmt, int n) {
+    lua_createtable(L, n, 0);
+    for(int i = 0; i != n; ++i) {
+        push_column(L, stmt, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+/** Pushes an array with at most \c max rows, all rows if it is negative. */
+static void push_rows(lua_State *L, sqlite3_stmt *stmt, lua_Integer max) {
+    const int n = sqlite3_column_count(stmt);
+    lua_newtable(L);
+    for(lua_Integer i = 0; i != max && step(L, stmt); ++i) {
+        push_row(L, stmt, n);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+/**
+ * Calls `f(row)` for each row of `sql`.
+ * The same row object is reused for every call, and errors raised by `f` are
+ * propagated to the caller.  Arguments after `f` are bound to the query.
+ */
+static int db(lua_State *L) {
+    const struct subs *const s = from_state(L);
+    const char *const sql = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    sqlite3_stmt *const stmt = new_stmt(L, s->db, sql, 0);
+    lua_insert(L, 3);
+    bind_args(L, stmt, 4);
+    lua_settop(L, 3);
+    new_userdata_ptr(L, stmt);
+    luaL_setmetatable(L, "subs_row");
+    while(step(L, stmt)) {
         lua_pushvalue(L, 2);
-        new_userdata_ptr(L, stmt);
-        luaL_getmetatable(L, "subs_row");
-        lua_setmetatable(L, -2);
-        if(lua_pcall(L, 1, 0, msgh) != LUA_OK)
-            goto err;
+        lua_pushvalue(L, 4);
+        lua_call(L, 1, 0);
     }
-end:
-    if(sqlite3_finalize(stmt) != SQLITE_OK)
-        goto err;
+    close_stmt(lua_touserdata(L, 3));
     return 0;
-err:
-    sqlite3_finalize(stmt);
-    luaL_error(L, __func__);
+}
+
+/**
+ * Prepares `sql`, binds the remaining arguments, and returns the statement.
+ * It can be iterated over with a generic `for`, which produces the row
+ * number followed by the columns of each row:
+ *
+ *     for i, id, title in S.query("select id, title from videos") do ... end
+ */
+static int query(lua_State *L) {
+    const struct subs *const s = from_state(L);
+    const char *const sql = luaL_checkstring(L, 1);
+    sqlite3_stmt *const stmt = new_stmt(L, s->db, sql, 0);
+    lua_insert(L, 2);
+    bind_args(L, stmt, 3);
+    lua_settop(L, 2);
+    /* Iterator, state, initial value, and closing value. */
+    lua_pushnil(L);
+    lua_pushnil(L);
+    lua_pushvalue(L, 2);
+    return 4;
+}
+
+/** Returns all rows of `sql` as an array of arrays. */
+static int fetch_all(lua_State *L) {
+    const struct subs *const s = from_state(L);
+    const char *const sql = luaL_checkstring(L, 1);
+    sqlite3_stmt *const stmt = new_stmt(L, s->db, sql, 0);
+    lua_insert(L, 2);
+    bind_args(L, stmt, 3);
+    lua_settop(L, 2);
+    push_rows(L, stmt, -1);
+    close_stmt(lua_touserdata(L, 2));
+    return 1;
+}
+
+/**
+ * Steps the statement and returns the row number and the columns of the row.
+ * The number always comes first since a generic `for` stops when its first
+ * value is `nil`, which any column can be.  It is one more than the control
+ * variable of the loop, which is the previous row number.
+ */
+static int stmt_call(lua_State *L) {
+    sqlite3_stmt *const stmt = check_stmt(L, 1);
+    const lua_Integer row = luaL_optinteger(L, 3, 0) + 1;
+    if(!step(L, stmt))
+        return 0;
+    const int n = sqlite3_column_count(stmt);
+    luaL_checkstack(L, n + 1, NULL);
+    lua_pushinteger(L, row);
+    for(int i = 0; i != n; ++i)
+        push_column(L, stmt, i);
+    return n + 1;
+}
+
+static int stmt_fetch_many(lua_State *L) {
+    sqlite3_stmt *const stmt = check_stmt(L, 1);
+    push_rows(L, stmt, luaL_checkinteger(L, 2));
+    return 1;
+}
+
+static int stmt_fetch_all(lua_State *L) {
+    push_rows(L, check_stmt(L, 1), -1);
+    return 1;
+}
+
+/**
+ * Prepares `sql` for repeated use and returns the statement.
+ * See the `stmt_*` functions for its methods.
+ */
+static int prepare(lua_State *L) {
+    const struct subs *const s = from_state(L);
+    const char *const sql = luaL_checkstring(L, 1);
+    new_stmt(L, s->db, sql, SQLITE_PREPARE_PERSISTENT);
+    return 1;
+}
+
+/**
+ * Resets the statement and binds new parameters, either the arguments, by
+ * position, or the fields of a single table argument.
+ */
+static int stmt_bind(lua_State *L) {
+    sqlite3_stmt *const stmt = check_stmt(L, 1);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if(lua_gettop(L) == 2 && lua_type(L, 2) == LUA_TTABLE)
+        bind_table(L, stmt, 2);
+    else
+        bind_args(L, stmt, 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+/** Returns the next row as an array, or `nil` when there are no more. */
+static int stmt_step(lua_State *L) {
+    sqlite3_stmt *const stmt = check_stmt(L, 1);
+    if(!step(L, stmt))
+        return 0;
+    push_row(L, stmt, sqlite3_column_count(stmt));
+    return 1;
+}
+
+/** Resets the statement, keeping the bound parameters. */
+static int stmt_reset(lua_State *L) {
+    sqlite3_stmt *const stmt = check_stmt(L, 1);
+    sqlite3_reset(stmt);
+    lua_settop(L, 1);
+    return 1;
+}
+
+/** Resets the statement and returns an iterator over the row arrays. */
+static int stmt_rows(lua_State *L) {
+    sqlite3_reset(check_stmt(L, 1));
+    lua_pushcfunction(L, stmt_step);
+    lua_pushvalue(L, 1);
+    return 2;
+}
+
+static int stmt_close(lua_State *L) {
+    close_stmt(luaL_checkudata(L, 1, "subs_stmt"));
     return 0;
 }
 
@@ -144,6 +401,357 @@ static bool err(lua_State *L, const char *f, const char *s) {
     return false;
 }
 
+enum {
+    /** Maximum number of pending messages in each direction. */
+    WORKER_QUEUE_SIZE = 64,
+    /** Maximum nesting of tables in a message. */
+    MSG_MAX_DEPTH = 32,
+    /** Number of instructions between checks for cancellation. */
+    WORKER_CANCEL_COUNT = 1000,
+};
+
+enum msg_type {
+    MSG_NIL, MSG_FALSE, MSG_TRUE, MSG_INT, MSG_NUM, MSG_STR, MSG_TABLE,
+    MSG_END,
+};
+
+enum worker_state { WORKER_NONE, WORKER_INIT, WORKER_RUNNING };
+
+/**
+ * Lua state executing a chunk in a separate thread.
+ * The state is initialized like the main one, including `init.lua`, and has
+ * its own database connection.  It shares nothing with the state which
+ * created it and communicates with it only through messages, which are
+ * copies of Lua values (see \ref encode).
+ */
+struct worker {
+    /** Copy of the parent's, with the worker's own database and state. */
+    struct subs s;
+    thrd_t t;
+    /** Messages to and from the worker. */
+    struct queue in, out;
+    char *src;
+    u8 state;
+    /** Set by the parent to interrupt the worker, see \ref cancel_hook. */
+    atomic_bool cancel;
+};
+
+static lua_State *new_state(const struct subs *s, struct worker *w);
+static struct worker *this_worker(lua_State *L);
+
+/** Pushes a userdata which owns a message buffer, freed by `__gc`. */
+static struct buffer *new_msg(lua_State *L) {
+    struct buffer *const b = lua_newuserdatauv(L, sizeof(*b), 0);
+    *b = (struct buffer){0};
+    luaL_setmetatable(L, "subs_msg");
+    return b;
+}
+
+static int msg_gc(lua_State *L) {
+    buffer_destroy(luaL_checkudata(L, 1, "subs_msg"));
+    return 0;
+}
+
+static void put_type(struct buffer *b, enum msg_type t) {
+    BUFFER_APPEND(b, &(u8){(u8)t});
+}
+
+/** Serializes the value at index `i`, only plain data can be sent. */
+static void encode(lua_State *L, int i, int depth, struct buffer *b) {
+    switch(lua_type(L, i)) {
+    case LUA_TNIL: put_type(b, MSG_NIL); break;
+    case LUA_TBOOLEAN:
+        put_type(b, lua_toboolean(L, i) ? MSG_TRUE : MSG_FALSE);
+        break;
+    case LUA_TNUMBER:
+        if(lua_isinteger(L, i)) {
+            put_type(b, MSG_INT);
+            BUFFER_APPEND(b, &(lua_Integer){lua_tointeger(L, i)});
+        } else {
+            put_type(b, MSG_NUM);
+            BUFFER_APPEND(b, &(lua_Number){lua_tonumber(L, i)});
+        }
+        break;
+    case LUA_TSTRING: {
+        size_t n = 0;
+        const char *const s = lua_tolstring(L, i, &n);
+        put_type(b, MSG_STR);
+        BUFFER_APPEND(b, &n);
+        buffer_append(b, s, n);
+        break;
+    }
+    case LUA_TTABLE:
+        if(depth == MSG_MAX_DEPTH)
+            luaL_error(L, "message is nested too deeply");
+        luaL_checkstack(L, 3, NULL);
+        i = lua_absindex(L, i);
+        put_type(b, MSG_TABLE);
+        for(lua_pushnil(L); lua_next(L, i); lua_pop(L, 1)) {
+            encode(L, -2, depth + 1, b);
+            encode(L, -1, depth + 1, b);
+        }
+        put_type(b, MSG_END);
+        break;
+    default:
+        luaL_error(L, "cannot send a value of type %s", luaL_typename(L, i));
+    }
+}
+
+static const char *decode(lua_State *L, const char *p) {
+    luaL_checkstack(L, 3, NULL);
+    switch((enum msg_type)*p++) {
+    case MSG_NIL: lua_pushnil(L); break;
+    case MSG_FALSE: lua_pushboolean(L, false); break;
+    case MSG_TRUE: lua_pushboolean(L, true); break;
+    case MSG_INT: {
+        lua_Integer x = 0;
+        memcpy(&x, p, sizeof(x));
+        lua_pushinteger(L, x);
+        p += sizeof(x);
+        break;
+    }
+    case MSG_NUM: {
+        lua_Number x = 0;
+        memcpy(&x, p, sizeof(x));
+        lua_pushnumber(L, x);
+        p += sizeof(x);
+        break;
+    }
+    case MSG_STR: {
+        size_t n = 0;
+        memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        lua_pushlstring(L, p, n);
+        p += n;
+        break;
+    }
+    case MSG_TABLE:
+        lua_newtable(L);
+        while(*p != MSG_END) {
+            p = decode(L, decode(L, p));
+            lua_rawset(L, -3);
+        }
+        ++p;
+        break;
+    case MSG_END: assert(false);
+    }
+    return p;
+}
+
+/**
+ * Sends the values starting at index `first` to `q`.
+ * \returns \c false if the queue has been closed.
+ */
+static bool send_msg(lua_State *L, struct queue *q, int first) {
+    const int top = lua_gettop(L);
+    luaL_checkany(L, first);
+    struct buffer *const b = new_msg(L);
+    BUFFER_APPEND(b, &(int){top - first + 1});
+    for(int i = first; i <= top; ++i)
+        encode(L, i, 0, b);
+    void *const p = b->p;
+    *b = (struct buffer){0};
+    if(queue_push(q, p))
+        return true;
+    free(p);
+    return false;
+}
+
+/** Pushes the values of the next message from `q`, if any. */
+static int recv_msg(lua_State *L, struct queue *q, bool wait) {
+    void *p = NULL;
+    if(!(wait ? queue_pop(q, &p) : queue_try_pop(q, &p)))
+        return 0;
+    /* Owned by the userdata until decoded, in case of errors. */
+    struct buffer *const b = new_msg(L);
+    b->p = p;
+    const int msg = lua_gettop(L);
+    int n = 0;
+    memcpy(&n, p, sizeof(n));
+    luaL_checkstack(L, n, "too many values in message");
+    const char *s = (const char*)p + sizeof(n);
+    for(int i = 0; i != n; ++i)
+        s = decode(L, s);
+    buffer_destroy(b);
+    lua_remove(L, msg);
+    return n;
+}
+
+static void free_msgs(struct queue *q) {
+    for(void *p = NULL; queue_try_pop(q, &p);)
+        free(p);
+}
+
+/**
+ * Interrupts the worker once it is cancelled by \ref close_worker.
+ * Called periodically while Lua code executes, so that a worker which never
+ * waits for messages can still be stopped.
+ */
+static void cancel_hook(lua_State *L, lua_Debug *ar) {
+    (void)ar;
+    if(atomic_load_explicit(&this_worker(L)->cancel, memory_order_relaxed))
+        luaL_error(L, "worker cancelled");
+}
+
+/** Same as \ref subs_lua_msgh, but a cancellation is not reported. */
+static int worker_msgh(lua_State *L) {
+    if(atomic_load(&this_worker(L)->cancel))
+        return 1;
+    return subs_lua_msgh(L);
+}
+
+static int worker_main(void *p) {
+    struct worker *const w = p;
+    struct subs *const s = &w->s;
+    int ret = 1;
+    if(!(s->db = subs_new_db_connection(s)) || !(s->L = new_state(s, w)))
+        goto end;
+    lua_State *const L = s->L;
+    lua_pushcfunction(L, worker_msgh);
+    const int msgh = lua_gettop(L);
+    if(luaL_loadstring(L, w->src) != LUA_OK)
+        err(L, __func__, w->src);
+    else if(lua_pcall(L, 0, 0, msgh) == LUA_OK || atomic_load(&w->cancel))
+        ret = 0;
+end:
+    /* Wakes up the parent and makes further messages fail. */
+    queue_close(&w->in);
+    queue_close(&w->out);
+    if(!subs_destroy(s))
+        ret = 1;
+    return ret;
+}
+
+/**
+ * Stops the thread, waiting for it to finish, and releases everything.
+ * The worker is interrupted the next time it executes Lua code or when it
+ * waits for a message.  Only a worker blocked in a C function (a long
+ * database query, for example) delays the return.
+ */
+static bool close_worker(struct worker *w) {
+    bool ret = true;
+    int status = 0;
+    switch((enum worker_state)w->state) {
+    case WORKER_RUNNING:
+        atomic_store(&w->cancel, true);
+        queue_close(&w->in);
+        queue_close(&w->out);
+        if(thrd_join(w->t, &status) != thrd_success) {
+            LOG_ERRNO("thrd_join", 0);
+            ret = false;
+        } else if(status)
+            ret = false;
+        /* fallthrough */
+    case WORKER_INIT:
+        free_msgs(&w->in);
+        free_msgs(&w->out);
+        queue_destroy(&w->in);
+        queue_destroy(&w->out);
+        /* fallthrough */
+    case WORKER_NONE:
+        free(w->src);
+        w->src = NULL;
+    }
+    w->state = WORKER_NONE;
+    return ret;
+}
+
+static struct worker *check_worker(lua_State *L, int i) {
+    struct worker *const w = luaL_checkudata(L, i, "subs_worker");
+    if(w->state != WORKER_RUNNING)
+        luaL_error(L, "worker is closed");
+    return w;
+}
+
+/** Returns the worker which owns this state, see \ref worker_main. */
+static struct worker *this_worker(lua_State *L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, "subs_this_worker");
+    struct worker *const ret = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if(!ret)
+        luaL_error(L, "not in a worker");
+    return ret;
+}
+
+/**
+ * Starts a worker which executes the Lua source `src`.
+ * The returned object has `send`, `recv`, `poll`, and `close` methods; the
+ * worker uses `S.send`, `S.recv`, and `S.poll` to communicate with it.
+ */
+static int worker_new(lua_State *L) {
+    const struct subs *const s = from_state(L);
+    const char *const src = luaL_checkstring(L, 1);
+    struct worker *const w = lua_newuserdatauv(L, sizeof(*w), 0);
+    *w = (struct worker){.s = *s};
+    w->s.db = NULL;
+    w->s.L = NULL;
+    luaL_setmetatable(L, "subs_worker");
+    if(!(w->src = strdup(src)))
+        return luaL_error(L, "strdup: %s", strerror(errno));
+    if(!queue_init(&w->in, WORKER_QUEUE_SIZE))
+        return luaL_error(L, "failed to initialize worker");
+    if(!queue_init(&w->out, WORKER_QUEUE_SIZE)) {
+        queue_destroy(&w->in);
+        return luaL_error(L, "failed to initialize worker");
+    }
+    w->state = WORKER_INIT;
+    if(thrd_create(&w->t, worker_main, w) != thrd_success)
+        return luaL_error(L, "failed to create thread");
+    w->state = WORKER_RUNNING;
+    return 1;
+}
+
+/**
+ * Sends the arguments to the worker, waiting if too many messages are
+ * pending.  Returns `false` if the worker has finished.
+ */
+static int worker_send(lua_State *L) {
+    lua_pushboolean(L, send_msg(L, &check_worker(L, 1)->in, 2));
+    return 1;
+}
+
+/**
+ * Waits for and returns the values of the next message, or nothing once the
+ * worker has finished and all its messages have been received.
+ */
+static int worker_recv(lua_State *L) {
+    return recv_msg(L, &check_worker(L, 1)->out, true);
+}
+
+/** Like `recv`, but returns nothing immediately if no message is pending. */
+static int worker_poll(lua_State *L) {
+    return recv_msg(L, &check_worker(L, 1)->out, false);
+}
+
+/**
+ * Stops the worker and waits for its thread to finish.
+ * Its pending messages are discarded; `S.recv` in the worker returns nothing
+ * from now on, and it is interrupted if it is still running Lua code.
+ * Returns `false` if the worker failed before that.
+ */
+static int worker_close(lua_State *L) {
+    lua_pushboolean(L, close_worker(luaL_checkudata(L, 1, "subs_worker")));
+    return 1;
+}
+
+static int worker_gc(lua_State *L) {
+    close_worker(luaL_checkudata(L, 1, "subs_worker"));
+    return 0;
+}
+
+static int this_send(lua_State *L) {
+    lua_pushboolean(L, send_msg(L, &this_worker(L)->out, 1));
+    return 1;
+}
+
+static int this_recv(lua_State *L) {
+    return recv_msg(L, &this_worker(L)->in, true);
+}
+
+static int this_poll(lua_State *L) {
+    return recv_msg(L, &this_worker(L)->in, false);
+}
+
 static void init_state(const struct subs *s, lua_State *L) {
     new_userdata_ptr(L, s);
     lua_pushcfunction(L, glob_lua);
@@ -157,6 +765,8 @@ static void init_state(const struct subs *s, lua_State *L) {
     lua_setfield(L, -2, "LBRY");
     lua_pushinteger(L, SUBS_YOUTUBE);
     lua_setfield(L, -2, "YOUTUBE");
+    lua_pushinteger(L, SUBS_LUA);
+    lua_setfield(L, -2, "LUA");
     lua_pushcfunction(L, type);
     lua_setfield(L, -2, "type");
     lua_pushcfunction(L, get_sub_info);
@@ -165,6 +775,16 @@ static void init_state(const struct subs *s, lua_State *L) {
     lua_setfield(L, -2, "get_video_info");
     lua_pushcfunction(L, db);
     lua_setfield(L, -2, "db");
+    lua_pushcfunction(L, query);
+    lua_setfield(L, -2, "query");
+    lua_pushcfunction(L, fetch_all);
+    lua_setfield(L, -2, "fetch_all");
+    lua_pushcfunction(L, prepare);
+    lua_setfield(L, -2, "prepare");
+    lua_pushcfunction(L, worker_new);
+    lua_setfield(L, -2, "worker");
+    lua_pushboolean(L, false);
+    lua_setfield(L, -2, "is_worker");
     lua_setmetatable(L, -2);
     lua_setglobal(L, "S");
     luaL_newmetatable(L, "subs_row");
@@ -177,6 +797,67 @@ static void init_state(const struct subs *s, lua_State *L) {
     lua_pushcfunction(L, row_str);
     lua_setfield(L, -2, "str");
     lua_pop(L, 1);
+    luaL_newmetatable(L, "subs_stmt");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, stmt_call);
+    lua_setfield(L, -2, "__call");
+    lua_pushcfunction(L, stmt_close);
+    lua_setfield(L, -2, "__close");
+    lua_pushcfunction(L, stmt_close);
+    lua_setfield(L, -2, "__gc");
+    lua_pushcfunction(L, stmt_close);
+    lua_setfield(L, -2, "close");
+    lua_pushcfunction(L, stmt_bind);
+    lua_setfield(L, -2, "bind");
+    lua_pushcfunction(L, stmt_step);
+    lua_setfield(L, -2, "step");
+    lua_pushcfunction(L, stmt_reset);
+    lua_setfield(L, -2, "reset");
+    lua_pushcfunction(L, stmt_rows);
+    lua_setfield(L, -2, "rows");
+    lua_pushcfunction(L, stmt_fetch_many);
+    lua_setfield(L, -2, "fetch_many");
+    lua_pushcfunction(L, stmt_fetch_all);
+    lua_setfield(L, -2, "fetch_all");
+    lua_pop(L, 1);
+    luaL_newmetatable(L, "subs_msg");
+    lua_pushcfunction(L, msg_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+    luaL_newmetatable(L, "subs_worker");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, worker_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pushcfunction(L, worker_gc);
+    lua_setfield(L, -2, "__close");
+    lua_pushcfunction(L, worker_close);
+    lua_setfield(L, -2, "close");
+    lua_pushcfunction(L, worker_send);
+    lua_setfield(L, -2, "send");
+    lua_pushcfunction(L, worker_recv);
+    lua_setfield(L, -2, "recv");
+    lua_pushcfunction(L, worker_poll);
+    lua_setfield(L, -2, "poll");
+    lua_pop(L, 1);
+}
+
+/** Adds the functions used by a worker to talk to the state that created it. */
+static void init_worker_state(lua_State *L, struct worker *w) {
+    lua_pushlightuserdata(L, w);
+    lua_setfield(L, LUA_REGISTRYINDEX, "subs_this_worker");
+    lua_sethook(L, cancel_hook, LUA_MASKCOUNT, WORKER_CANCEL_COUNT);
+    luaL_getmetatable(L, "subs");
+    lua_pushboolean(L, true);
+    lua_setfield(L, -2, "is_worker");
+    lua_pushcfunction(L, this_send);
+    lua_setfield(L, -2, "send");
+    lua_pushcfunction(L, this_recv);
+    lua_setfield(L, -2, "recv");
+    lua_pushcfunction(L, this_poll);
+    lua_setfield(L, -2, "poll");
+    lua_pop(L, 1);
 }
 
 static bool read_config(lua_State *L) {
@@ -206,14 +887,21 @@ static bool read_config(lua_State *L) {
     return true;
 }
 
-lua_State *subs_lua_init(struct subs *s) {
+/**
+ * Creates a state with the `S` API and executes the configuration file.
+ * `w` is the worker which will run it, if any.  The configuration can test
+ * `S.is_worker` to skip what only applies to the main state.
+ */
+static lua_State *new_state(const struct subs *s, struct worker *w) {
     lua_State *const L = luaL_newstate();
     if(!L) {
-        log_err("%s: failed to create Lua state\n");
+        log_err("%s: failed to create Lua state\n", __func__);
         return NULL;
     }
     luaL_openlibs(L);
     init_state(s, L);
+    if(w)
+        init_worker_state(L, w);
     if(!read_config(L))
         goto err;
     return L;
@@ -222,12 +910,52 @@ err:
     return NULL;
 }
 
+lua_State *subs_lua_init(struct subs *s) {
+    return new_state(s, NULL);
+}
+
 int subs_lua_msgh(lua_State *L) {
     luaL_traceback(L, L, lua_tostring(L, 1), 0);
     log_err("lua: %s\n", lua_tostring(L, -1));
     return 0;
 }
 
+int subs_lua_ref_callback(lua_State *L, const char *name, const char *src) {
+    const int top = lua_gettop(L);
+    if(lua_getglobal(L, name) != LUA_TFUNCTION) {
+        lua_pushcfunction(L, subs_lua_msgh);
+        if(luaL_loadstring(L, src) != LUA_OK) {
+            err(L, __func__, src);
+            goto err;
+        }
+        if(lua_pcall(L, 0, 1, top + 2) != LUA_OK)
+            goto err;
+        if(lua_type(L, -1) != LUA_TFUNCTION) {
+            LOG_ERR("%s: expected a function\n", name);
+            goto err;
+        }
+    }
+    const int ret = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_settop(L, top);
+    return ret;
+err:
+    lua_settop(L, top);
+    return LUA_NOREF;
+}
+
+bool subs_lua_call_ref(lua_State *L, int ref, int n_args, int n_results) {
+    const int msgh = lua_gettop(L) - n_args + 1;
+    lua_pushcfunction(L, subs_lua_msgh);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    lua_rotate(L, msgh, 2);
+    if(lua_pcall(L, n_args, n_results, msgh) != LUA_OK) {
+        lua_settop(L, msgh - 1);
+        return false;
+    }
+    lua_remove(L, msgh);
+    return true;
+}
+
 bool subs_lua(const struct subs *s, const char *src) {
     lua_State *const L = s->L;
     return luaL_dostring(L, src) == LUA_OK || err(L, __func__, src);
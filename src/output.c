@@ -0,0 +1,92 @@
+#include "output.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "log.h"
+#include "util.h"
+
+enum {
+    /** Size of the output buffer, flushed with a single `write`. */
+    OUTPUT_SIZE = 1 << 20,
+};
+
+static bool write_all(int fd, const void *p, size_t n) {
+    while(n) {
+        const ssize_t nw = write(fd, p, n);
+        if(nw == -1) {
+            if(errno == EINTR)
+                continue;
+            return LOG_ERRNO("write", 0), false;
+        }
+        p = (const char*)p + nw;
+        n -= (size_t)nw;
+    }
+    return true;
+}
+
+bool output_init(struct output *o, FILE *f) {
+    *o = (struct output){.fd = fileno(f)};
+    if(o->fd == -1)
+        return LOG_ERRNO("fileno", 0), false;
+    if(fflush(f) == EOF)
+        return LOG_ERRNO("fflush", 0), false;
+    return (o->p = checked_malloc(OUTPUT_SIZE));
+}
+
+bool output_destroy(struct output *o) {
+    const bool ret = output_flush(o);
+    free(o->p);
+    return ret;
+}
+
+bool output_flush(struct output *o) {
+    if(!o->err && o->n && !write_all(o->fd, o->p, o->n))
+        o->err = true;
+    o->n = 0;
+    return !o->err;
+}
+
+void output_write(struct output *o, const void *p, size_t n) {
+    if(!n)
+        return;
+    if(OUTPUT_SIZE - o->n < n && !output_flush(o))
+        return;
+    /* Large blocks are not worth copying. */
+    if(OUTPUT_SIZE <= n) {
+        if(!o->err && !write_all(o->fd, p, n))
+            o->err = true;
+        return;
+    }
+    memcpy(o->p + o->n, p, n);
+    o->n += n;
+}
+
+void output_str(struct output *o, const char *s) {
+    output_write(o, s, strlen(s));
+}
+
+void output_char(struct output *o, char c) {
+    if(o->n == OUTPUT_SIZE && !output_flush(o))
+        return;
+    o->p[o->n++] = c;
+}
+
+void output_i64(struct output *o, i64 x) {
+    char v[24], *p = v + sizeof(v);
+    u64 u = x < 0 ? -(u64)x : (u64)x;
+    do
+        *--p = (char)('0' + u % 10);
+    while(u /= 10);
+    if(x < 0)
+        *--p = '-';
+    output_write(o, p, (size_t)(v + sizeof(v) - p));
+}
+
+void output_column(struct output *o, sqlite3_stmt *stmt, int i) {
+    const unsigned char *const p = sqlite3_column_text(stmt, i);
+    if(p)
+        output_write(o, p, (size_t)sqlite3_column_bytes(stmt, i));
+}
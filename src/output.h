@@ -0,0 +1,41 @@
+#ifndef SUBS_OUTPUT_H
+#define SUBS_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <sqlite3.h>
+
+#include "def.h"
+
+/**
+ * Buffered output to a file descriptor.
+ * Data are accumulated in a single large buffer, which is written with one
+ * `write` call whenever it fills up.  Errors are sticky: once a write fails,
+ * all further output is discarded and \ref output_destroy fails.
+ */
+struct output {
+    int fd;
+    char *p;
+    size_t n;
+    bool err;
+};
+
+/**
+ * Starts writing to the file descriptor of \c f.
+ * Pending data in \c f are flushed first, and \c f must not be written to
+ * until \ref output_destroy is called.
+ */
+bool output_init(struct output *o, FILE *f);
+/** Flushes the remaining data and releases the buffer. */
+bool output_destroy(struct output *o);
+bool output_flush(struct output *o);
+void output_write(struct output *o, const void *p, size_t n);
+void output_str(struct output *o, const char *s);
+void output_char(struct output *o, char c);
+void output_i64(struct output *o, i64 x);
+/** Writes the text of a column, which is empty if it is `NULL`. */
+void output_column(struct output *o, sqlite3_stmt *stmt, int i);
+
+#endif
@@ -0,0 +1,137 @@
+#include "query.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "log.h"
+
+static void add_cond(struct buffer *b, bool *first, const char *s) {
+    buffer_str_append_str(b, *first ? " where " : " and ");
+    buffer_str_append_str(b, s);
+    *first = false;
+}
+
+/**
+ * Appends a term of the `order by` clause.
+ * Without a limit every row is read, and sorting them is cheaper than
+ * following an index in random order, so indexes are disabled with a unary
+ * `+`.  Sorting by ID alone is free, since it is the order of the table.
+ */
+static void add_order(
+    const struct video_filter *f, struct buffer *b, const char *s, bool last)
+{
+    if(!f->limit && f->order != VIDEO_ORDER_ID)
+        buffer_str_append_str(b, "+");
+    buffer_str_append_str(b, s);
+    if(f->flags & VIDEO_FILTER_DESC)
+        buffer_str_append_str(b, " desc");
+    if(!last)
+        buffer_str_append_str(b, ", ");
+}
+
+static bool bind_i64(sqlite3_stmt *stmt, const char *name, i64 x) {
+    const int i = sqlite3_bind_parameter_index(stmt, name);
+    return !i || sqlite3_bind_int64(stmt, i, x) == SQLITE_OK;
+}
+
+enum video_order video_parse_order(const char *s) {
+    static const char *const v[] = {
+        [VIDEO_ORDER_TIMESTAMP] = "timestamp",
+        [VIDEO_ORDER_ID] = "id",
+        [VIDEO_ORDER_SUB] = "sub",
+        [VIDEO_ORDER_TITLE] = "title",
+        [VIDEO_ORDER_DURATION] = "duration",
+    };
+    for(size_t i = 0; i != VIDEO_ORDER_MAX; ++i)
+        if(strcmp(s, v[i]) == 0)
+            return (enum video_order)i;
+    log_err("invalid order: %s\n", s);
+    return VIDEO_ORDER_MAX;
+}
+
+void video_filter_where(const struct video_filter *f, struct buffer *b) {
+    bool first = true;
+    if(f->flags & VIDEO_FILTER_UNTAGGED)
+        add_cond(b, &first,
+            "not exists (select 1 from videos_tags"
+                " where videos_tags.video == videos.id)"
+            " and not exists (select 1 from subs_tags"
+                " where subs_tags.sub == videos.sub)");
+    else if(f->tag)
+        add_cond(b, &first,
+            "(videos.id in (select video from videos_tags where tag == :tag)"
+            " or videos.sub in (select sub from subs_tags where tag == :tag))");
+    if(f->type)
+        add_cond(b, &first, "subs.type == :type");
+    if(f->sub)
+        add_cond(b, &first, "videos.sub == :sub");
+    if(f->flags & VIDEO_FILTER_WATCHED)
+        add_cond(b, &first, "videos.watched == 1");
+    else if(f->flags & VIDEO_FILTER_NOT_WATCHED)
+        add_cond(b, &first, "videos.watched == 0");
+    if(f->since)
+        add_cond(b, &first, "videos.timestamp >= :since");
+    if(f->until)
+        add_cond(b, &first, "videos.timestamp < :until");
+    if(f->title)
+        add_cond(b, &first, "instr(videos.title, :title)");
+    if(f->n_ids)
+        add_cond(b, &first,
+            "videos.id in (select value from json_each(:ids))");
+}
+
+void video_filter_order(const struct video_filter *f, struct buffer *b) {
+    buffer_str_append_str(b, " order by ");
+    switch(f->order) {
+    case VIDEO_ORDER_SUB:
+        add_order(f, b, "subs.name", false);
+        goto ts;
+    case VIDEO_ORDER_DURATION:
+        add_order(f, b, "videos.duration_seconds", false);
+        /* fallthrough */
+ts:
+    case VIDEO_ORDER_TIMESTAMP:
+        add_order(f, b, "videos.timestamp", false);
+        goto id;
+    case VIDEO_ORDER_TITLE:
+        add_order(f, b, "videos.title", false);
+        /* fallthrough */
+id:
+    /* Final tiebreak, so that the order is total and pages are stable. */
+    case VIDEO_ORDER_ID: add_order(f, b, "videos.id", true); break;
+    }
+    if(f->limit || f->offset)
+        buffer_str_append_str(b, " limit :limit offset :offset");
+}
+
+bool video_filter_bind(const struct video_filter *f, sqlite3_stmt *stmt) {
+    if(!(
+        bind_i64(stmt, ":tag", f->tag)
+        && bind_i64(stmt, ":type", f->type)
+        && bind_i64(stmt, ":sub", f->sub)
+        && bind_i64(stmt, ":since", f->since)
+        && bind_i64(stmt, ":until", f->until)
+        && bind_i64(stmt, ":limit", f->limit ? f->limit : -1)
+        && bind_i64(stmt, ":offset", f->offset)
+    ))
+        return false;
+    int i = sqlite3_bind_parameter_index(stmt, ":title");
+    if(i && sqlite3_bind_text(
+        stmt, i, f->title, -1, SQLITE_STATIC) != SQLITE_OK
+    )
+        return false;
+    if(!(i = sqlite3_bind_parameter_index(stmt, ":ids")))
+        return true;
+    struct buffer b = {0};
+    char v[24];
+    buffer_append_str(&b, "[");
+    for(size_t j = 0; j != f->n_ids; ++j) {
+        snprintf(v, sizeof(v), "%s%lld", j ? "," : "", (long long)f->ids[j]);
+        buffer_str_append_str(&b, v);
+    }
+    buffer_str_append_str(&b, "]");
+    return sqlite3_bind_text64(
+        stmt, i, b.p, b.n - 1, free, SQLITE_UTF8) == SQLITE_OK;
+}
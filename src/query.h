@@ -0,0 +1,61 @@
+#ifndef SUBS_QUERY_H
+#define SUBS_QUERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sqlite3.h>
+
+#include "def.h"
+
+struct buffer;
+
+enum video_order {
+    VIDEO_ORDER_TIMESTAMP,
+    VIDEO_ORDER_ID,
+    VIDEO_ORDER_SUB,
+    VIDEO_ORDER_TITLE,
+    VIDEO_ORDER_DURATION,
+    VIDEO_ORDER_MAX,
+};
+
+enum video_filter_flags {
+    /** Videos without tags whose subscription also has no tags. */
+    VIDEO_FILTER_UNTAGGED    = 1u << 0,
+    VIDEO_FILTER_WATCHED     = 1u << 1,
+    VIDEO_FILTER_NOT_WATCHED = 1u << 2,
+    VIDEO_FILTER_DESC        = 1u << 3,
+};
+
+/**
+ * Selection of videos, shared by the command line and the TUI.
+ * Fields which are zero do not restrict the selection.  Queries built from
+ * it refer to `videos` and, when filtering or sorting by subscription type
+ * or name, to `subs`, which the caller must join.
+ */
+struct video_filter {
+    /** Videos with this tag, directly or through their subscription. */
+    i64 tag;
+    i64 sub;
+    /** Publication time range, `[since, until)`. */
+    i64 since, until;
+    i64 limit, offset;
+    /** Substring of the title. */
+    const char *title;
+    /** Only these videos, passed to SQLite as a single array parameter. */
+    const i64 *ids;
+    size_t n_ids;
+    int type;
+    u8 flags;
+    u8 order;
+};
+
+enum video_order video_parse_order(const char *s);
+/** Appends the `where` clause, if any. */
+void video_filter_where(const struct video_filter *f, struct buffer *b);
+/** Appends the `order by` clause and the `limit`, if any. */
+void video_filter_order(const struct video_filter *f, struct buffer *b);
+/** Binds the parameters used by the clauses above. */
+bool video_filter_bind(const struct video_filter *f, sqlite3_stmt *stmt);
+
+#endif
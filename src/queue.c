@@ -0,0 +1,80 @@
+#include "queue.h"
+
+#include "log.h"
+#include "util.h"
+
+/** Removes the oldest element, if any, with the mutex held. */
+static bool take(struct queue *q, void **p) {
+    if(!q->n)
+        return false;
+    *p = q->v[q->head];
+    q->head = (q->head + 1) % q->cap;
+    --q->n;
+    cnd_signal(&q->not_full);
+    return true;
+}
+
+bool queue_init(struct queue *q, size_t cap) {
+    *q = (struct queue){.cap = cap};
+    if(!(q->v = checked_calloc(cap, sizeof(*q->v))))
+        return false;
+    if(mtx_init(&q->mtx, mtx_plain) != thrd_success)
+        goto e0;
+    if(cnd_init(&q->not_empty) != thrd_success)
+        goto e1;
+    if(cnd_init(&q->not_full) != thrd_success)
+        goto e2;
+    return true;
+e2:
+    cnd_destroy(&q->not_empty);
+e1:
+    mtx_destroy(&q->mtx);
+e0:
+    LOG_ERR("failed to initialize queue\n", 0);
+    free(q->v);
+    return false;
+}
+
+void queue_destroy(struct queue *q) {
+    cnd_destroy(&q->not_full);
+    cnd_destroy(&q->not_empty);
+    mtx_destroy(&q->mtx);
+    free(q->v);
+}
+
+bool queue_push(struct queue *q, void *p) {
+    mtx_lock(&q->mtx);
+    while(q->n == q->cap && !q->closed)
+        cnd_wait(&q->not_full, &q->mtx);
+    const bool ret = !q->closed;
+    if(ret) {
+        q->v[(q->head + q->n++) % q->cap] = p;
+        cnd_signal(&q->not_empty);
+    }
+    mtx_unlock(&q->mtx);
+    return ret;
+}
+
+bool queue_pop(struct queue *q, void **p) {
+    mtx_lock(&q->mtx);
+    while(!q->n && !q->closed)
+        cnd_wait(&q->not_empty, &q->mtx);
+    const bool ret = take(q, p);
+    mtx_unlock(&q->mtx);
+    return ret;
+}
+
+bool queue_try_pop(struct queue *q, void **p) {
+    mtx_lock(&q->mtx);
+    const bool ret = take(q, p);
+    mtx_unlock(&q->mtx);
+    return ret;
+}
+
+void queue_close(struct queue *q) {
+    mtx_lock(&q->mtx);
+    q->closed = true;
+    cnd_broadcast(&q->not_empty);
+    cnd_broadcast(&q->not_full);
+    mtx_unlock(&q->mtx);
+}
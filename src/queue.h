@@ -0,0 +1,41 @@
+#ifndef SUBS_QUEUE_H
+#define SUBS_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <threads.h>
+
+/**
+ * Bounded, blocking, multi-producer/multi-consumer queue of pointers.
+ * Used to connect the stages of a pipeline running in separate threads.
+ */
+struct queue {
+    mtx_t mtx;
+    cnd_t not_empty, not_full;
+    void **v;
+    size_t cap, head, n;
+    /** No more elements will be pushed, see \ref queue_close. */
+    bool closed;
+};
+
+bool queue_init(struct queue *q, size_t cap);
+void queue_destroy(struct queue *q);
+/**
+ * Adds an element, waiting while the queue is full.
+ * \returns \c false if the queue has been closed.
+ */
+bool queue_push(struct queue *q, void *p);
+/**
+ * Removes the oldest element, waiting while the queue is empty.
+ * \returns \c false once the queue is closed and empty.
+ */
+bool queue_pop(struct queue *q, void **p);
+/**
+ * Removes the oldest element without waiting.
+ * \returns \c false if the queue is empty.
+ */
+bool queue_try_pop(struct queue *q, void **p);
+/** Wakes up all waiting threads, subsequent pushes fail. */
+void queue_close(struct queue *q);
+
+#endif
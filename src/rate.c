@@ -0,0 +1,47 @@
+#include "rate.h"
+
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "log.h"
+#include "util.h"
+
+void rate_limiter_init(struct rate_limiter *r, double rate, double burst) {
+    burst = MAX(1.0, burst);
+    *r = (struct rate_limiter){
+        .rate = rate,
+        .burst = burst,
+        .tokens = burst,
+        .t = -INFINITY,
+    };
+}
+
+double rate_limiter_reserve(struct rate_limiter *r, double now) {
+    if(!r->rate)
+        return 0;
+    if(r->t < now) {
+        r->tokens = MIN(r->burst, r->tokens + (now - r->t) * r->rate);
+        r->t = now;
+    }
+    r->tokens -= 1;
+    return r->tokens < 0 ? -r->tokens / r->rate : 0;
+}
+
+bool rate_limiter_wait(struct rate_limiter *r) {
+    if(!r->rate)
+        return true;
+    struct timespec t;
+    if(clock_gettime(CLOCK_MONOTONIC, &t) == -1)
+        return LOG_ERRNO("clock_gettime", 0), false;
+    const double wait =
+        rate_limiter_reserve(r, (double)t.tv_sec + (double)t.tv_nsec / 1e9);
+    if(!wait)
+        return true;
+    t.tv_sec = (time_t)wait;
+    t.tv_nsec = (long)((wait - (double)t.tv_sec) * 1e9);
+    while(nanosleep(&t, &t) == -1)
+        if(errno != EINTR)
+            return LOG_ERRNO("nanosleep", 0), false;
+    return true;
+}
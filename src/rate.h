@@ -0,0 +1,35 @@
+#ifndef SUBS_RATE_H
+#define SUBS_RATE_H
+
+#include <stdbool.h>
+
+/**
+ * Token bucket rate limiter.
+ * Tokens are added continuously at \c rate per second, up to \c burst.  Each
+ * request takes a token, waiting until one is available.  Reservations can
+ * exceed the available tokens: the deficit is paid by later requests, so that
+ * waits are spread evenly.
+ */
+struct rate_limiter {
+    /** Tokens added per second, \c 0 disables the limit. */
+    double rate;
+    /** Maximum number of accumulated tokens. */
+    double burst;
+    /** Tokens currently available, negative if there is a deficit. */
+    double tokens;
+    /** Time of the last reservation, in seconds. */
+    double t;
+};
+
+void rate_limiter_init(struct rate_limiter *r, double rate, double burst);
+
+/**
+ * Takes a token at time \c now.
+ * \returns the number of seconds to wait before the request can be made.
+ */
+double rate_limiter_reserve(struct rate_limiter *r, double now);
+
+/** Takes a token, sleeping until it is available. */
+bool rate_limiter_wait(struct rate_limiter *r);
+
+#endif
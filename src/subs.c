@@ -11,7 +11,10 @@
 #include "http.h"
 #include "log.h"
 #include "os.h"
+#include "output.h"
+#include "query.h"
 #include "subs.h"
+#include "update.h"
 
 static void usage(void) {
     printf(
@@ -28,16 +31,22 @@ static void usage(void) {
 "    db SQL          Execute database query\n"
 "    ls [OPTIONS]    List subscriptions.\n"
 "    videos          List videos.\n"
+"    export [OPTIONS]\n"
+"                    Write all videos in a format suitable for other\n"
+"                    programs.\n"
 "    add TYPE NAME ID\n"
 "                    Add a subscription.\n"
 "    rm ID           Remove a subscription.\n"
 "    tag add NAME    Create a tag.\n"
 "    tag subs|videos TAG_NAME|TAG_ID ID...\n"
 "                    Add tag to subscriptions/videos.\n"
-"    watched [-r|--remove] ID\n"
+"    watched [OPTIONS] [ID...]\n"
 "                    Mark videos as watched (`-r` to unmark)\n"
 "    update [OPTIONS] [ID...]\n"
 "                    Fetch new videos from subscriptions.\n"
+"    daemon [OPTIONS] [REQUEST...]\n"
+"                    Update continuously in the background or send a\n"
+"                    request to a running daemon.\n"
 "    tui             Start curses terminal interface.\n",
         PROG_NAME);
 }
@@ -62,42 +71,110 @@ static bool parse_log_level(const char *p, u32 *l) {
     return true;
 }
 
-static void format_sub(sqlite3_stmt *stmt, FILE *f) {
-    fprintf(
-        f, "%d %s %s %s\n",
-        sqlite3_column_int(stmt, 0),
-        subs_type_name(sqlite3_column_int(stmt, 1)),
-        sqlite3_column_text(stmt, 2),
-        sqlite3_column_text(stmt, 3));
-}
-
-static void format_video(sqlite3_stmt *stmt, FILE *f) {
-    fprintf(
-        f,
-        "%d"    // id
-        " %s"   // watched
-        " %s"   // sub type
-        " %lld" // timestamp
-        " %lld" // duration
-        " %s"   // ext_id
-        " %s"   // name
-        " %s"   // title
-        "\n",
-        sqlite3_column_int(stmt, 0),
-        sqlite3_column_int(stmt, 1) ? "w" : "0",
-        subs_type_name(sqlite3_column_int(stmt, 2)),
-        sqlite3_column_int64(stmt, 3),
-        sqlite3_column_int64(stmt, 4),
-        sqlite3_column_text(stmt, 5),
-        sqlite3_column_text(stmt, 6),
-        sqlite3_column_text(stmt, 7));
-}
-
-static void format_tag(sqlite3_stmt *stmt, FILE *f) {
-    fprintf(
-        f, "%d %s\n",
-        sqlite3_column_int(stmt, 0),
-        sqlite3_column_text(stmt, 1));
+/** Parses a rate limit of the form `TYPE:RATE[:BURST]`. */
+static bool parse_rate(const char *p, struct rate_limiter *v) {
+    const char *const colon = strchr(p, ':');
+    if(!colon)
+        goto err;
+    char type_str[16] = {0};
+    const size_t n = (size_t)(colon - p);
+    if(sizeof(type_str) <= n)
+        goto err;
+    memcpy(type_str, p, n);
+    const enum subs_type type = subs_parse_type(type_str);
+    if(!type)
+        return false;
+    char *e = NULL;
+    const double rate = strtod(colon + 1, &e);
+    double burst = MAX(1.0, rate);
+    if(e == colon + 1 || rate < 0)
+        goto err;
+    if(*e == ':') {
+        const char *const b = e + 1;
+        burst = strtod(b, &e);
+        if(e == b || burst < 1)
+            goto err;
+    }
+    if(*e)
+        goto err;
+    rate_limiter_init(&v[type], rate, burst);
+    return true;
+err:
+    log_err("invalid rate limit: %s\n", p);
+    return false;
+}
+
+static void format_sub(sqlite3_stmt *stmt, struct output *o) {
+    output_i64(o, sqlite3_column_int64(stmt, 0));
+    output_char(o, ' ');
+    output_str(o, subs_type_name(sqlite3_column_int(stmt, 1)));
+    output_char(o, ' ');
+    output_column(o, stmt, 2);
+    output_char(o, ' ');
+    output_column(o, stmt, 3);
+    output_char(o, '\n');
+}
+
+static void format_video(sqlite3_stmt *stmt, struct output *o) {
+    output_i64(o, sqlite3_column_int64(stmt, 0));                   // id
+    output_str(o, sqlite3_column_int(stmt, 1) ? " w " : " 0 ");     // watched
+    output_str(o, subs_type_name(sqlite3_column_int(stmt, 2)));     // sub type
+    output_char(o, ' ');
+    output_i64(o, sqlite3_column_int64(stmt, 3));                   // timestamp
+    output_char(o, ' ');
+    output_i64(o, sqlite3_column_int64(stmt, 4));                   // duration
+    output_char(o, ' ');
+    output_column(o, stmt, 5);                                      // ext_id
+    output_char(o, ' ');
+    output_column(o, stmt, 6);                                      // name
+    output_char(o, ' ');
+    output_column(o, stmt, 7);                                      // title
+    output_char(o, '\n');
+}
+
+static void format_tag(sqlite3_stmt *stmt, struct output *o) {
+    output_i64(o, sqlite3_column_int64(stmt, 0));
+    output_char(o, ' ');
+    output_column(o, stmt, 1);
+    output_char(o, '\n');
+}
+
+/** Writes all columns separated by spaces, as `sqlite3` does in list mode. */
+static void format_row(sqlite3_stmt *stmt, struct output *o) {
+    const int n = sqlite3_column_count(stmt);
+    for(int i = 0; i != n; ++i) {
+        if(i)
+            output_char(o, ' ');
+        output_column(o, stmt, i);
+    }
+    output_char(o, '\n');
+}
+
+/** Executes each statement in \c sql and writes the resulting rows. */
+static bool exec_print(sqlite3 *db, const char *sql, struct output *o) {
+    while(*sql) {
+        sqlite3_stmt *stmt = NULL;
+        if(sqlite3_prepare_v3(db, sql, -1, 0, &stmt, &sql) != SQLITE_OK)
+            return false;
+        /* Comments and white space do not produce a statement. */
+        if(!stmt)
+            continue;
+        const bool ret = write_stmt(stmt, o, format_row);
+        if(sqlite3_finalize(stmt) != SQLITE_OK || !ret)
+            return false;
+    }
+    return true;
+}
+
+/** Writes the rows of \c stmt to \c f with \ref output. */
+static bool write_stmt_file(
+    sqlite3_stmt *stmt, FILE *f, void fmt(sqlite3_stmt*, struct output*))
+{
+    struct output o;
+    if(!output_init(&o, f))
+        return false;
+    const bool ret = write_stmt(stmt, &o, fmt);
+    return output_destroy(&o) && ret;
 }
 
 static bool exec_simple_query(sqlite3 *db, const char *sql, int len, i64 arg) {
@@ -122,6 +199,7 @@ const char *subs_type_name(enum subs_type type) {
         [0] = "unknown",
         [SUBS_LBRY] = "lbry",
         [SUBS_YOUTUBE] = "youtube",
+        [SUBS_LUA] = "lua",
     };
     return v[type < SUBS_TYPE_MAX ? type : 0];
 }
@@ -130,6 +208,7 @@ enum subs_type subs_parse_type(const char *s) {
 #define C(u, n) if(strcmp(s, #n) == 0) return SUBS_ ## u;
     C(LBRY, lbry)
     C(YOUTUBE, youtube)
+    C(LUA, lua)
 #undef C
     log_err("invalid subscription type: %s\n", s);
     return 0;
@@ -283,7 +362,7 @@ bool subs_list(const struct subs *s, i64 tag, FILE *f) {
         goto end;
     if(tag && sqlite3_bind_int64(stmt, 1, tag) != SQLITE_OK)
         goto end;
-    if(!write_stmt(stmt, f, format_sub))
+    if(!write_stmt_file(stmt, f, format_sub))
         goto end;
     ret = true;
 end:
@@ -293,6 +372,12 @@ end:
 }
 
 bool subs_list_videos(const struct subs *s, i64 tag, FILE *f) {
+    return subs_query_videos(s, &(struct video_filter){.tag = tag}, f);
+}
+
+bool subs_query_videos(
+    const struct subs *s, const struct video_filter *filter, FILE *f)
+{
     struct buffer b = {0};
     buffer_append_str(&b,
         "select"
@@ -302,19 +387,16 @@ bool subs_list_videos(const struct subs *s, i64 tag, FILE *f) {
             " replace(title, '\n', '\\n'), sub"
         " from videos"
         " join subs on subs.id == videos.sub");
-    if(tag)
-        buffer_str_append_str(&b,
-            ", videos_tags on videos.id == videos_tags.video"
-            " where videos_tags.tag == ?");
-    buffer_str_append_str(&b, " order by timestamp");
+    video_filter_where(filter, &b);
+    video_filter_order(filter, &b);
     sqlite3_stmt *stmt = NULL;
     sqlite3_prepare_v3(s->db, b.p, (int)b.n, 0, &stmt, NULL);
     bool ret = false;
     if(!stmt)
         goto end;
-    if(tag && sqlite3_bind_int64(stmt, 1, tag) != SQLITE_OK)
+    if(!video_filter_bind(filter, stmt))
         goto end;
-    if(!write_stmt(stmt, f, format_video))
+    if(!write_stmt_file(stmt, f, format_video))
         goto end;
     ret = true;
 end:
@@ -329,7 +411,7 @@ bool subs_list_tags(const struct subs *s, FILE *f) {
     sqlite3_prepare_v3(s->db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
     if(!stmt)
         return false;
-    bool ret = write_stmt(stmt, f, format_tag);
+    bool ret = write_stmt_file(stmt, f, format_tag);
     ret = (sqlite3_finalize(stmt) == SQLITE_OK) && ret;
     return ret;
 }
@@ -367,11 +449,15 @@ bool subs_rm(const struct subs *s, i64 id) {
         "delete from videos_tags"
         " where video in (select id from videos where sub == ?)";
     const char sql_tags[] = "delete from subs_tags where sub == ?";
+    const char sql_cache[] = "delete from update_cache where sub == ?";
+    const char sql_progress[] = "delete from update_progress where sub == ?";
     const char sql_videos[] = "delete from videos where sub == ?";
     const char sql[] = "delete from subs where id == ?";
 #define Q(x) x, sizeof(x) - 1
     return exec_simple_query(s->db, Q(sql_videos_tags), id)
         && exec_simple_query(s->db, Q(sql_tags), id)
+        && exec_simple_query(s->db, Q(sql_cache), id)
+        && exec_simple_query(s->db, Q(sql_progress), id)
         && exec_simple_query(s->db, Q(sql_videos), id)
         && exec_simple_query(s->db, Q(sql), id);
 #undef Q
@@ -527,9 +613,81 @@ bool subs_set_watched(const struct subs *s, i64 id, bool b) {
     return sqlite3_finalize(stmt) == SQLITE_OK && ret;
 }
 
+/**
+ * Executes a statement on a selection of videos.
+ * The statement is \c prefix, which should end in a `select` that produces
+ * the video IDs, followed by the clauses of \c filter and by \c suffix.
+ * \c value is bound to the `:value` parameter.
+ */
+static bool exec_video_filter(
+    const struct subs *s, const char *prefix, const char *suffix,
+    const struct video_filter *filter, i64 value, i64 *changes)
+{
+    struct buffer b = {0};
+    buffer_append_str(&b, prefix);
+    buffer_str_append_str(&b,
+        " from videos join subs on subs.id == videos.sub");
+    video_filter_where(filter, &b);
+    if(filter->limit || filter->offset)
+        video_filter_order(filter, &b);
+    buffer_str_append_str(&b, suffix);
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(s->db, b.p, (int)b.n, 0, &stmt, NULL);
+    bool ret = false;
+    if(!stmt)
+        goto end;
+    const int i = sqlite3_bind_parameter_index(stmt, ":value");
+    if(!(
+        video_filter_bind(filter, stmt)
+        && sqlite3_bind_int64(stmt, i, value) == SQLITE_OK
+        && step_stmt_once(stmt)
+    ))
+        goto end;
+    *changes = sqlite3_changes64(s->db);
+    ret = true;
+end:
+    free(b.p);
+    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
+    return ret;
+}
+
+bool subs_tag_videos(
+    const struct subs *s, i64 tag, const struct video_filter *filter)
+{
+    i64 n = 0;
+    if(!exec_video_filter(
+        s, "insert or ignore into videos_tags (tag, video)"
+            " select :value, videos.id",
+        "", filter, tag, &n
+    ))
+        return false;
+    if(s->log_level)
+        fprintf(stderr, "tagged videos: %lld\n", (long long)n);
+    return true;
+}
+
+bool subs_set_watched_videos(
+    const struct subs *s, const struct video_filter *filter, bool b)
+{
+    i64 n = 0;
+    if(!exec_video_filter(
+        s, "update videos set watched = :value where id in (select videos.id",
+        ")", filter, b, &n
+    ))
+        return false;
+    if(s->log_level)
+        fprintf(stderr, "watched videos: %lld\n", (long long)n);
+    return true;
+}
+
 static bool cmd_db(struct subs *s, int argc, char **argv) {
-    return check_argc("db", argc, 1)
-        && sqlite3_exec(s->db, *argv, db_print_row, stdout, NULL) == SQLITE_OK;
+    if(!check_argc("db", argc, 1))
+        return false;
+    struct output o;
+    if(!output_init(&o, stdout))
+        return false;
+    const bool ret = exec_print(s->db, *argv, &o);
+    return output_destroy(&o) && ret;
 }
 
 static bool cmd_list(struct subs *s, int argc, char **argv) {
@@ -571,45 +729,245 @@ end:
     return ret;
 }
 
+enum {
+    FILTER_TAG = 0x100, FILTER_SUB, FILTER_TYPE, FILTER_WATCHED,
+    FILTER_UNWATCHED, FILTER_SINCE, FILTER_UNTIL, FILTER_TITLE, FILTER_LIMIT,
+    FILTER_OFFSET, FILTER_ORDER, FILTER_DESC,
+};
+
+/** Options of commands which operate on a selection of videos. */
+#define FILTER_OPTIONS \
+    {"tag", required_argument, 0, FILTER_TAG}, \
+    {"sub", required_argument, 0, FILTER_SUB}, \
+    {"type", required_argument, 0, FILTER_TYPE}, \
+    {"watched", no_argument, 0, FILTER_WATCHED}, \
+    {"unwatched", no_argument, 0, FILTER_UNWATCHED}, \
+    {"since", required_argument, 0, FILTER_SINCE}, \
+    {"until", required_argument, 0, FILTER_UNTIL}, \
+    {"title", required_argument, 0, FILTER_TITLE}, \
+    {"limit", required_argument, 0, FILTER_LIMIT}, \
+    {"offset", required_argument, 0, FILTER_OFFSET}, \
+    {"order", required_argument, 0, FILTER_ORDER}, \
+    {"desc", no_argument, 0, FILTER_DESC}
+
+#define FILTER_HELP \
+"    --tag TAG       Filter by tag, of the video or of its subscription.\n" \
+"    --sub ID        Filter by subscription.\n" \
+"    --type TYPE     Filter by subscription type (lbry, youtube).\n" \
+"    --watched       Only watched videos.\n" \
+"    --unwatched     Only videos not yet watched.\n" \
+"    --since T       Videos published at or after timestamp T.\n" \
+"    --until T       Videos published before timestamp T.\n" \
+"    --title TEXT    Videos whose title contains TEXT.\n" \
+"    --limit N       Select at most N videos.\n" \
+"    --offset N      Skip the first N videos.\n" \
+"    --order ORDER   Sort by timestamp (default), id, sub, title, or\n" \
+"                    duration.\n" \
+"    --desc          Sort in descending order.\n"
+
+/**
+ * Handles an option from \ref FILTER_OPTIONS.
+ * \return `1` if \c c is a filter option, `0` if it is not, `-1` on errors
+ */
+static int parse_filter_option(sqlite3 *db, int c, struct video_filter *f) {
+    i64 *p = NULL;
+    switch(c) {
+    case FILTER_TAG:
+        return (f->tag = find_tag(db, optarg)) == -1 ? -1 : 1;
+    case FILTER_SUB: p = &f->sub; break;
+    case FILTER_SINCE: p = &f->since; break;
+    case FILTER_UNTIL: p = &f->until; break;
+    case FILTER_LIMIT: p = &f->limit; break;
+    case FILTER_OFFSET: p = &f->offset; break;
+    case FILTER_TYPE:
+        return (f->type = (int)subs_parse_type(optarg)) ? 1 : -1;
+    case FILTER_WATCHED:
+        f->flags &= (u8)~VIDEO_FILTER_NOT_WATCHED;
+        f->flags |= VIDEO_FILTER_WATCHED;
+        return 1;
+    case FILTER_UNWATCHED:
+        f->flags &= (u8)~VIDEO_FILTER_WATCHED;
+        f->flags |= VIDEO_FILTER_NOT_WATCHED;
+        return 1;
+    case FILTER_TITLE: f->title = optarg; return 1;
+    case FILTER_ORDER: {
+        const enum video_order o = video_parse_order(optarg);
+        if(o == VIDEO_ORDER_MAX)
+            return -1;
+        f->order = (u8)o;
+        return 1;
+    }
+    case FILTER_DESC: f->flags |= VIDEO_FILTER_DESC; return 1;
+    default: return 0;
+    }
+    return (*p = parse_i64(optarg)) == -1 ? -1 : 1;
+}
+
+/** Reads whitespace-separated IDs from \c f. */
+static bool read_ids(FILE *f, struct buffer *b) {
+    long long id = 0;
+    int r = 0;
+    while((r = fscanf(f, "%lld", &id)) == 1)
+        BUFFER_APPEND(b, &(i64){id});
+    if(ferror(f))
+        return LOG_ERRNO("fscanf", 0), false;
+    if(r != EOF)
+        return log_err("invalid ID in input\n"), false;
+    return true;
+}
+
+/** Parses ID arguments, `-` reads them from the standard input. */
+static bool parse_ids(char **argv, struct buffer *b) {
+    for(; *argv; ++argv) {
+        if(strcmp(*argv, "-") == 0) {
+            if(!read_ids(stdin, b))
+                return false;
+            continue;
+        }
+        const i64 id = parse_i64(*argv);
+        if(id == -1)
+            return false;
+        BUFFER_APPEND(b, &id);
+    }
+    return true;
+}
+
 static bool cmd_list_videos(struct subs *s, int argc, char **argv) {
-    enum { TAG = 1 };
     const char short_opts[] = "h";
     const struct option long_opts[] = {
         {"help", no_argument, 0, 'h'},
-        {"tag", required_argument, 0, TAG},
+        FILTER_OPTIONS,
         {0},
     };
     bool ret = false;
-    i64 tag = 0;
+    struct video_filter filter = {0};
     for(;;) {
         int long_idx = 0;
         const int c = getopt_long(argc, argv, short_opts, long_opts, &long_idx);
         if(c == -1)
             break;
+        switch(parse_filter_option(s->db, c, &filter)) {
+        case -1: goto end;
+        case 1: continue;
+        }
         switch(c) {
         case '?': goto end;
-        case TAG:
-            if((tag = parse_i64(optarg)) == -1)
+        case 'h':
+            printf(
+"Usage: %s [options] videos [options]\n"
+"\n"
+"Options:\n"
+"    -h, --help      This help text.\n"
+FILTER_HELP,
+                PROG_NAME);
+            ret = true;
+            goto end;
+        }
+    }
+    ret = subs_query_videos(s, &filter, stdout);
+end:
+    optind = 1;
+    return ret;
+}
+
+static bool cmd_export(struct subs *s, int argc, char **argv) {
+    enum { FORMAT = 1 };
+    const char short_opts[] = "h";
+    const struct option long_opts[] = {
+        {"help", no_argument, 0, 'h'},
+        {"format", required_argument, 0, FORMAT},
+        {0},
+    };
+    bool ret = false;
+    enum subs_export_format format = SUBS_EXPORT_NDJSON;
+    for(;;) {
+        int long_idx = 0;
+        const int c = getopt_long(argc, argv, short_opts, long_opts, &long_idx);
+        if(c == -1)
+            break;
+        switch(c) {
+        case '?': goto end;
+        case FORMAT:
+            if(!(format = subs_parse_export_format(optarg)))
                 goto end;
             break;
         case 'h':
             printf(
-"Usage: %s [options] videos [options]\n"
+"Usage: %s [options] export [options]\n"
 "\n"
 "Options:\n"
 "    -h, --help      This help text.\n"
-"    --tag TAG       Filter by tag.\n",
+"    --format FMT    Output format: ndjson (default), csv, or binary (see\n"
+"                    src/export.h).\n",
                 PROG_NAME);
             ret = true;
             goto end;
         }
     }
-    ret = subs_list_videos(s, tag, stdout);
+    ret = check_argc("export", argc - optind, 0)
+        && subs_export(s, format, stdout);
 end:
     optind = 1;
     return ret;
 }
 
+static bool cmd_tag_videos(struct subs *s, int argc, char **argv) {
+    const char short_opts[] = "h";
+    const struct option long_opts[] = {
+        {"help", no_argument, 0, 'h'},
+        FILTER_OPTIONS,
+        {0},
+    };
+    bool ret = false, filtered = false;
+    struct video_filter filter = {0};
+    struct buffer ids = {0};
+    for(;;) {
+        int long_idx = 0;
+        const int c = getopt_long(argc, argv, short_opts, long_opts, &long_idx);
+        if(c == -1)
+            break;
+        switch(parse_filter_option(s->db, c, &filter)) {
+        case -1: goto end;
+        case 1: filtered = true; continue;
+        }
+        switch(c) {
+        case '?': goto end;
+        case 'h':
+            printf(
+"Usage: %s [options] tag videos [options] TAG_NAME|TAG_ID [ID...|-]\n"
+"\n"
+"Tags the videos given as arguments (`-` reads IDs from the standard\n"
+"input) and/or selected by the options, in a single statement.\n"
+"\n"
+"Options:\n"
+"    -h, --help      This help text.\n"
+FILTER_HELP,
+                PROG_NAME);
+            ret = true;
+            goto end;
+        }
+    }
+    argv += optind;
+    if(!*argv) {
+        log_err("missing tag argument\n");
+        goto end;
+    }
+    const i64 tag = find_tag(s->db, *argv);
+    if(tag == -1 || !parse_ids(++argv, &ids))
+        goto end;
+    if(!filtered && !*argv) {
+        log_err("tag videos: at least one ID or option required\n");
+        goto end;
+    }
+    filter.ids = (const i64*)ids.p;
+    filter.n_ids = ids.n / sizeof(i64);
+    ret = (*argv && !filter.n_ids) || subs_tag_videos(s, tag, &filter);
+end:
+    free(ids.p);
+    optind = 1;
+    return ret;
+}
+
 static bool cmd_tag(struct subs *s, int argc, char **argv) {
     bool (*f)(const struct subs*, i64, i64) = NULL;
     if(!*argv)
@@ -620,7 +978,7 @@ static bool cmd_tag(struct subs *s, int argc, char **argv) {
     else if(strcmp(*argv, "subs") == 0)
         f = subs_tag_sub;
     else if(strcmp(*argv, "videos") == 0)
-        f = subs_tag_video;
+        return cmd_tag_videos(s, argc, argv);
     else
         return log_err("invalid tag destination type: %s\n", *argv), false;
     if(!*++argv)
@@ -636,33 +994,108 @@ static bool cmd_tag(struct subs *s, int argc, char **argv) {
     return true;
 }
 
-static bool cmd_watched(struct subs *s, char **argv) {
-    bool b = true;
-    if(strcmp(*argv, "-r") == 0 || strcmp(*argv, "--remove") == 0)
-        b = false, ++argv;
-    if(!*argv)
-        return log_err("watched: at least one argument required\n"), false;
-    do {
-        const i64 id = parse_i64(*argv);
-        if(id == -1 || !subs_set_watched(s, id, b))
-            return false;
-    } while(*++argv);
-    return true;
+static bool cmd_watched(struct subs *s, int argc, char **argv) {
+    enum { REMOVE = 'r' };
+    const char short_opts[] = "hr";
+    const struct option long_opts[] = {
+        {"help", no_argument, 0, 'h'},
+        {"remove", no_argument, 0, REMOVE},
+        {"before", required_argument, 0, FILTER_UNTIL},
+        FILTER_OPTIONS,
+        {0},
+    };
+    bool ret = false, filtered = false, watched = true;
+    struct video_filter filter = {0};
+    struct buffer ids = {0};
+    for(;;) {
+        int long_idx = 0;
+        const int c = getopt_long(argc, argv, short_opts, long_opts, &long_idx);
+        if(c == -1)
+            break;
+        switch(parse_filter_option(s->db, c, &filter)) {
+        case -1: goto end;
+        case 1: filtered = true; continue;
+        }
+        switch(c) {
+        case '?': goto end;
+        case REMOVE: watched = false; break;
+        case 'h':
+            printf(
+"Usage: %s [options] watched [options] [ID...|-]\n"
+"\n"
+"Marks the videos given as arguments (`-` reads IDs from the standard\n"
+"input) and/or selected by the options as watched, in a single statement.\n"
+"\n"
+"Options:\n"
+"    -h, --help      This help text.\n"
+"    -r, --remove    Mark videos as not watched.\n"
+"    --before T      Same as --until.\n"
+FILTER_HELP,
+                PROG_NAME);
+            ret = true;
+            goto end;
+        }
+    }
+    argv += optind;
+    if(!filtered && !*argv) {
+        log_err("watched: at least one ID or option required\n");
+        goto end;
+    }
+    if(!parse_ids(argv, &ids))
+        goto end;
+    filter.ids = (const i64*)ids.p;
+    filter.n_ids = ids.n / sizeof(i64);
+    ret = (*argv && !filter.n_ids)
+        || subs_set_watched_videos(s, &filter, watched);
+end:
+    free(ids.p);
+    optind = 1;
+    return ret;
+}
+
+static bool write_stats(const struct update_stats *stats, const char *path) {
+    const bool std = strcmp(path, "-") == 0;
+    FILE *const f = std ? stdout : fopen(path, "w");
+    if(!f)
+        return LOG_ERRNO("fopen: %s", path), false;
+    struct buffer b = {0};
+    update_stats_json(stats, &b);
+    bool ret = fprintf(f, "%s\n", (const char*)b.p) >= 0;
+    if(!ret)
+        LOG_ERRNO("fprintf", 0);
+    free(b.p);
+    if(!std && fclose(f) == EOF)
+        LOG_ERRNO("fclose", 0), ret = false;
+    return ret;
 }
 
 static bool cmd_update(struct subs *s, int argc, char **argv) {
-    enum { DEPTH = 1, DELAY = 2, SINCE = 3 };
+    enum {
+        DEPTH = 1, DELAY = 2, SINCE = 3, NO_CACHE = 4, SCHEDULE = 5, RATE = 6,
+        RESUME = 7, STATS = 8, SAVE_STATS = 9,
+    };
     const char short_opts[] = "h";
     const struct option long_opts[] = {
         {"help", no_argument, 0, 'h'},
         {"depth", required_argument, 0, DEPTH},
         {"delay", required_argument, 0, DELAY},
         {"since", required_argument, 0, SINCE},
+        {"no-cache", no_argument, 0, NO_CACHE},
+        {"schedule", no_argument, 0, SCHEDULE},
+        {"rate", required_argument, 0, RATE},
+        {"resume", no_argument, 0, RESUME},
+        {"stats", required_argument, 0, STATS},
+        {"save-stats", no_argument, 0, SAVE_STATS},
         {0},
     };
     bool ret = false;
     u32 flags = 0;
     int depth = -1, delay = 0, since = 0;
+    const char *stats_path = NULL;
+    bool save_stats = false;
+    struct rate_limiter rate[SUBS_TYPE_MAX];
+    for(size_t i = 0; i != ARRAY_SIZE(rate); ++i)
+        rate_limiter_init(&rate[i], 0, 0);
     for(;;) {
         int long_idx = 0;
         const int c = getopt_long(argc, argv, short_opts, long_opts, &long_idx);
@@ -682,6 +1115,15 @@ static bool cmd_update(struct subs *s, int argc, char **argv) {
             if((since = parse_int(optarg)) == -1)
                 return false;
             break;
+        case NO_CACHE: flags |= UPDATE_NO_CACHE; break;
+        case SCHEDULE: flags |= UPDATE_SCHEDULE; break;
+        case RESUME: flags |= UPDATE_RESUME; break;
+        case STATS: stats_path = optarg; break;
+        case SAVE_STATS: save_stats = true; break;
+        case RATE:
+            if(!parse_rate(optarg, rate))
+                goto end;
+            break;
         case 'h':
             printf(
 "Usage: %s [options] update [options]\n"
@@ -695,6 +1137,20 @@ static bool cmd_update(struct subs *s, int argc, char **argv) {
 "    --since TIMESTAMP\n"
 "                    Only update subscriptions which have not been updated.\n"
 "                    since TIMESTAMP (Unix timestamp)\n"
+"    --no-cache      Process all pages, even those which have not changed\n"
+"                    since the previous update.\n"
+"    --schedule      Only update subscriptions which are due, estimated from\n"
+"                    how often they have published videos in the past.\n"
+"    --rate TYPE:RATE[:BURST]\n"
+"                    Limit requests for subscriptions of type TYPE to RATE\n"
+"                    per second, allowing bursts of up to BURST requests.\n"
+"                    Can be repeated for each type.\n"
+"    --resume        Continue deep updates (see --depth) which were\n"
+"                    interrupted, from the last page processed.  Only those\n"
+"                    subscriptions are updated, with their original depth.\n"
+"    --stats FILE    Write timing information and counters for the update to\n"
+"                    FILE as JSON (\"-\" for standard output).\n"
+"    --save-stats    Record the same information in the update_runs table.\n"
 ,
                 PROG_NAME);
             ret = true;
@@ -709,9 +1165,102 @@ static bool cmd_update(struct subs *s, int argc, char **argv) {
             goto end;
     struct http_client http = {0};
     http_client_init(&http, 0);
-    if(!subs_update(s, &http, flags, depth, delay, since, pos_argc, pos_argv))
+    struct update_stats stats = {0};
+    struct updater u;
+    if(updater_init(&u, s, &http)) {
+        memcpy(u.rate, rate, sizeof(rate));
+        if(stats_path || save_stats)
+            u.stats = &stats;
+        ret = updater_run(
+            &u, flags, depth, delay, since, pos_argc, pos_argv);
+        ret = updater_destroy(&u) && ret;
+        /* Also recorded for failed updates, to see where they stopped. */
+        if(stats_path)
+            ret = write_stats(&stats, stats_path) && ret;
+        if(save_stats)
+            ret = update_stats_store(&stats, s->db) && ret;
+    }
+    update_stats_destroy(&stats);
+    http_client_destroy(&http);
+end:
+    optind = 1;
+    return ret;
+}
+
+static bool cmd_daemon(struct subs *s, int argc, char **argv) {
+    enum { SOCKET = 1, INTERVAL = 2, RATE = 3 };
+    const char short_opts[] = "+h";
+    const struct option long_opts[] = {
+        {"help", no_argument, 0, 'h'},
+        {"socket", required_argument, 0, SOCKET},
+        {"interval", required_argument, 0, INTERVAL},
+        {"rate", required_argument, 0, RATE},
+        {0},
+    };
+    bool ret = false;
+    const char *path = NULL;
+    int interval = 60 * 60;
+    struct rate_limiter rate[SUBS_TYPE_MAX];
+    for(size_t i = 0; i != ARRAY_SIZE(rate); ++i)
+        rate_limiter_init(&rate[i], 0, 0);
+    for(;;) {
+        int long_idx = 0;
+        const int c = getopt_long(argc, argv, short_opts, long_opts, &long_idx);
+        if(c == -1)
+            break;
+        switch(c) {
+        case '?': goto end;
+        case SOCKET: path = optarg; break;
+        case INTERVAL:
+            if((interval = parse_int(optarg)) == -1)
+                goto end;
+            break;
+        case RATE:
+            if(!parse_rate(optarg, rate))
+                goto end;
+            break;
+        case 'h':
+            printf(
+"Usage: %s [options] daemon [options] [REQUEST...]\n"
+"\n"
+"Without a request, runs updates in the foreground as subscriptions become\n"
+"due (see `update --schedule`).  Otherwise, sends the request to a running\n"
+"daemon and prints the reply.\n"
+"\n"
+"Options:\n"
+"    -h, --help      This help text.\n"
+"    --socket PATH   Path of the control socket, default:\n"
+"                    $XDG_RUNTIME_DIR/subs.sock.\n"
+"    --interval N    Check for new subscriptions at least every N seconds,\n"
+"                    default: 3600.\n"
+"    --rate TYPE:RATE[:BURST]\n"
+"                    Limit request rates, see `update --help`.\n"
+"\n"
+"Requests:\n"
+"    update now      Update all subscriptions immediately.\n"
+"    status          Print update statistics.\n"
+"    stop            Terminate the daemon.\n"
+,
+                PROG_NAME);
+            ret = true;
+            goto end;
+        }
+    }
+    char v[SUBS_MAX_PATH];
+    if(!(path = subs_daemon_socket_path(v, path)))
         goto end;
-    ret = true;
+    if(optind == argc) {
+        ret = subs_daemon(s, path, interval, rate);
+        goto end;
+    }
+    struct buffer req = {0};
+    buffer_append_str(&req, argv[optind]);
+    for(int i = optind + 1; i != argc; ++i) {
+        buffer_str_append_str(&req, " ");
+        buffer_str_append_str(&req, argv[i]);
+    }
+    ret = subs_daemon_send(path, req.p, stdout);
+    free(req.p);
 end:
     optind = 1;
     return ret;
@@ -728,6 +1277,8 @@ bool subs_exec(struct subs *s, int argc, char **argv) {
         return cmd_list(s, argc, argv);
     if(strcmp(*argv, "videos") == 0)
         return cmd_list_videos(s, argc, argv);
+    if(strcmp(*argv, "export") == 0)
+        return cmd_export(s, argc, argv);
     if(strcmp(*argv, "add") == 0) {
         --argc, ++argv;
         enum subs_type t = 0;
@@ -744,9 +1295,11 @@ bool subs_exec(struct subs *s, int argc, char **argv) {
     if(strcmp(*argv, "tag") == 0)
         return cmd_tag(s, --argc, ++argv);
     if(strcmp(*argv, "watched") == 0)
-        return cmd_watched(s, ++argv);
+        return cmd_watched(s, argc, argv);
     if(strcmp(*argv, "update") == 0)
         return cmd_update(s, argc, argv);
+    if(strcmp(*argv, "daemon") == 0)
+        return cmd_daemon(s, argc, argv);
     if(argc && strcmp(argv[0], "lua") == 0)
         return check_argc("lua", --argc, 1)
             && subs_lua(s, *++argv);
@@ -9,17 +9,28 @@
 #include <sqlite3.h>
 
 #include "const.h"
+#include "rate.h"
 
 struct lua_State;
 
 struct http_client;
+struct video_filter;
 
 enum subs_type {
     SUBS_LBRY = (uint32_t)1,
     SUBS_YOUTUBE,
+    /** Updated by the `subs_update` Lua function, see update_lua.c. */
+    SUBS_LUA,
     SUBS_TYPE_MAX,
 };
 
+enum subs_export_format {
+    SUBS_EXPORT_NDJSON = 1,
+    SUBS_EXPORT_CSV,
+    /** Columnar, see export.h. */
+    SUBS_EXPORT_BINARY,
+};
+
 struct subs {
     sqlite3 *db;
     lua_State *L;
@@ -37,7 +48,14 @@ bool subs_init_from_argv(struct subs *s, int *argc, char ***argv);
 bool subs_destroy(struct subs *s);
 bool subs_list(const struct subs *s, int64_t tag, FILE *f);
 bool subs_list_videos(const struct subs *s, int64_t tag, FILE *f);
+/** Writes the videos selected by \c filter, see query.h. */
+bool subs_query_videos(
+    const struct subs *s, const struct video_filter *filter, FILE *f);
 bool subs_list_tags(const struct subs *s, FILE *f);
+enum subs_export_format subs_parse_export_format(const char *s);
+/** Writes every video to \c f, which is flushed and then written directly. */
+bool subs_export(
+    const struct subs *s, enum subs_export_format format, FILE *f);
 bool subs_add(
     const struct subs *s,
     enum subs_type type, const char *name, const char *id);
@@ -50,13 +68,47 @@ bool subs_add_tag(const struct subs *s, const char *name);
 bool subs_tag_sub(const struct subs *s, int64_t tag, int64_t id);
 bool subs_tag_video(const struct subs *s, int64_t tag, int64_t id);
 bool subs_set_watched(const struct subs *s, int64_t id, bool b);
+/**
+ * Tags the videos selected by \c filter.
+ * The selection is updated with a single statement, already tagged videos
+ * are skipped.
+ */
+bool subs_tag_videos(
+    const struct subs *s, int64_t tag, const struct video_filter *filter);
+/** Sets the watched state of the videos selected by \c filter at once. */
+bool subs_set_watched_videos(
+    const struct subs *s, const struct video_filter *filter, bool b);
 bool subs_update(
     const struct subs *s, const struct http_client *http, uint32_t flags,
     int depth, int since, int delay, size_t n, int64_t *ids);
 bool subs_start_tui(const struct subs *s);
+/** Resolves the daemon socket path, `$XDG_RUNTIME_DIR/subs.sock` by default. */
+const char *subs_daemon_socket_path(
+    char v[static SUBS_MAX_PATH], const char *path);
+/**
+ * Runs updates continuously, as subscriptions become due.
+ * Requests are accepted on a Unix socket at `path`, see \ref subs_daemon_send.
+ */
+bool subs_daemon(
+    const struct subs *s, const char *path, int interval,
+    const struct rate_limiter rate[static SUBS_TYPE_MAX]);
+/** Sends a request to a running daemon and writes its reply to `f`. */
+bool subs_daemon_send(const char *path, const char *req, FILE *f);
 lua_State *subs_lua_init(struct subs *s);
 bool subs_lua(const struct subs *s, const char *src);
 int subs_lua_msgh(lua_State *L);
+/**
+ * Stores a callback in the registry and returns its reference.
+ * The global \c name is used if it is a function, which allows it to be
+ * defined in `init.lua`, otherwise \c src is executed once and must return
+ * the function.  Returns \c LUA_NOREF on error.
+ */
+int subs_lua_ref_callback(lua_State *L, const char *name, const char *src);
+/**
+ * Calls a callback stored by \ref subs_lua_ref_callback with the \c n_args
+ * values on the top of the stack, which are replaced by the results.
+ */
+bool subs_lua_call_ref(lua_State *L, int ref, int n_args, int n_results);
 bool subs_exec(struct subs *s, int argc, char **argv);
 
 #endif
@@ -2,10 +2,14 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
 
 #include <alloca.h>
+#include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 
 #include "log.h"
@@ -55,12 +59,12 @@ int setup_signalfd(sigset_t mask) {
     return ret;
 }
 
-bool process_signalfd(int fd) {
+int process_signalfd(int fd) {
     struct signalfd_siginfo i;
     const ssize_t n = read(fd, &i, sizeof(i));
     if(n != sizeof(i))
-        return LOG_ERRNO("read", 0), false;
-    return true;
+        return LOG_ERRNO("read", 0), 0;
+    return (int)i.ssi_signo;
 }
 
 bool exec_with_pipes(
@@ -96,6 +100,28 @@ bool exec_with_pipes(
     }
 }
 
+pid_t spawn_process(const char *file, const char *const *argv) {
+    const pid_t ret = fork();
+    if(ret == -1)
+        return LOG_ERRNO("fork", 0), -1;
+    if(ret)
+        return ret;
+    sigset_t mask;
+    sigemptyset(&mask);
+    if(sigprocmask(SIG_SETMASK, &mask, NULL) == -1)
+        LOG_ERRNO("sigprocmask", 0), _exit(1);
+    const int fd = open("/dev/null", O_RDWR);
+    if(fd == -1)
+        LOG_ERRNO("open", 0), _exit(1);
+    for(int i = 0; i != 3; ++i)
+        if(dup2(fd, i) == -1)
+            _exit(1);
+    if(2 < fd)
+        close(fd);
+    execvp(file, (char *const*)argv);
+    _exit(127);
+}
+
 bool wait_for_pid(pid_t pid) {
     int status;
     if(waitpid(pid, &status, 0) == -1) {
@@ -126,18 +152,106 @@ bool get_terminal_size(int *x, int *y) {
     return true;
 }
 
+static bool unix_socket_addr(const char *path, struct sockaddr_un *addr) {
+    *addr = (struct sockaddr_un){.sun_family = AF_UNIX};
+    const size_t n = strlen(path);
+    if(sizeof(addr->sun_path) <= n)
+        return LOG_ERR("socket path too long: %s\n", path), false;
+    memcpy(addr->sun_path, path, n + 1);
+    return true;
+}
+
+/**
+ * Checks whether a process is accepting connections on an existing socket.
+ * \returns \c 1 if it is, \c 0 if the socket is stale, \c -1 on errors
+ */
+static int socket_is_live(const struct sockaddr_un *addr) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+        return LOG_ERRNO("socket", 0), -1;
+    int ret = 1;
+    if(connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == -1) {
+        if(errno == ECONNREFUSED)
+            ret = 0;
+        else
+            log_errno("connect: %s", addr->sun_path), ret = -1;
+    }
+    if(close(fd) == -1)
+        LOG_ERRNO("close", 0);
+    return ret;
+}
+
+int unix_socket_listen(const char *path) {
+    struct sockaddr_un addr;
+    if(!unix_socket_addr(path, &addr))
+        return -1;
+    const int ret = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(ret == -1)
+        return LOG_ERRNO("socket", 0), -1;
+    while(bind(ret, (const struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        if(errno != EADDRINUSE) {
+            LOG_ERRNO("bind", 0);
+            goto err;
+        }
+        /* A stale socket from a previous process prevents binding, but one
+         * which is still in use must be left alone. */
+        switch(socket_is_live(&addr)) {
+        case 0: break;
+        case 1: log_err("socket already in use: %s\n", path); /* fallthrough */
+        default: goto err;
+        }
+        if(unlink(path) == -1 && errno != ENOENT) {
+            LOG_ERRNO("unlink", 0);
+            goto err;
+        }
+    }
+    if(listen(ret, 8) == -1) {
+        LOG_ERRNO("listen", 0);
+        goto err;
+    }
+    return ret;
+err:
+    if(close(ret) == -1)
+        LOG_ERRNO("close", 0);
+    return -1;
+}
+
+int unix_socket_connect(const char *path) {
+    struct sockaddr_un addr;
+    if(!unix_socket_addr(path, &addr))
+        return -1;
+    const int ret = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(ret == -1)
+        return LOG_ERRNO("socket", 0), -1;
+    if(connect(ret, (const struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        log_errno("connect: %s", path);
+        if(close(ret) == -1)
+            LOG_ERRNO("close", 0);
+        return -1;
+    }
+    return ret;
+}
+
 enum input_result poll_input(nfds_t n, const int fds[static n], int *fd) {
+    return poll_input_timeout(n, fds, -1, fd);
+}
+
+enum input_result poll_input_timeout(
+    nfds_t n, const int fds[static n], int timeout, int *fd)
+{
     struct pollfd *const v = alloca(n * sizeof(*v));
     for(nfds_t i = 0; i != n; ++i)
         v[i] = (struct pollfd){.events = POLLIN, .fd = fds[i]};
     enum input_result ret = -1;
 retry: ;
-    int n_events = poll(v, n, -1);
+    int n_events = poll(v, n, timeout);
     if(n_events == -1) {
         if(errno == EINTR)
             goto retry;
         return LOG_ERRNO("poll", 0), INPUT_ERR;
     }
+    if(!n_events)
+        return INPUT_TIMEOUT;
     for(size_t i = 0; n_events; ++i) {
         assert(i < n);
         const short revents = v[i].revents;
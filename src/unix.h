@@ -11,18 +11,37 @@ enum input_result {
     INPUT_FD,
     INPUT_CLOSED,
     INPUT_ERR,
+    INPUT_TIMEOUT,
 };
 
 bool setup_pipe(int *r, int *w);
 bool setup_bidirectional_pipe(int *r0, int *w0, int *r1, int *w1);
 sigset_t make_signal_mask(int s, ...);
 int setup_signalfd(sigset_t mask);
-bool process_signalfd(int fd);
+/** \returns the number of the signal received, or \c 0 on error. */
+int process_signalfd(int fd);
 bool exec_with_pipes(
     const char *file, const char *const *argv,
     pid_t *pid, int *r, int *w);
+/**
+ * Starts a process without waiting for it.
+ * Its signal mask is cleared and its standard streams are redirected to
+ * `/dev/null`, so that it does not interfere with the terminal.
+ * \returns the process ID, or \c -1 on error.
+ */
+pid_t spawn_process(const char *file, const char *const *argv);
 bool wait_for_pid(pid_t pid);
 bool get_terminal_size(int *x, int *y);
+/**
+ * Creates a listening Unix domain stream socket at \c path.
+ * A stale socket at that path is replaced, but the call fails if another
+ * process is still listening on it.
+ */
+int unix_socket_listen(const char *path);
+int unix_socket_connect(const char *path);
 enum input_result poll_input(nfds_t n, const int fds[static n], int *fd);
+/** Same as \ref poll_input, but returns \c INPUT_TIMEOUT after \c timeout ms. */
+enum input_result poll_input_timeout(
+    nfds_t n, const int fds[static n], int timeout, int *fd);
 
 #endif
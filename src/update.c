@@ -11,21 +11,68 @@
 #include "log.h"
 #include "update.h"
 
-static void build_query_common(struct buffer *b, int since) {
+enum {
+    /** Lower bound for the interval between scheduled updates. */
+    SCHEDULE_MIN_DELAY = 60 * 60,
+    /** Upper bound for the interval between scheduled updates. */
+    SCHEDULE_MAX_DELAY = 7 * 24 * 60 * 60,
+    /** Number of recent videos used to estimate the posting frequency. */
+    SCHEDULE_HISTORY = 16,
+    /** Delay before the first retry of a failed subscription. */
+    SCHEDULE_RETRY_DELAY = 5 * 60,
+    /** Maximum number of times the retry delay is doubled. */
+    SCHEDULE_RETRY_MAX_SHIFT = 12,
+};
+
+static void build_query_common(
+    struct buffer *b, u32 flags, int since, size_t n)
+{
     buffer_str_append_str(b, " from subs where disabled == 0");
     if(since)
         buffer_str_append_str(b, " and last_update < ?");
+    if(flags & UPDATE_SCHEDULE)
+        buffer_str_append_str(b, " and next_update <= ?");
+    if(flags & UPDATE_RESUME)
+        buffer_str_append_str(
+            b, " and id in (select sub from update_progress)");
+    if(n) {
+        buffer_str_append_str(b, " and id in (");
+        query_add_param_list(b, n);
+        buffer_str_append_str(b, ")");
+    }
+}
+
+static int bind_query_common(
+    sqlite3_stmt *stmt, u32 flags, int since, time_t now,
+    size_t n, const i64 *ids)
+{
+    int i = 0;
+    if(since && sqlite3_bind_int(stmt, ++i, since) != SQLITE_OK)
+        return -1;
+    if(flags & UPDATE_SCHEDULE)
+        if(sqlite3_bind_int64(stmt, ++i, (i64)now) != SQLITE_OK)
+            return -1;
+    for(size_t j = 0; j != n; ++j)
+        if(sqlite3_bind_int64(stmt, ++i, ids[j]) != SQLITE_OK)
+            return -1;
+    return i;
 }
 
-static bool count_subs(sqlite3 *db, struct buffer *b, int since, size_t *p) {
+static bool count_subs(
+    sqlite3 *db, struct buffer *b, u32 flags, int since, time_t now,
+    size_t n, const i64 *ids, size_t *p)
+{
+    b->n = 0;
     buffer_append_str(b, "select count(*)");
-    build_query_common(b, since);
+    build_query_common(b, flags, since, n);
     sqlite3_stmt *stmt = NULL;
     sqlite3_prepare_v3(db, b->p, (int)b->n, 0, &stmt, NULL);
     if(!stmt)
         return false;
-    if(since)
-        sqlite3_bind_int(stmt, 1, since);
+    if(bind_query_common(stmt, flags, since, now, n, ids) == -1) {
+        sqlite3_finalize(stmt);
+        return false;
+    }
     for(;;)
         switch(sqlite3_step(stmt)) {
         case SQLITE_BUSY: continue;
@@ -52,25 +99,21 @@ static bool count_videos(sqlite3 *db, size_t *p) {
         }
 }
 
-static int has_youtube(sqlite3 *db, size_t n, i64 *ids) {
+static int has_youtube(
+    sqlite3 *db, u32 flags, int since, time_t now, size_t n, const i64 *ids)
+{
     struct buffer sql = {0};
-    buffer_append_str(&sql, "select 1 from subs" " where subs.type == ?");
-    if(n) {
-        buffer_str_append_str(&sql, "and id in (");
-        query_add_param_list(&sql, n);
-        buffer_str_append_str(&sql, ")");
-    }
-    buffer_str_append_str(&sql, " limit 1");
+    buffer_append_str(&sql, "select 1");
+    build_query_common(&sql, flags, since, n);
+    buffer_str_append_str(&sql, " and type == ? limit 1");
     sqlite3_stmt *stmt = NULL;
     sqlite3_prepare_v3(db, sql.p, (int)sql.n - 1, 0, &stmt, NULL);
     int ret = -1;
     if(!stmt)
         goto e0;
-    if(sqlite3_bind_int(stmt, 1, SUBS_YOUTUBE) != SQLITE_OK)
+    const int i = bind_query_common(stmt, flags, since, now, n, ids);
+    if(i == -1 || sqlite3_bind_int(stmt, i + 1, SUBS_YOUTUBE) != SQLITE_OK)
         goto e1;
-    for(size_t i = 0; i != n; ++i)
-        if(sqlite3_bind_int64(stmt, (int)i + 2, ids[i]) != SQLITE_OK)
-            goto e1;
     ret = exists_query_stmt(stmt);
 e1:
     if(sqlite3_finalize(stmt) != SQLITE_OK)
@@ -80,15 +123,54 @@ e0:
     return ret;
 }
 
-static bool set_last_update(sqlite3 *db, int id) {
-    time_t t = time(NULL);
-    const char sql[] = "update subs set last_update == ? where id == ?";
-    sqlite3_stmt *stmt = NULL;
-    sqlite3_prepare_v3(db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
-    if(!stmt)
+/**
+ * Estimates how long to wait before updating a subscription again.
+ * The average interval between its most recent videos is used as the expected
+ * posting frequency, backing off from subscriptions which have been quiet for
+ * longer than that.
+ */
+static bool next_update_delay(
+    sqlite3_stmt *stmt, int id, time_t now, i64 *p)
+{
+    bool ret = false;
+    if(!(
+        sqlite3_bind_int(stmt, 1, id) == SQLITE_OK
+        && sqlite3_bind_int(stmt, 2, SCHEDULE_HISTORY) == SQLITE_OK
+    ))
+        goto end;
+    for(;;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_ROW: ret = true; goto end;
+        default: goto end;
+        }
+end:
+    if(ret) {
+        const i64 n = sqlite3_column_int64(stmt, 0);
+        const i64 min = sqlite3_column_int64(stmt, 1);
+        const i64 max = sqlite3_column_int64(stmt, 2);
+        i64 delay = SCHEDULE_MAX_DELAY;
+        if(2 <= n)
+            delay = MAX((max - min) / (n - 1) / 2, ((i64)now - max) / 4);
+        *p = CLAMP(delay, SCHEDULE_MIN_DELAY, SCHEDULE_MAX_DELAY);
+    }
+    ret = sqlite3_reset(stmt) == SQLITE_OK && ret;
+    return ret;
+}
+
+static bool set_last_update(struct updater *u, int id) {
+    const time_t t = time(NULL);
+    i64 delay;
+    if(!next_update_delay(u->next_update_stmt, id, t, &delay))
         return false;
-    sqlite3_bind_int(stmt, 1, (int)t);
-    sqlite3_bind_int(stmt, 2, id);
+    sqlite3_stmt *const stmt = u->last_update_stmt;
+    sqlite3_bind_int64(stmt, 1, (i64)t);
+    sqlite3_bind_int64(stmt, 2, (i64)t + delay);
+    if(u->newest)
+        sqlite3_bind_int64(stmt, 3, u->newest);
+    else
+        sqlite3_bind_null(stmt, 3);
+    sqlite3_bind_int(stmt, 4, id);
     bool ret = false;
     for(;;) {
         switch(sqlite3_step(stmt)) {
@@ -99,10 +181,121 @@ static bool set_last_update(sqlite3 *db, int id) {
         }
     }
 end:
-    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
+    ret = sqlite3_reset(stmt) == SQLITE_OK && ret;
+    return ret;
+}
+
+/**
+ * Postpones the next update of a subscription which failed.
+ * The delay doubles with each consecutive failure, up to the maximum interval
+ * between scheduled updates.
+ */
+static bool set_retry(struct updater *u, int id) {
+    sqlite3_stmt *const stmt = u->retry_stmt;
+    const bool ret =
+        sqlite3_bind_int64(stmt, 1, (i64)time(NULL)) == SQLITE_OK
+        && sqlite3_bind_int(stmt, 2, SCHEDULE_RETRY_DELAY) == SQLITE_OK
+        && sqlite3_bind_int(stmt, 3, SCHEDULE_RETRY_MAX_SHIFT) == SQLITE_OK
+        && sqlite3_bind_int(stmt, 4, SCHEDULE_MAX_DELAY) == SQLITE_OK
+        && sqlite3_bind_int(stmt, 5, id) == SQLITE_OK
+        && step_stmt_once(stmt);
+    return sqlite3_reset(stmt) == SQLITE_OK && ret;
+}
+
+u64 update_items_hash(const struct buffer *b) {
+    const struct update_item *const v = b->p;
+    u64 ret = HASH_FNV1A_INIT;
+    for(size_t i = 0, n = b->n / sizeof(*v); i != n; ++i) {
+        ret = hash_fnv1a(ret, v[i].ext_id, strlen(v[i].ext_id) + 1);
+        ret = hash_fnv1a(ret, v[i].title, strlen(v[i].title) + 1);
+        ret = hash_fnv1a(ret, &v[i].timestamp, sizeof(v[i].timestamp));
+        ret = hash_fnv1a(
+            ret, &v[i].duration_seconds, sizeof(v[i].duration_seconds));
+    }
+    return ret;
+}
+
+bool update_cache_check(
+    struct updater *u, u32 flags, int id, size_t page, u64 hash,
+    bool *unchanged)
+{
+    *unchanged = false;
+    if(flags & UPDATE_NO_CACHE)
+        return true;
+    sqlite3_stmt *const stmt = u->cache_check_stmt;
+    int ret = -1;
+    if(
+        sqlite3_bind_int(stmt, 1, id) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 2, (i64)page) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 3, (i64)hash) == SQLITE_OK
+    )
+        ret = exists_query_stmt(stmt);
+    if(sqlite3_reset(stmt) != SQLITE_OK || ret == -1)
+        return false;
+    if((*unchanged = ret) && u->s->log_level)
+        fprintf(stderr, "page %zu unchanged since last update\n", page);
+    return true;
+}
+
+bool update_cache_store(struct updater *u, int id, size_t page, u64 hash) {
+    sqlite3_stmt *const stmt = u->cache_store_stmt;
+    const bool ret =
+        sqlite3_bind_int(stmt, 1, id) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 2, (i64)page) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 3, (i64)hash) == SQLITE_OK
+        && step_stmt_once(stmt);
+    return sqlite3_reset(stmt) == SQLITE_OK && ret;
+}
+
+bool update_checkpoint(
+    struct updater *u, int sub, int depth, size_t page, size_t n_pages)
+{
+    sqlite3_stmt *const stmt = u->checkpoint_stmt;
+    const bool ret =
+        sqlite3_bind_int(stmt, 1, sub) == SQLITE_OK
+        && sqlite3_bind_int(stmt, 2, depth) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 3, (i64)page) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 4, (i64)n_pages) == SQLITE_OK
+        && step_stmt_once(stmt);
+    return sqlite3_reset(stmt) == SQLITE_OK && ret;
+}
+
+/**
+ * Loads the checkpoint of an interrupted deep update.
+ * The update continues with the depth it was started with.
+ */
+static bool load_progress(struct updater *u, int id, int *depth) {
+    sqlite3_stmt *const stmt = u->progress_stmt;
+    if(sqlite3_bind_int(stmt, 1, id) != SQLITE_OK)
+        return false;
+    bool ret = false;
+    for(;;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_ROW:
+            *depth = sqlite3_column_int(stmt, 0);
+            u->resume_page = (size_t)sqlite3_column_int64(stmt, 1);
+            u->resume_n_pages = (size_t)sqlite3_column_int64(stmt, 2);
+            /* fallthrough */
+        case SQLITE_DONE: ret = true; /* fallthrough */
+        default: goto end;
+        }
+end:
+    ret = sqlite3_reset(stmt) == SQLITE_OK && ret;
+    if(ret && u->resume_page && u->s->log_level)
+        fprintf(stderr, "resuming from page %zu\n", u->resume_page);
     return ret;
 }
 
+/** Removes the checkpoint of a deep update once it is complete. */
+static bool clear_progress(struct updater *u, int id) {
+    sqlite3_stmt *const stmt = u->clear_progress_stmt;
+    const bool ret =
+        sqlite3_bind_int(stmt, 1, id) == SQLITE_OK
+        && step_stmt_once(stmt);
+    return sqlite3_reset(stmt) == SQLITE_OK && ret;
+}
+
 static bool report(sqlite3 *db, size_t initial_count) {
     size_t final_count = 0;
     if(!count_videos(db, &final_count))
@@ -114,52 +307,390 @@ static bool report(sqlite3 *db, size_t initial_count) {
     return true;
 }
 
-bool subs_update(
-    const struct subs *s, const struct http_client *http, uint32_t flags,
-    int depth, int delay, int since, size_t n, i64 *ids)
+static u64 known_key(int sub, const char *ext_id, size_t len) {
+    const u64 h = hash_fnv1a(HASH_FNV1A_INIT, &sub, sizeof(sub));
+    return hash_fnv1a(h, ext_id, len);
+}
+
+int update_known(
+    const struct updater *u, int sub, const char *ext_id, size_t len)
+{
+    if(!u->has_known)
+        return -1;
+    return hash_set_contains(&u->known, known_key(sub, ext_id, len));
+}
+
+bool update_known_add(
+    struct updater *u, int sub, const char *ext_id, size_t len)
+{
+    return !u->has_known
+        || hash_set_insert(&u->known, known_key(sub, ext_id, len));
+}
+
+static bool load_known(struct updater *u) {
+    const char sql[] = "select sub, ext_id from videos";
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(u->s->db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        return false;
+    hash_set_clear(&u->known);
+    bool ret = false;
+    for(;;) {
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_ROW: break;
+        case SQLITE_DONE: ret = true; /* fallthrough */
+        default: goto end;
+        }
+        const int sub = sqlite3_column_int(stmt, 0);
+        const char *const ext_id = (const char*)sqlite3_column_text(stmt, 1);
+        const size_t len = (size_t)sqlite3_column_bytes(stmt, 1);
+        if(!hash_set_insert(&u->known, known_key(sub, ext_id, len)))
+            goto end;
+    }
+end:
+    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
+    u->has_known = ret;
+    if(ret && u->s->log_level)
+        fprintf(stderr, "loaded %zu known video(s)\n", u->known.n);
+    return ret;
+}
+
+/**
+ * Loads the external ID of the newest video seen in the previous update.
+ * Only used for regular updates: deep updates and those which bypass the
+ * cache are meant to process every item.
+ */
+static bool load_last_video(
+    struct updater *u, u32 flags, int depth, int id, i64 video)
+{
+    struct buffer *const b = &u->last_video;
+    b->n = 0;
+    if(!video || depth != -1 || (flags & UPDATE_NO_CACHE))
+        return true;
+    sqlite3_stmt *const stmt = u->last_video_stmt;
+    if(!(
+        sqlite3_bind_int64(stmt, 1, video) == SQLITE_OK
+        && sqlite3_bind_int(stmt, 2, id) == SQLITE_OK
+    ))
+        return false;
+    bool ret = false;
+    for(;;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_ROW:
+            buffer_append(
+                b, sqlite3_column_text(stmt, 0),
+                (size_t)sqlite3_column_bytes(stmt, 0));
+            /* fallthrough */
+        case SQLITE_DONE: ret = true; /* fallthrough */
+        default: goto end;
+        }
+end:
+    ret = sqlite3_reset(stmt) == SQLITE_OK && ret;
+    return ret;
+}
+
+bool update_is_last_video(
+    const struct updater *u, const char *ext_id, size_t len)
+{
+    const struct buffer *const b = &u->last_video;
+    return b->n && b->n == len && memcmp(b->p, ext_id, len) == 0;
+}
+
+bool update_set_newest(
+    struct updater *u, int sub, const char *ext_id, size_t len, bool *found)
+{
+    sqlite3_stmt *const stmt = u->find_video_stmt;
+    if(!(
+        sqlite3_bind_int(stmt, 1, sub) == SQLITE_OK
+        && sqlite3_bind_text(stmt, 2, ext_id, (int)len, SQLITE_STATIC)
+            == SQLITE_OK
+    ))
+        return false;
+    bool ret = false;
+    *found = false;
+    for(;;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_ROW:
+            u->newest = sqlite3_column_int64(stmt, 0);
+            *found = true;
+            /* fallthrough */
+        case SQLITE_DONE: ret = true; /* fallthrough */
+        default: goto end;
+        }
+end:
+    ret = sqlite3_reset(stmt) == SQLITE_OK && ret;
+    return ret;
+}
+
+bool update_items_stop_at_last_video(
+    const struct updater *u, struct buffer *b)
+{
+    const struct update_item *const v = b->p;
+    const size_t n = b->n / sizeof(*v);
+    for(size_t i = 0; i != n; ++i)
+        if(update_is_last_video(u, v[i].ext_id, strlen(v[i].ext_id))) {
+            b->n = i * sizeof(*v);
+            return true;
+        }
+    return false;
+}
+
+bool update_items_set_newest(
+    struct updater *u, int id, const struct buffer *b)
+{
+    const struct update_item *const v = b->p;
+    const size_t n = b->n / sizeof(*v);
+    bool found = false;
+    for(size_t i = 0; !found && i != n; ++i)
+        if(!update_set_newest(
+            u, id, v[i].ext_id, strlen(v[i].ext_id), &found
+        ))
+            return false;
+    return true;
+}
+
+static bool insert(
+    struct updater *u, sqlite3_stmt *stmt, bool log,
+    int id, const struct update_item *item, int *acc);
+
+int update_insert_items(struct updater *u, int id, const struct buffer *b) {
+    const struct subs *const s = u->s;
+    sqlite3 *const db = s->db;
+    const struct update_item *p = b->p;
+    size_t n = b->n / sizeof(*p);
+    assert(n * sizeof(*p) == b->n);
+    const char sql[] =
+        "insert into videos (sub, ext_id, timestamp, duration_seconds, title)"
+        " values (?, ?, ?, ?, ?)"
+        " on conflict (sub, ext_id) do nothing;";
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        return -1;
+    bool ret = true;
+    int n_changes = 0;
+    for(p += n - 1; n--; --p)
+        if(!insert(u, stmt, 1 < s->log_level, id, p, &n_changes)) {
+            ret = false;
+            break;
+        }
+    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
+    return ret ? n_changes : -1;
+}
+
+static bool insert(
+    struct updater *u, sqlite3_stmt *stmt, bool log,
+    int id, const struct update_item *item, int *acc)
+{
+    const size_t len = strlen(item->ext_id);
+    u64 t = update_stats_now(u->stats);
+    const bool known = update_known(u, id, item->ext_id, len) == 1;
+    t = update_stats_phase(u->stats, UPDATE_PHASE_PROBE, t);
+    if(known)
+        return true;
+    sqlite3 *const db = u->s->db;
+    if(!(
+        sqlite3_bind_int(stmt, 1, id) == SQLITE_OK
+        && sqlite3_bind_text(
+            stmt, 2, item->ext_id, -1, SQLITE_STATIC) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 3, item->timestamp) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, 4, item->duration_seconds) == SQLITE_OK
+        && sqlite3_bind_text(
+            stmt, 5, item->title, -1, SQLITE_STATIC) == SQLITE_OK
+    ))
+        return false;
+    for(;;)
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_ROW:
+        case SQLITE_BUSY: continue;
+        case SQLITE_DONE: goto done;
+        default: return false;
+        }
+done:
+    update_stats_phase(u->stats, UPDATE_PHASE_INSERT, t);
+    if(sqlite3_changes(db)) {
+        if(!update_known_add(u, id, item->ext_id, len))
+            return false;
+        if(log)
+            fprintf(
+                stderr, "created new video: %" PRId64 " %d %s %" PRId64 " %"
+                    PRId64 " %s\n",
+                (i64)sqlite3_last_insert_rowid(db), id, item->ext_id,
+                item->timestamp, item->duration_seconds, item->title);
+        ++(*acc);
+    }
+    return sqlite3_reset(stmt) == SQLITE_OK;
+}
+
+static bool prepare(sqlite3 *db, const char *sql, sqlite3_stmt **p) {
+    sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, p, NULL);
+    return *p;
+}
+
+bool updater_init(
+    struct updater *u, const struct subs *s, const struct http_client *http)
 {
+    *u = (struct updater){
+        .s = s,
+        .http = http,
+        .youtube_backend = {
+            .init = update_youtube_init,
+            .destroy = update_youtube_destroy,
+        },
+    };
+    for(size_t i = 0; i != ARRAY_SIZE(u->rate); ++i)
+        rate_limiter_init(&u->rate[i], 0, 0);
+    sqlite3 *const db = s->db;
+    if(!(
+        prepare(
+            db,
+            "select count(*), min(timestamp), max(timestamp) from ("
+                "select timestamp from videos where sub == ?"
+                " order by timestamp desc limit ?"
+            ")",
+            &u->next_update_stmt)
+        && prepare(
+            db,
+            "update subs set"
+                " last_update = ?, next_update = ?,"
+                " last_video = coalesce(?, last_video), failures = 0"
+            " where id == ?",
+            &u->last_update_stmt)
+        && prepare(
+            db,
+            "update subs set"
+                " next_update ="
+                    " ? + min(? << min(failures, ?), ?),"
+                " failures = failures + 1"
+            " where id == ?",
+            &u->retry_stmt)
+        && prepare(
+            db, "select ext_id from videos where id == ? and sub == ?",
+            &u->last_video_stmt)
+        && prepare(
+            db, "select id from videos where sub == ? and ext_id == ?",
+            &u->find_video_stmt)
+        && prepare(
+            db,
+            "select depth, page, n_pages from update_progress where sub == ?",
+            &u->progress_stmt)
+        && prepare(
+            db,
+            "insert into update_progress (sub, depth, page, n_pages)"
+                " values (?, ?, ?, ?)"
+            " on conflict (sub) do update set"
+                " depth = excluded.depth, page = excluded.page,"
+                " n_pages = excluded.n_pages",
+            &u->checkpoint_stmt)
+        && prepare(
+            db, "delete from update_progress where sub == ?",
+            &u->clear_progress_stmt)
+        && prepare(
+            db,
+            "select 1 from update_cache"
+            " where sub == ? and page == ? and hash == ?",
+            &u->cache_check_stmt)
+        && prepare(
+            db,
+            "insert into update_cache (sub, page, hash) values (?, ?, ?)"
+            " on conflict (sub, page) do update set hash = excluded.hash",
+            &u->cache_store_stmt)
+    )) {
+        updater_destroy(u);
+        return false;
+    }
+    return true;
+}
+
+bool updater_destroy(struct updater *u) {
+    bool ret = true;
+    if(u->has_youtube)
+        ret = u->youtube_backend.destroy(u->youtube_backend.data, &u->youtube)
+            && ret;
+    ret = sqlite3_finalize(u->next_update_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->last_update_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->last_video_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->find_video_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->progress_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->checkpoint_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->clear_progress_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->retry_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->cache_check_stmt) == SQLITE_OK && ret;
+    ret = sqlite3_finalize(u->cache_store_stmt) == SQLITE_OK && ret;
+    free(u->b.p);
+    free(u->last_video.p);
+    free(u->sql.p);
+    hash_set_destroy(&u->known);
+    return ret;
+}
+
+bool updater_run(
+    struct updater *u, u32 flags, int depth, int delay, int since,
+    size_t n, const i64 *ids)
+{
+    const struct subs *const s = u->s;
     const bool verbose = s->log_level;
     sqlite3 *const db = s->db;
     bool ret = false;
     size_t subs_count = 0, videos_count = 0;
-    struct buffer sql = {0};
+    struct buffer *const sql = &u->sql;
+    const time_t now = time(NULL);
+    u->n_failed = 0;
+    update_stats_begin(u->stats);
+    if(!update_stats_trace(u->stats, db))
+        goto e0;
     if(verbose) {
-        if(!count_subs(db, &sql, since, &subs_count))
+        if(!count_subs(db, sql, flags, since, now, n, ids, &subs_count))
             goto e0;
         if(!count_videos(db, &videos_count))
             goto e0;
+        if(flags & UPDATE_SCHEDULE) {
+            size_t total = 0;
+            if(!count_subs(db, sql, 0, since, now, n, ids, &total))
+                goto e0;
+            fprintf(
+                stderr, "polling %zu of %zu subscription(s), %zu not due\n",
+                subs_count, total, total - subs_count);
+        }
     }
-    struct update_youtube youtube = {0};
-    const int needs_youtube = has_youtube(db, n, ids);
-    switch(needs_youtube) {
-    case -1:
-        goto e0;
-    case 1:
-        if(!update_youtube_init(&youtube))
+    /* The helper processes are kept running for subsequent updates. */
+    if(!u->has_youtube) {
+        switch(has_youtube(db, flags, since, now, n, ids)) {
+        case -1:
             goto e0;
+        case 1:
+            if(!u->youtube_backend.init(u->youtube_backend.data, &u->youtube))
+                goto e0;
+            u->has_youtube = true;
+        }
     }
-    sql.n = 0;
-    buffer_append_str(&sql, "select id, ext_id, type, name");
-    build_query_common(&sql, since);
-    if(n) {
-        buffer_str_append_str(&sql, " and id in (");
-        query_add_param_list(&sql, n);
-        buffer_str_append_str(&sql, ")");
-    }
-    buffer_str_append_str(&sql, " order by id");
+    sql->n = 0;
+    buffer_append_str(sql, "select id, ext_id, type, name, last_video");
+    build_query_common(sql, flags, since, n);
+    buffer_str_append_str(
+        sql,
+        flags & UPDATE_SCHEDULE ? " order by next_update, id" : " order by id");
+    /* Deep updates revisit pages which are mostly known, check those in
+     * memory instead of probing the database for each item. */
+    const bool deep = depth != -1 || (flags & UPDATE_RESUME);
+    if(deep && !load_known(u))
+        goto e0;
     sqlite3_stmt *stmt = NULL;
-    sqlite3_prepare_v3(db, sql.p, (int)sql.n, 0, &stmt, NULL);
+    sqlite3_prepare_v3(db, sql->p, (int)sql->n, 0, &stmt, NULL);
     if(!stmt)
+        goto e0;
+    if(bind_query_common(stmt, flags, since, now, n, ids) == -1)
         goto e1;
-    int i_param = 0;
-    if(since)
-        sqlite3_bind_int(stmt, ++i_param, since);
-    for(size_t i = 0; i != n; ++i)
-        sqlite3_bind_int64(stmt, ++i_param, ids[i]);
-    struct buffer b = {0};
     size_t i = 0;
     goto after_delay;
     for(;; ++i) {
+        if(u->poll && !u->poll(u->poll_data)) {
+            ret = true;
+            goto e1;
+        }
         if(delay)
             sleep((unsigned)delay);
 after_delay:
@@ -167,7 +698,7 @@ after_delay:
         case SQLITE_BUSY: continue;
         case SQLITE_ROW: break;
         case SQLITE_DONE: ret = true; /* fallthrough */
-        default: goto e2;
+        default: goto e1;
         }
         const int id = sqlite3_column_int(stmt, 0);
         if(!id)
@@ -178,32 +709,58 @@ after_delay:
             fprintf(
                 stderr, "[%zd/%zd] processing %d %s\n",
                 i, subs_count, id, sqlite3_column_text(stmt, 3));
+        update_stats_begin_sub(u->stats, id);
+        u->newest = 0;
+        u->resume_page = u->resume_n_pages = 0;
+        int sub_depth = depth;
+        if((flags & UPDATE_RESUME) && !load_progress(u, id, &sub_depth))
+            goto e1;
+        const i64 last_video = sqlite3_column_int64(stmt, 4);
+        if(!load_last_video(u, flags, sub_depth, id, last_video))
+            goto e1;
+        bool ok = false;
         switch(type) {
         case SUBS_LBRY:
-            if(!update_lbry(s, http, &b, flags, depth, id, ext_id))
-                goto e2;
+            ok = update_lbry(u, flags, sub_depth, id, ext_id);
             break;
         case SUBS_YOUTUBE:
-            if(!update_youtube(s, &youtube, &b, flags, depth, id, ext_id))
-                goto e2;
+            ok = update_youtube(u, flags, sub_depth, id, ext_id);
+            break;
+        case SUBS_LUA:
+            ok = update_lua(u, sub_depth, id, ext_id);
             break;
         default:
             log_err("%s: unsupported type: %d\n", __func__, type);
-            goto e2;
         }
-        if(!set_last_update(db, id))
-            goto e2;
-        b.n = 0;
+        ok = ok && set_last_update(u, id) && (!deep || clear_progress(u, id));
+        update_stats_end_sub(u->stats);
+        if(ok)
+            continue;
+        if(!(flags & UPDATE_KEEP_GOING) || !set_retry(u, id))
+            goto e1;
+        log_err("failed to update subscription %d, retrying later\n", id);
+        ++u->n_failed;
     }
-e2:
-    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
-    free(b.p);
 e1:
-    if(needs_youtube)
-        ret = update_youtube_destroy(&youtube) && ret;
+    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
 e0:
-    free(sql.p);
+    /* The database can change between runs. */
+    u->has_known = false;
+    ret = update_stats_untrace(u->stats, db) && ret;
+    update_stats_end(u->stats);
     if(verbose && !report(db, videos_count))
         ret = false;
     return ret;
 }
+
+bool subs_update(
+    const struct subs *s, const struct http_client *http, uint32_t flags,
+    int depth, int delay, int since, size_t n, i64 *ids)
+{
+    struct updater u;
+    if(!updater_init(&u, s, http))
+        return false;
+    bool ret = updater_run(&u, flags, depth, delay, since, n, ids);
+    ret = updater_destroy(&u) && ret;
+    return ret;
+}
@@ -5,26 +5,198 @@
 
 #include <unistd.h>
 
+#include <sqlite3.h>
+
+#include "buffer.h"
 #include "def.h"
+#include "hash_set.h"
+#include "rate.h"
+#include "subs.h"
+#include "update_stats.h"
 
-struct buffer;
 struct http_client;
-struct subs;
+
+enum update_flags {
+    /** Process every page, even if it is unchanged since the last update. */
+    UPDATE_NO_CACHE = (u32)1 << 0,
+    /** Only update subscriptions which are due according to their history. */
+    UPDATE_SCHEDULE = (u32)1 << 1,
+    /**
+     * Continue with the next subscription when one fails.  The failed
+     * subscription is rescheduled with an exponential backoff and counted in
+     * \ref updater::n_failed instead of aborting the run.
+     */
+    UPDATE_KEEP_GOING = (u32)1 << 2,
+    /**
+     * Only update subscriptions with an interrupted deep update, continuing
+     * from their last checkpoint, see \ref update_checkpoint.
+     */
+    UPDATE_RESUME = (u32)1 << 3,
+};
+
+/** Video found in a page, see \ref update_insert_items. */
+struct update_item {
+    const char *ext_id, *title;
+    i64 timestamp, duration_seconds;
+};
 
 struct update_youtube {
     pid_t channel_pid;
     int channel_r, channel_w;
     pid_t info_pid;
     int info_r, info_w;
+    /** Private data of the backend. */
+    void *priv;
+};
+
+typedef bool update_youtube_init_fn(void *p, struct update_youtube *u);
+typedef bool update_youtube_destroy_fn(void *p, struct update_youtube *u);
+
+/**
+ * Provides the helpers which list channel pages and video information.
+ * Requests and responses are exchanged through the file descriptors in
+ * \ref update_youtube.  By default, these are `yt-dlp` scripts executed by
+ * `python`, see \ref update_youtube_init.
+ */
+struct update_youtube_backend {
+    void *data;
+    update_youtube_init_fn *init;
+    update_youtube_destroy_fn *destroy;
+};
+
+/**
+ * Called between subscriptions, see \ref updater::poll.
+ * \returns whether the run should continue
+ */
+typedef bool update_poll_fn(void *p);
+
+/**
+ * State kept between updates.
+ * Helper processes, buffers, and prepared statements are reused by each call
+ * to \ref updater_run, so that a long-running process such as the daemon only
+ * pays for their initialization once.
+ */
+struct updater {
+    const struct subs *s;
+    const struct http_client *http;
+    bool has_youtube;
+    struct update_youtube_backend youtube_backend;
+    struct update_youtube youtube;
+    struct buffer b, sql;
+    sqlite3_stmt *next_update_stmt, *last_update_stmt;
+    sqlite3_stmt *last_video_stmt, *find_video_stmt;
+    sqlite3_stmt *progress_stmt, *checkpoint_stmt, *clear_progress_stmt;
+    sqlite3_stmt *retry_stmt, *cache_check_stmt, *cache_store_stmt;
+    /**
+     * External ID of the newest video seen in the previous update of the
+     * current subscription, empty if unknown, see \ref update_is_last_video.
+     */
+    struct buffer last_video;
+    /** Newest video seen in the current update, recorded as `last_video`. */
+    i64 newest;
+    /** Request rate limits for each \ref subs_type, unlimited by default. */
+    struct rate_limiter rate[SUBS_TYPE_MAX];
+    /** Number of subscriptions which failed in the last run. */
+    size_t n_failed;
+    /**
+     * Lets a long-running caller handle other events during a run, if set.
+     * A run stopped by it is not considered a failure.
+     */
+    update_poll_fn *poll;
+    void *poll_data;
+    /**
+     * Hashes of the existing `(sub, ext_id)` pairs, see \ref update_known.
+     * Only loaded for deep updates, where most items are already known.
+     */
+    struct hash_set known;
+    bool has_known;
+    /**
+     * First page to fetch for the current subscription and its total number
+     * of pages, if known.  Both are zero unless it is being resumed.
+     */
+    size_t resume_page, resume_n_pages;
+    /** Instrumentation of each run, disabled if null. */
+    struct update_stats *stats;
 };
 
+bool updater_init(
+    struct updater *u, const struct subs *s, const struct http_client *http);
+bool updater_destroy(struct updater *u);
+/** Performs one update pass, see \ref subs_update. */
+bool updater_run(
+    struct updater *u, u32 flags, int depth, int delay, int since,
+    size_t n, const i64 *ids);
+/**
+ * Hashes the fields of the \ref update_item array in \c b which are stored,
+ * so that changes to other parts of a response do not invalidate the cache.
+ */
+u64 update_items_hash(const struct buffer *b);
+bool update_cache_check(
+    struct updater *u, u32 flags, int id, size_t page, u64 hash,
+    bool *unchanged);
+bool update_cache_store(struct updater *u, int id, size_t page, u64 hash);
+/**
+ * Checks whether a video is known to exist.
+ * \returns \c -1 if the set of known videos is not loaded, \c 1 if the video
+ * exists, \c 0 otherwise.
+ */
+int update_known(
+    const struct updater *u, int sub, const char *ext_id, size_t len);
+/** Records a video inserted during the update, see \ref update_known. */
+bool update_known_add(
+    struct updater *u, int sub, const char *ext_id, size_t len);
+/**
+ * Checks whether the item is the newest video seen in the previous update.
+ * Pages are ordered from newest to oldest, so it and all items after it are
+ * known to have already been processed.
+ */
+bool update_is_last_video(
+    const struct updater *u, const char *ext_id, size_t len);
+/**
+ * Records a video as the newest in the subscription, if it exists.
+ * Should be called for items on the first page, in order, until \c found.
+ */
+bool update_set_newest(
+    struct updater *u, int sub, const char *ext_id, size_t len, bool *found);
+/**
+ * Removes the newest video seen in the previous update and all items after
+ * it from the \ref update_item array in \c b.
+ * \returns whether the video was found
+ */
+bool update_items_stop_at_last_video(
+    const struct updater *u, struct buffer *b);
+/** Calls \ref update_set_newest for the items of the first page. */
+bool update_items_set_newest(
+    struct updater *u, int id, const struct buffer *b);
+/**
+ * Inserts the \ref update_item array in \c b, oldest first.
+ * Videos which already exist are ignored.
+ * \returns the number of videos inserted, or \c -1 on errors
+ */
+int update_insert_items(struct updater *u, int id, const struct buffer *b);
+/**
+ * Records the progress of a deep update of a subscription.
+ * \param page the next page to be fetched, all previous ones having been
+ * processed
+ * \param n_pages the total number of pages, if known, otherwise \c 0
+ */
+bool update_checkpoint(
+    struct updater *u, int sub, int depth, size_t page, size_t n_pages);
 bool update_lbry(
-    const struct subs *s, const struct http_client *http, struct buffer *b,
-    u32 flags, int depth, int id, const char *ext_id);
-bool update_youtube_init(struct update_youtube *u);
-bool update_youtube_destroy(struct update_youtube *u);
+    struct updater *u, u32 flags, int depth, int id, const char *ext_id);
+/**
+ * Updates a subscription using the `subs_update` Lua function.
+ * It is called as `subs_update(sub_id, ext_id, page)` for each page, starting
+ * at 1, and returns an array of items and, optionally, the total number of
+ * pages.  Each item is a table with `ext_id` and `title` strings and
+ * `timestamp` and `duration_seconds` integers, which default to zero.  The
+ * update stops at an empty page, otherwise pages are processed as for the
+ * other types.
+ */
+bool update_lua(struct updater *u, int depth, int id, const char *ext_id);
+bool update_youtube_init(void *p, struct update_youtube *u);
+bool update_youtube_destroy(void *p, struct update_youtube *u);
 bool update_youtube(
-    const struct subs *s, struct update_youtube *u, struct buffer *b, u32 flags,
-    int depth, int id, const char *ext_id);
+    struct updater *u, u32 flags, int depth, int id, const char *ext_id);
 
 #endif
@@ -5,15 +5,11 @@
 #include "buffer.h"
 #include "http.h"
 #include "log.h"
+#include "queue.h"
 #include "subs.h"
 
 enum { DONE = 1, ERR };
 
-struct update_item {
-    const char *claim_id, *title;
-    i64 timestamp, duration_seconds;
-};
-
 static const char *POST_FMT = "{"
     "\"method\":\"claim_search\","
     "\"params\":{"
@@ -27,60 +23,256 @@ static cJSON *get_item(const cJSON *j, const char *k) {
     return cJSON_GetObjectItemCaseSensitive(j, k);
 }
 
-static cJSON *post(
+enum {
+    /** Maximum number of pages fetched ahead of processing. */
+    PIPELINE_DEPTH = 4,
+};
+
+/** A page of results, passed from the fetch to the write stage. */
+struct page {
+    size_t page;
+    struct buffer data;
+    cJSON *root;
+    /** Total number of pages, only set for the first page. */
+    size_t n_pages;
+    /**
+     * Time spent in the request and parsing the response, see
+     * \ref record_page.
+     */
+    u64 fetch_ns, parse_ns;
+    bool requested, ok;
+};
+
+/** State of the fetch stage of a pipelined update. */
+struct fetcher {
+    struct updater *u;
+    const char *ext_id;
+    int depth;
+    struct queue q;
+};
+
+static bool post(
     const struct http_client *http,
     const char *url, const char *id, size_t page,
     struct buffer *data, struct buffer *b);
+static cJSON *parse(const struct buffer *b);
 static bool get_result_info(const cJSON *j, size_t *n_pages);
+static bool max_depth(const struct subs *s, int depth, size_t page);
+static bool page_items(
+    struct updater *u, size_t page, const cJSON *root, struct buffer *b);
 static int process_page(
-    const struct subs *s, u32 flags, int depth, int id, size_t page,
-    const cJSON *root, struct buffer *items);
+    struct updater *u, int depth, int id, size_t page, struct buffer *b);
+static bool fetch_page(
+    struct updater *u, const char *ext_id, size_t page,
+    struct buffer *post_data, struct page *p);
+static void free_page(struct page *p);
+static void record_page(
+    struct updater *u, const struct page *p, bool pipelined);
+static int write_page(
+    struct updater *u, u32 flags, int depth, int id, const struct page *p,
+    size_t *n_pages);
+static bool update_pipelined(
+    struct updater *u, u32 flags, int depth, int id, const char *ext_id);
 
 bool update_lbry(
-    const struct subs *s, const struct http_client *http, struct buffer *b,
-    u32 flags, int depth, int id, const char *ext_id)
+    struct updater *u, u32 flags, int depth, int id, const char *ext_id)
 {
-    bool ret = false;
+    /* Every page is needed in a deep update, so they can be requested
+     * without waiting for the previous one to be processed. */
+    if(depth != -1)
+        return update_pipelined(u, flags, depth, id, ext_id);
     struct buffer post_data = {0};
-    cJSON *root = post(http, s->url, ext_id, 1, &post_data, b);
-    size_t n_pages;
-    if(!root || !get_result_info(root, &n_pages))
-        goto err0;
-    if(s->log_level)
-        fprintf(stderr, "total pages: %zu\n", n_pages);
-    if(!n_pages)
-        goto done;
-    for(size_t page = 1;;) {
-        b->n = 0;
-        switch(process_page(s, flags, depth, id, page, root, b)) {
-        case DONE: goto done;
-        case ERR: goto err1;
+    size_t n_pages = 0;
+    int r = 0;
+    for(size_t page = 1; !r; ++page) {
+        struct page p = {0};
+        const bool ok = fetch_page(u, ext_id, page, &post_data, &p);
+        record_page(u, &p, false);
+        r = ok ? write_page(u, flags, depth, id, &p, &n_pages) : ERR;
+        free_page(&p);
+    }
+    free(post_data.p);
+    return r != ERR;
+}
+
+/** Requests and parses one page, executed by the fetch stage. */
+static bool fetch_page(
+    struct updater *u, const char *ext_id, size_t page,
+    struct buffer *post_data, struct page *p)
+{
+    p->page = page;
+    post_data->n = 0;
+    if(!rate_limiter_wait(&u->rate[SUBS_LBRY]))
+        return false;
+    const u64 t = update_stats_now(u->stats);
+    p->requested = true;
+    const bool posted =
+        post(u->http, u->s->url, ext_id, page, post_data, &p->data);
+    const u64 t_posted = update_stats_now(u->stats);
+    p->fetch_ns = t_posted - t;
+    if(!posted)
+        return false;
+    if(!(p->root = parse(&p->data)))
+        return false;
+    if(page == 1 && !get_result_info(p->root, &p->n_pages))
+        return false;
+    p->parse_ns = update_stats_now(u->stats) - t_posted;
+    return p->ok = true;
+}
+
+static void free_page(struct page *p) {
+    cJSON_Delete(p->root);
+    free(p->data.p);
+}
+
+/**
+ * Adds the timing of the fetch stage to the statistics.
+ * Pages are timed in the fetch stage but only recorded in the write stage, so
+ * that the statistics are only accessed by the thread which runs the update.
+ * In a pipelined update, the fetch stage runs concurrently with the writes,
+ * so only the request latency is recorded: the phases are accounted as the
+ * time the write stage waits for each page, see \ref update_pipelined.
+ */
+static void record_page(
+    struct updater *u, const struct page *p, bool pipelined)
+{
+    struct update_stats *const stats = u->stats;
+    if(p->requested)
+        update_stats_request(stats, UPDATE_CHANNEL_HTTP, p->fetch_ns);
+    if(pipelined)
+        return;
+    update_stats_add(stats, UPDATE_PHASE_FETCH, p->fetch_ns);
+    update_stats_add(stats, UPDATE_PHASE_PARSE, p->parse_ns);
+}
+
+/**
+ * Inserts the videos in a page, executed by the write stage.
+ * This is the only stage which accesses the database.  Each page is written
+ * in a single transaction.
+ */
+static int write_page(
+    struct updater *u, u32 flags, int depth, int id, const struct page *p,
+    size_t *n_pages)
+{
+    const struct subs *const s = u->s;
+    const size_t page = p->page;
+    u->b.n = 0;
+    if(!page_items(u, page, p->root, &u->b))
+        return ERR;
+    /* Only the stored fields are hashed: responses also contain counters and
+     * signatures which change without any new videos. */
+    const u64 hash = update_items_hash(&u->b);
+    bool unchanged;
+    if(!update_cache_check(u, flags, id, page, hash, &unchanged))
+        return ERR;
+    if(unchanged && depth == -1)
+        return DONE;
+    if(page == 1) {
+        *n_pages = p->n_pages;
+        if(s->log_level)
+            fprintf(stderr, "total pages: %zu\n", *n_pages);
+        if(!*n_pages)
+            return DONE;
+    }
+    if(unchanged) {
+        if(max_depth(s, depth, page))
+            return DONE;
+    } else {
+        sqlite3 *const db = s->db;
+        if(sqlite3_exec(db, "begin", NULL, NULL, NULL) != SQLITE_OK)
+            return ERR;
+        const int r = process_page(u, depth, id, page, &u->b);
+        if(r == ERR || !update_cache_store(u, id, page, hash)) {
+            sqlite3_exec(db, "rollback", NULL, NULL, NULL);
+            return ERR;
+        }
+        if(sqlite3_exec(db, "commit", NULL, NULL, NULL) != SQLITE_OK)
+            return ERR;
+        if(r == DONE)
+            return DONE;
+    }
+    if(depth != -1 && !update_checkpoint(u, id, depth, page + 1, *n_pages))
+        return ERR;
+    return page == *n_pages ? DONE : 0;
+}
+
+static int fetch_pages(void *data) {
+    struct fetcher *const f = data;
+    struct buffer post_data = {0};
+    const size_t start = MAX(f->u->resume_page, 1);
+    size_t n_pages = start == 1 ? 1 : f->u->resume_n_pages;
+    for(size_t page = start; page <= n_pages; ++page) {
+        struct page *const p = checked_calloc(1, sizeof(*p));
+        if(!p)
+            break;
+        fetch_page(f->u, f->ext_id, page, &post_data, p);
+        if(page == 1)
+            n_pages = p->n_pages;
+        const bool ok = p->ok;
+        if(!queue_push(&f->q, p)) {
+            free_page(p);
+            free(p);
+            break;
         }
-        if(page++ == n_pages)
+        if(!ok || (f->depth && (size_t)(f->depth - 1) <= page))
             break;
-        b->n = post_data.n = 0;
-        cJSON_Delete(root);
-        root = post(http, s->url, ext_id, page, &post_data, b);
-        if(!root)
-            goto err1;
     }
-done:
-    ret = true;
-err1:
-    cJSON_Delete(root);
-err0:
     free(post_data.p);
-    return ret;
+    queue_close(&f->q);
+    return 0;
+}
+
+/**
+ * Updates a subscription with a two-stage pipeline.
+ * A separate thread fetches and parses pages while the current thread writes
+ * them, connected by a bounded queue.  Once the write stage is done (or
+ * fails), the queue is closed, which stops the fetch stage.
+ */
+static bool update_pipelined(
+    struct updater *u, u32 flags, int depth, int id, const char *ext_id)
+{
+    struct fetcher f = {.u = u, .ext_id = ext_id, .depth = depth};
+    if(!queue_init(&f.q, PIPELINE_DEPTH))
+        return false;
+    thrd_t t;
+    if(thrd_create(&t, fetch_pages, &f) != thrd_success) {
+        LOG_ERR("failed to create thread\n", 0);
+        queue_destroy(&f.q);
+        return false;
+    }
+    size_t n_pages = u->resume_n_pages;
+    int r = 0;
+    for(;;) {
+        const u64 wait = update_stats_now(u->stats);
+        void *v = NULL;
+        const bool popped = queue_pop(&f.q, &v);
+        update_stats_phase(u->stats, UPDATE_PHASE_FETCH, wait);
+        if(!popped)
+            break;
+        struct page *const p = v;
+        record_page(u, p, true);
+        if(!r)
+            r = p->ok ? write_page(u, flags, depth, id, p, &n_pages) : ERR;
+        if(r)
+            queue_close(&f.q);
+        free_page(p);
+        free(p);
+    }
+    thrd_join(t, NULL);
+    queue_destroy(&f.q);
+    return r != ERR;
 }
 
-static cJSON *post(
+static bool post(
     const struct http_client *http,
     const char *url, const char *id, size_t page,
     struct buffer *data, struct buffer *b)
 {
     buffer_printf(data, POST_FMT, id, page);
-    if(!http->post(http->data, url, data->p, b))
-        return NULL;
+    return http->post(http->data, url, data->p, b);
+}
+
+static cJSON *parse(const struct buffer *b) {
     cJSON *const ret = cJSON_ParseWithLength(b->p, b->n);
     if(!ret) {
         const char *const e = cJSON_GetErrorPtr();
@@ -105,34 +297,51 @@ static bool get_result_info(const cJSON *j, size_t *n_pages_p) {
 
 static bool list_to_items(
     const struct subs *s, const cJSON *items, struct buffer *b);
-static int process(const struct subs *s, int id, const struct buffer *b);
 
-static int process_page(
-    const struct subs *s, u32 flags, int depth, int id, size_t page,
-    const cJSON *j, struct buffer *b)
+static bool page_items(
+    struct updater *u, size_t page, const cJSON *j, struct buffer *b)
 {
-    (void)flags;
-    const bool verbose = s->log_level;
+    const struct subs *const s = u->s;
     const cJSON *const result = get_item(j, "result");
     if(!result)
-        return LOG_ERR("'result' missing\n", 0), ERR;
+        return LOG_ERR("'result' missing\n", 0), false;
     const cJSON *const items = get_item(result, "items");
     if(!items)
-        return LOG_ERR("'result.items' missing\n", 0), ERR;
+        return LOG_ERR("'result.items' missing\n", 0), false;
     const int page_size = cJSON_GetArraySize(items);
     if(page_size < 0) {
-        LOG_ERR("invalid page size (page %d): %d)\n", page, page_size);
-        return ERR;
+        LOG_ERR("invalid page size (page %zu): %d\n", page, page_size);
+        return false;
     }
-    if(verbose)
+    if(s->log_level)
         fprintf(stderr, "page %zu, size %d\n", page, page_size);
     buffer_reserve(b, (size_t)page_size * sizeof(struct update_item));
+    const u64 t = update_stats_now(u->stats);
     if(!list_to_items(s, items, b))
+        return false;
+    update_stats_phase(u->stats, UPDATE_PHASE_PARSE, t);
+    return true;
+}
+
+static int process_page(
+    struct updater *u, int depth, int id, size_t page, struct buffer *b)
+{
+    const struct subs *const s = u->s;
+    const bool verbose = s->log_level;
+    const bool stop = update_items_stop_at_last_video(u, b);
+    const int n_updated = update_insert_items(u, id, b);
+    if(n_updated == -1)
         return ERR;
-    const int n_updated = process(s, id, b);
-    switch(n_updated) {
-    case -1:
+    if(page == 1 && !update_items_set_newest(u, id, b))
         return ERR;
+    if(stop) {
+        if(verbose)
+            fprintf(
+                stderr, "added %d new video(s), reached last known video\n",
+                n_updated);
+        return DONE;
+    }
+    switch(n_updated) {
     case 0:
         if(depth != -1)
             break;
@@ -145,12 +354,15 @@ static int process_page(
     }
     if(verbose)
         fprintf(stderr, "added %d new video(s)\n", n_updated);
-    if(page == (size_t)(depth - 1)) {
-        if(verbose)
-            fputs("maximum depth reached\n", stderr);
-        return DONE;
-    }
-    return 0;
+    return max_depth(s, depth, page) ? DONE : 0;
+}
+
+static bool max_depth(const struct subs *s, int depth, size_t page) {
+    if(page != (size_t)(depth - 1))
+        return false;
+    if(s->log_level)
+        fputs("maximum depth reached\n", stderr);
+    return true;
 }
 
 static i64 lbry_timestamp(
@@ -225,7 +437,7 @@ static bool list_to_items(
         if(duration_seconds == -1)
             return false;
         BUFFER_APPEND(b, (&(struct update_item){
-            .claim_id = id,
+            .ext_id = id,
             .title = title->valuestring,
             .timestamp = timestamp,
             .duration_seconds = duration_seconds,
@@ -233,65 +445,3 @@ static bool list_to_items(
     }
     return true;
 }
-
-static bool insert(
-    sqlite3 *db, sqlite3_stmt *stmt, bool log,
-    int id, const struct update_item *item, int *acc);
-
-static int process(const struct subs *s, int id, const struct buffer *b) {
-    sqlite3 *const db = s->db;
-    const struct update_item *p = b->p;
-    size_t n = b->n / sizeof(*p);
-    assert(n * sizeof(*p) == b->n);
-    const char sql[] =
-        "insert into videos (sub, ext_id, timestamp, duration_seconds, title)"
-        " values (?, ?, ?, ?, ?)"
-        " on conflict (sub, ext_id) do nothing;";
-    sqlite3_stmt *stmt = NULL;
-    sqlite3_prepare_v3(db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
-    if(!stmt)
-        return -1;
-    bool ret = true;
-    int n_changes = 0;
-    for(p += n - 1; n--; --p)
-        if(!insert(db, stmt, 1 < s->log_level, id, p, &n_changes)) {
-            ret = false;
-            break;
-        }
-    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
-    return ret ? n_changes : -1;
-}
-
-static bool insert(
-    sqlite3 *db, sqlite3_stmt *stmt, bool log,
-    int id, const struct update_item *item, int *acc)
-{
-    if(!(
-        sqlite3_bind_int(stmt, 1, id) == SQLITE_OK
-        && sqlite3_bind_text(
-            stmt, 2, item->claim_id, -1, SQLITE_STATIC) == SQLITE_OK
-        && sqlite3_bind_int64(stmt, 3, item->timestamp) == SQLITE_OK
-        && sqlite3_bind_int64(stmt, 4, item->duration_seconds) == SQLITE_OK
-        && sqlite3_bind_text(
-            stmt, 5, item->title, -1, SQLITE_STATIC) == SQLITE_OK
-    ))
-        return false;
-    for(;;)
-        switch(sqlite3_step(stmt)) {
-        case SQLITE_ROW:
-        case SQLITE_BUSY: continue;
-        case SQLITE_DONE: goto done;
-        default: return false;
-        }
-done:
-    if(sqlite3_changes(db)) {
-        if(log)
-            fprintf(
-                stderr, "created new video: %" PRId64 " %d %s %" PRId64 " %"
-                    PRId64 " %s\n",
-                (i64)sqlite3_last_insert_rowid(db), id, item->claim_id,
-                item->timestamp, item->duration_seconds, item->title);
-        ++(*acc);
-    }
-    return sqlite3_reset(stmt) == SQLITE_OK;
-}
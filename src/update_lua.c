@@ -0,0 +1,174 @@
+#include "update.h"
+
+#include <lua.h>
+
+#include "buffer.h"
+#include "log.h"
+#include "subs.h"
+
+enum { DONE = 1, ERR };
+
+/**
+ * Pushes the string field \p k of table \p i.
+ * The value is left on the stack to keep \p p valid.
+ */
+static bool get_str(lua_State *L, int i, const char *k, const char **p) {
+    lua_pushstring(L, k);
+    if(lua_rawget(L, i) != LUA_TSTRING)
+        return LOG_ERR("subs_update: item %s is not a string\n", k), false;
+    *p = lua_tostring(L, -1);
+    return true;
+}
+
+static bool get_int(lua_State *L, int i, const char *k, i64 *p) {
+    bool ret = true;
+    lua_pushstring(L, k);
+    switch(lua_rawget(L, i)) {
+    case LUA_TNIL: *p = 0; break;
+    case LUA_TNUMBER:
+        if(lua_isinteger(L, -1)) {
+            *p = (i64)lua_tointeger(L, -1);
+            break;
+        }
+        /* fallthrough */
+    default:
+        LOG_ERR("subs_update: item %s is not an integer\n", k);
+        ret = false;
+    }
+    lua_pop(L, 1);
+    return ret;
+}
+
+/**
+ * Converts the array of items returned by `subs_update`.
+ * Fields are read without metamethods.  Each item and its strings are pushed
+ * onto the stack, since the pointers in \p b refer to them: they must not be
+ * popped until the items are no longer used.
+ */
+static bool to_items(lua_State *L, int i, struct buffer *b) {
+    switch(lua_type(L, i)) {
+    case LUA_TNIL: return true;
+    case LUA_TTABLE: break;
+    default: return LOG_ERR("subs_update: expected a table\n", 0), false;
+    }
+    const lua_Integer n = (lua_Integer)lua_rawlen(L, i);
+    buffer_reserve(b, (size_t)n * sizeof(struct update_item));
+    for(lua_Integer j = 1; j <= n; ++j) {
+        if(!lua_checkstack(L, 4))
+            return LOG_ERR("subs_update: too many items\n", 0), false;
+        if(lua_rawgeti(L, i, j) != LUA_TTABLE) {
+            LOG_ERR("subs_update: item %lld is not a table\n", (long long)j);
+            return false;
+        }
+        const int t = lua_gettop(L);
+        struct update_item item = {0};
+        if(!(
+            get_str(L, t, "ext_id", &item.ext_id)
+            && get_str(L, t, "title", &item.title)
+            && get_int(L, t, "timestamp", &item.timestamp)
+            && get_int(L, t, "duration_seconds", &item.duration_seconds)
+        ))
+            return false;
+        BUFFER_APPEND(b, &item);
+    }
+    return true;
+}
+
+static bool max_depth(bool verbose, int depth, size_t page) {
+    if(page != (size_t)(depth - 1))
+        return false;
+    if(verbose)
+        fputs("maximum depth reached\n", stderr);
+    return true;
+}
+
+/** Inserts the items of a page in a single transaction. */
+static int write_page(
+    struct updater *u, int depth, int id, size_t page, size_t n_pages,
+    struct buffer *b)
+{
+    sqlite3 *const db = u->s->db;
+    const bool verbose = u->s->log_level;
+    const size_t n = b->n / sizeof(struct update_item);
+    if(verbose)
+        fprintf(stderr, "page %zu, size %zu\n", page, n);
+    if(!n)
+        return DONE;
+    const bool stop = update_items_stop_at_last_video(u, b);
+    if(sqlite3_exec(db, "begin", NULL, NULL, NULL) != SQLITE_OK)
+        return ERR;
+    const int n_updated = update_insert_items(u, id, b);
+    if(n_updated == -1 || (page == 1 && !update_items_set_newest(u, id, b))) {
+        sqlite3_exec(db, "rollback", NULL, NULL, NULL);
+        return ERR;
+    }
+    if(sqlite3_exec(db, "commit", NULL, NULL, NULL) != SQLITE_OK)
+        return ERR;
+    if(depth != -1 && !update_checkpoint(u, id, depth, page + 1, n_pages))
+        return ERR;
+    if(stop) {
+        if(verbose)
+            fprintf(
+                stderr, "added %d new video(s), reached last known video\n",
+                n_updated);
+        return DONE;
+    }
+    if(!n_updated && depth == -1) {
+        if(verbose)
+            fputs(
+                "page has no new videos"
+                " (use a deep update to unconditionally fetch all pages)\n",
+                stderr);
+        return DONE;
+    }
+    if(verbose)
+        fprintf(stderr, "added %d new video(s)\n", n_updated);
+    if(n_pages && n_pages <= page)
+        return DONE;
+    return max_depth(verbose, depth, page) ? DONE : 0;
+}
+
+bool update_lua(struct updater *u, int depth, int id, const char *ext_id) {
+    lua_State *const L = u->s->L;
+    if(!L)
+        return LOG_ERR("Lua is not initialized\n", 0), false;
+    const int top = lua_gettop(L);
+    lua_pushcfunction(L, subs_lua_msgh);
+    const int msgh = lua_gettop(L);
+    struct buffer b = {0};
+    size_t n_pages = u->resume_n_pages;
+    int r = 0;
+    for(size_t page = MAX(u->resume_page, 1); !r; ++page) {
+        if(!rate_limiter_wait(&u->rate[SUBS_LUA])) {
+            r = ERR;
+            break;
+        }
+        if(lua_getglobal(L, "subs_update") != LUA_TFUNCTION) {
+            LOG_ERR("subs_update is not a function\n", 0);
+            r = ERR;
+            break;
+        }
+        lua_pushinteger(L, id);
+        lua_pushstring(L, ext_id);
+        lua_pushinteger(L, (lua_Integer)page);
+        u64 t = update_stats_now(u->stats);
+        if(lua_pcall(L, 3, 2, msgh) != LUA_OK) {
+            r = ERR;
+            break;
+        }
+        t = update_stats_phase(u->stats, UPDATE_PHASE_FETCH, t);
+        if(lua_isinteger(L, -1))
+            n_pages = (size_t)lua_tointeger(L, -1);
+        b.n = 0;
+        if(!to_items(L, msgh + 1, &b)) {
+            r = ERR;
+            break;
+        }
+        update_stats_phase(u->stats, UPDATE_PHASE_PARSE, t);
+        r = write_page(u, depth, id, page, n_pages, &b);
+        lua_settop(L, msgh);
+    }
+    lua_settop(L, top);
+    free(b.p);
+    return r != ERR;
+}
@@ -0,0 +1,199 @@
+#include "update_stats.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "db.h"
+#include "log.h"
+
+static const char *const PHASE_NAMES[] = {
+    [UPDATE_PHASE_FETCH] = "fetch",
+    [UPDATE_PHASE_PARSE] = "parse",
+    [UPDATE_PHASE_PROBE] = "probe",
+    [UPDATE_PHASE_INSERT] = "insert",
+};
+
+static const char *const CHANNEL_NAMES[] = {
+    [UPDATE_CHANNEL_HTTP] = "http",
+    [UPDATE_CHANNEL_YT_DLP] = "yt-dlp",
+};
+
+static struct update_sub_stats *current(struct update_stats *s) {
+    const size_t n = s->subs.n / sizeof(struct update_sub_stats);
+    return n ? (struct update_sub_stats*)s->subs.p + n - 1 : NULL;
+}
+
+void update_stats_destroy(struct update_stats *s) {
+    free(s->subs.p);
+}
+
+u64 update_stats_now(const struct update_stats *s) {
+    if(!s)
+        return 0;
+    struct timespec t;
+    if(clock_gettime(CLOCK_MONOTONIC, &t) == -1)
+        return LOG_ERRNO("clock_gettime", 0), 0;
+    return (u64)t.tv_sec * 1000000000 + (u64)t.tv_nsec;
+}
+
+void update_stats_begin(struct update_stats *s) {
+    if(!s)
+        return;
+    struct buffer subs = s->subs;
+    subs.n = 0;
+    *s = (struct update_stats){
+        .time = time(NULL),
+        .start = update_stats_now(s),
+        .subs = subs,
+    };
+}
+
+void update_stats_end(struct update_stats *s) {
+    if(s)
+        s->wall = update_stats_now(s) - s->start;
+}
+
+void update_stats_begin_sub(struct update_stats *s, i64 id) {
+    if(s)
+        BUFFER_APPEND(&s->subs, (&(struct update_sub_stats){
+            .id = id,
+            .wall = update_stats_now(s),
+        }));
+}
+
+void update_stats_end_sub(struct update_stats *s) {
+    struct update_sub_stats *const p = s ? current(s) : NULL;
+    if(p)
+        p->wall = update_stats_now(s) - p->wall;
+}
+
+void update_stats_add(struct update_stats *s, enum update_phase p, u64 ns) {
+    if(!s)
+        return;
+    s->phase[p] += ns;
+    struct update_sub_stats *const sub = current(s);
+    if(sub)
+        sub->phase[p] += ns;
+}
+
+u64 update_stats_phase(struct update_stats *s, enum update_phase p, u64 t) {
+    const u64 now = update_stats_now(s);
+    update_stats_add(s, p, now - t);
+    return now;
+}
+
+size_t update_stats_bucket(u64 ns) {
+    size_t i = 0;
+    for(u64 ms = ns / 1000000; ms && i != UPDATE_LATENCY_BUCKETS - 1; ms /= 2)
+        ++i;
+    return i;
+}
+
+void update_stats_request(
+    struct update_stats *s, enum update_channel c, u64 ns)
+{
+    if(!s)
+        return;
+    ++s->latency[c][update_stats_bucket(ns)];
+    ++s->n_requests;
+    struct update_sub_stats *const sub = current(s);
+    if(sub)
+        ++sub->n_requests;
+}
+
+static int trace(unsigned type, void *data, void *p, void *x) {
+    (void)type, (void)p, (void)x;
+    struct update_stats *const s = data;
+    ++s->n_statements;
+    return 0;
+}
+
+bool update_stats_trace(struct update_stats *s, sqlite3 *db) {
+    return !s
+        || sqlite3_trace_v2(db, SQLITE_TRACE_STMT, trace, s) == SQLITE_OK;
+}
+
+bool update_stats_untrace(struct update_stats *s, sqlite3 *db) {
+    return !s || sqlite3_trace_v2(db, 0, NULL, NULL) == SQLITE_OK;
+}
+
+static void append(struct buffer *b, const char *fmt, ...) {
+    char v[128];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(v, sizeof(v), fmt, args);
+    va_end(args);
+    (b->n ? buffer_str_append_str : buffer_append_str)(b, v);
+}
+
+static double ms(u64 ns) {
+    return (double)ns / 1e6;
+}
+
+static void append_phases(struct buffer *b, const u64 v[UPDATE_PHASE_MAX]) {
+    for(size_t i = 0; i != UPDATE_PHASE_MAX; ++i)
+        append(b, ",\"%s_ms\":%.3f", PHASE_NAMES[i], ms(v[i]));
+}
+
+void update_stats_json(const struct update_stats *s, struct buffer *b) {
+    append(
+        b, "{\"time\":%jd,\"wall_ms\":%.3f", (intmax_t)s->time, ms(s->wall));
+    append_phases(b, s->phase);
+    append(
+        b, ",\"requests\":%" PRIu64 ",\"statements\":%" PRIu64,
+        s->n_requests, s->n_statements);
+    append(b, ",\"latency\":{\"bounds_ms\":[");
+    for(size_t i = 0; i != UPDATE_LATENCY_BUCKETS - 1; ++i)
+        append(b, "%s%" PRIu64, i ? "," : "", (u64)1 << i);
+    append(b, "]");
+    for(size_t c = 0; c != UPDATE_CHANNEL_MAX; ++c) {
+        append(b, ",\"%s\":[", CHANNEL_NAMES[c]);
+        for(size_t i = 0; i != UPDATE_LATENCY_BUCKETS; ++i)
+            append(b, "%s%" PRIu64, i ? "," : "", s->latency[c][i]);
+        append(b, "]");
+    }
+    append(b, "},\"subs\":[");
+    const struct update_sub_stats *const v = s->subs.p;
+    const size_t n = s->subs.n / sizeof(*v);
+    for(size_t i = 0; i != n; ++i) {
+        append(
+            b, "%s{\"id\":%" PRId64 ",\"wall_ms\":%.3f",
+            i ? "," : "", v[i].id, ms(v[i].wall));
+        append_phases(b, v[i].phase);
+        append(b, ",\"requests\":%" PRIu64 "}", v[i].n_requests);
+    }
+    append(b, "]}");
+}
+
+bool update_stats_store(const struct update_stats *s, sqlite3 *db) {
+    const char sql[] =
+        "insert into update_runs ("
+            "time, wall_ms, fetch_ms, parse_ms, probe_ms, insert_ms,"
+            " n_subs, n_requests, n_statements, stats"
+        ") values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        return false;
+    struct buffer json = {0};
+    update_stats_json(s, &json);
+    int i = 0;
+    bool ret =
+        sqlite3_bind_int64(stmt, ++i, (i64)s->time) == SQLITE_OK
+        && sqlite3_bind_double(stmt, ++i, ms(s->wall)) == SQLITE_OK;
+    for(size_t p = 0; ret && p != UPDATE_PHASE_MAX; ++p)
+        ret = sqlite3_bind_double(stmt, ++i, ms(s->phase[p])) == SQLITE_OK;
+    ret = ret
+        && sqlite3_bind_int64(
+            stmt, ++i,
+            (i64)(s->subs.n / sizeof(struct update_sub_stats))) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, ++i, (i64)s->n_requests) == SQLITE_OK
+        && sqlite3_bind_int64(stmt, ++i, (i64)s->n_statements) == SQLITE_OK
+        && sqlite3_bind_text(
+            stmt, ++i, json.p, (int)json.n - 1, SQLITE_STATIC) == SQLITE_OK
+        && step_stmt_once(stmt);
+    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
+    free(json.p);
+    return ret;
+}
@@ -0,0 +1,95 @@
+#ifndef SUBS_UPDATE_STATS_H
+#define SUBS_UPDATE_STATS_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+#include "buffer.h"
+#include "def.h"
+
+/** Stages of the update of a subscription which are timed separately. */
+enum update_phase {
+    /** Waiting for HTTP responses and helper processes. */
+    UPDATE_PHASE_FETCH,
+    /** Decoding responses into items. */
+    UPDATE_PHASE_PARSE,
+    /** Checking which items already exist. */
+    UPDATE_PHASE_PROBE,
+    /** Inserting new items. */
+    UPDATE_PHASE_INSERT,
+    UPDATE_PHASE_MAX,
+};
+
+/** Sources of requests whose latency is recorded. */
+enum update_channel {
+    UPDATE_CHANNEL_HTTP,
+    UPDATE_CHANNEL_YT_DLP,
+    UPDATE_CHANNEL_MAX,
+};
+
+enum {
+    /**
+     * Number of buckets in latency histograms.
+     * Bucket \c i counts requests which took less than `2^i` milliseconds,
+     * the last one counts all others.
+     */
+    UPDATE_LATENCY_BUCKETS = 16,
+};
+
+struct update_sub_stats {
+    i64 id;
+    /** Durations, in nanoseconds. */
+    u64 wall, phase[UPDATE_PHASE_MAX];
+    u64 n_requests;
+};
+
+/**
+ * Instrumentation of an update run.
+ * All functions accept a null pointer, in which case nothing is recorded.
+ * Values must only be recorded from the thread which runs the update.
+ */
+struct update_stats {
+    /** Unix time at which the run started. */
+    time_t time;
+    /** Durations, in nanoseconds. */
+    u64 start, wall, phase[UPDATE_PHASE_MAX];
+    u64 latency[UPDATE_CHANNEL_MAX][UPDATE_LATENCY_BUCKETS];
+    u64 n_requests, n_statements;
+    /** \ref update_sub_stats for each subscription, in update order. */
+    struct buffer subs;
+};
+
+void update_stats_destroy(struct update_stats *s);
+/** Monotonic time in nanoseconds, \c 0 if \c s is null. */
+u64 update_stats_now(const struct update_stats *s);
+/** Resets all values and starts timing a run. */
+void update_stats_begin(struct update_stats *s);
+void update_stats_end(struct update_stats *s);
+void update_stats_begin_sub(struct update_stats *s, i64 id);
+void update_stats_end_sub(struct update_stats *s);
+/** Adds \c ns to a phase of the current subscription. */
+void update_stats_add(struct update_stats *s, enum update_phase p, u64 ns);
+/**
+ * Adds the time since \c t to a phase.
+ * \returns the current time, so that consecutive phases can be chained.
+ */
+u64 update_stats_phase(struct update_stats *s, enum update_phase p, u64 t);
+/**
+ * Records the latency of a request.
+ * Requests can be made ahead of time, so this is not accounted as fetch time,
+ * which is only the time spent waiting for them.
+ */
+void update_stats_request(
+    struct update_stats *s, enum update_channel c, u64 ns);
+size_t update_stats_bucket(u64 ns);
+/** Counts statements executed in \c db while the run is in progress. */
+bool update_stats_trace(struct update_stats *s, sqlite3 *db);
+bool update_stats_untrace(struct update_stats *s, sqlite3 *db);
+/** Formats the statistics as a JSON object. */
+void update_stats_json(const struct update_stats *s, struct buffer *b);
+/** Records a run in the `update_runs` table. */
+bool update_stats_store(const struct update_stats *s, sqlite3 *db);
+
+#endif
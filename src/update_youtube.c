@@ -5,6 +5,7 @@
 #include <sqlite3.h>
 
 #include "buffer.h"
+#include "db.h"
 #include "log.h"
 #include "subs.h"
 #include "unix.h"
@@ -72,7 +73,8 @@ static const char *VIDEO_INFO =
 
 #undef LOGGER
 
-bool update_youtube_init(struct update_youtube *u) {
+bool update_youtube_init(void *p, struct update_youtube *u) {
+    (void)p;
     *u = (struct update_youtube){
         .channel_pid = -1,
         .channel_r   = -1,
@@ -89,7 +91,8 @@ bool update_youtube_init(struct update_youtube *u) {
             &u->info_pid, &u->info_r, &u->info_w);
 }
 
-bool update_youtube_destroy(struct update_youtube *p) {
+bool update_youtube_destroy(void *data, struct update_youtube *p) {
+    (void)data;
     bool ret = true;
     if(p->channel_r != -1 && close(p->channel_r) == -1)
         LOG_ERRNO("close", 0), ret = false;
@@ -106,67 +109,210 @@ bool update_youtube_destroy(struct update_youtube *p) {
     return ret;
 }
 
+static bool is_last_page(const struct buffer *b);
+static bool max_depth(bool verbose, int depth, size_t page);
 static enum result process(
-    sqlite3 *db, const struct update_youtube *u, const struct buffer *input,
-    u32 flags, int depth, bool verbose, struct buffer *b, size_t page, int id,
-    int *n);
+    struct updater *u, const struct buffer *input, u32 flags, int depth,
+    bool verbose, struct buffer *b, size_t page, int id, int *n,
+    bool *skipped);
+
+static bool request_page(
+    struct updater *u, struct buffer *b, const char *ext_id, size_t page,
+    u64 *t);
+static bool read_page(const struct update_youtube *u, struct buffer *b);
 
 bool update_youtube(
-    const struct subs *s, struct update_youtube *u, struct buffer *b, u32 flags,
-    int depth, int id, const char *ext_id)
+    struct updater *u, u32 flags, int depth, int id, const char *ext_id)
 {
-    sqlite3 *const db = s->db;
+    const struct subs *const s = u->s;
+    struct buffer *const b = &u->b;
     const bool verbose = s->log_level;
     struct buffer tmp = {0};
-    bool ret = false;
-    for(size_t page = 0;; ++page) {
+    bool ret = false, pending = false;
+    u64 t_request = 0;
+    for(size_t page = u->resume_page;; ++page) {
         if(verbose)
             fprintf(stderr, "page %zu\n", page);
-        b->n = 0;
-        buffer_printf(b, "%s %zu\n", ext_id, page);
-        --b->n;
-        if(write(u->channel_w, b->p, b->n) != (ssize_t)b->n) {
-            LOG_ERRNO("write", 0);
-            goto end;
+        if(!pending) {
+            if(!request_page(u, &tmp, ext_id, page, &t_request))
+                goto end;
         }
-        buffer_reserve(b, 4096);
-        const ssize_t nr = read(u->channel_r, b->p, b->cap);
-        if(nr == -1) {
-            LOG_ERRNO("read", 0);
+        pending = false;
+        const u64 t_read = update_stats_now(u->stats);
+        if(!read_page(&u->youtube, b))
             goto end;
+        const u64 t = update_stats_phase(u->stats, UPDATE_PHASE_FETCH, t_read);
+        update_stats_request(u->stats, UPDATE_CHANNEL_YT_DLP, t - t_request);
+        const bool last = is_last_page(b);
+        /* Every page is needed in a deep update, so the helper process can
+         * list the next one while this one is processed. */
+        if(depth != -1 && !last && page != (size_t)(depth - 1)) {
+            if(!request_page(u, &tmp, ext_id, page + 1, &t_request))
+                goto end;
+            pending = true;
         }
-        b->n = (size_t)nr;
-        int n_updated = 0;
-        switch(process(
-            db, u, b, flags, depth, verbose, &tmp, page, id, &n_updated
-        )) {
-        case DONE: ret = true; goto end;
-        case ERR: goto end;
+        const u64 hash = hash_fnv1a(HASH_FNV1A_INIT, b->p, b->n);
+        bool unchanged = false;
+        if(!last && !update_cache_check(u, flags, id, page, hash, &unchanged))
+            goto end;
+        if(unchanged) {
+            if(depth == -1 || max_depth(verbose, depth, page)) {
+                ret = true;
+                goto end;
+            }
+        } else {
+            int n_updated = 0;
+            bool skipped = false;
+            const enum result r = process(
+                u, b, flags, depth, verbose, &tmp, page, id, &n_updated,
+                &skipped);
+            if(r == ERR)
+                goto end;
+            /* Skipped videos (e.g. premieres) have to be retried even if
+             * the page does not change. */
+            if(!last && !skipped && !update_cache_store(u, id, page, hash))
+                goto end;
+            if(r == DONE) {
+                ret = true;
+                goto end;
+            }
+            if(verbose)
+                fprintf(stderr, "added %d new video(s)\n", n_updated);
         }
-        if(verbose)
-            fprintf(stderr, "added %d new video(s)\n", n_updated);
+        if(depth != -1 && !update_checkpoint(u, id, depth, page + 1, 0))
+            goto end;
     }
 end:
+    /* Keep requests and responses in sync for the next subscription. */
+    if(pending)
+        ret = read_page(&u->youtube, &tmp) && ret;
     free(tmp.p);
     return ret;
 }
 
-static bool process_line(
-    sqlite3 *db, const struct update_youtube *u, struct buffer *b,
-    bool verbose, int sub_id, const char *ext_id, size_t ext_id_len,
-    const char *title, size_t title_len, bool *done, int *n);
+/**
+ * Sends a request for a page to the helper process.
+ * \param t set to the time the request is sent, after waiting for the rate
+ * limiter, from which its latency is measured
+ */
+static bool request_page(
+    struct updater *u, struct buffer *b, const char *ext_id, size_t page,
+    u64 *t)
+{
+    b->n = 0;
+    buffer_printf(b, "%s %zu\n", ext_id, page);
+    --b->n;
+    if(!rate_limiter_wait(&u->rate[SUBS_YOUTUBE]))
+        return false;
+    *t = update_stats_now(u->stats);
+    if(write(u->youtube.channel_w, b->p, b->n) != (ssize_t)b->n)
+        return LOG_ERRNO("write", 0), false;
+    return true;
+}
+
+static bool read_page(const struct update_youtube *u, struct buffer *b) {
+    b->n = 0;
+    buffer_reserve(b, 4096);
+    const ssize_t nr = read(u->channel_r, b->p, b->cap);
+    if(nr == -1)
+        return LOG_ERRNO("read", 0), false;
+    b->n = (size_t)nr;
+    return true;
+}
+
+static bool is_last_page(const struct buffer *b) {
+    return strncmp("\n", b->p, b->n) == 0;
+}
+
+static bool max_depth(bool verbose, int depth, size_t page) {
+    if(page != (size_t)(depth - 1))
+        return false;
+    if(verbose)
+        fputs("maximum depth reached\n", stderr);
+    return true;
+}
+
+struct entry {
+    const char *ext_id, *title;
+    size_t ext_id_len, title_len;
+    bool exists;
+};
+
+static bool parse_page(const struct buffer *input, struct buffer *entries);
+static bool mark_existing(
+    const struct updater *u, int id, struct entry *v, size_t n);
+static bool process_entry(
+    struct updater *u, struct buffer *b, bool verbose, int id,
+    const struct entry *e, int *n, bool *skipped);
 
+/**
+ * \param skipped set if any video was not inserted because its information
+ *                is not yet available
+ */
 static enum result process(
-    sqlite3 *db, const struct update_youtube *u, const struct buffer *input,
-    u32 flags, int depth, bool verbose, struct buffer *b, size_t page, int id,
-    int *n_p)
+    struct updater *u, const struct buffer *input, u32 flags, int depth,
+    bool verbose, struct buffer *b, size_t page, int id, int *n_p,
+    bool *skipped)
 {
     (void)flags;
-    const char *p = input->p;
-    size_t n = input->n;
-    if(strncmp("\n", p, n) == 0)
+    if(is_last_page(input))
         return DONE;
+    enum result ret = ERR;
+    struct buffer entries = {0};
+    u64 t = update_stats_now(u->stats);
+    if(!parse_page(input, &entries))
+        goto end;
+    t = update_stats_phase(u->stats, UPDATE_PHASE_PARSE, t);
+    struct entry *const v = entries.p;
+    size_t n = entries.n / sizeof(*v);
+    /* Everything from the last video of the previous update is known. */
+    bool stop = false;
+    for(size_t i = 0; i != n; ++i)
+        if(update_is_last_video(u, v[i].ext_id, v[i].ext_id_len)) {
+            n = i;
+            stop = true;
+            break;
+        }
+    if(!mark_existing(u, id, v, n))
+        goto end;
+    update_stats_phase(u->stats, UPDATE_PHASE_PROBE, t);
     bool done = true;
+    for(size_t i = 0; i != n; ++i) {
+        if(v[i].exists)
+            continue;
+        done = false;
+        if(!process_entry(u, b, verbose, id, v + i, n_p, skipped))
+            goto end;
+    }
+    if(!page) {
+        bool found = false;
+        for(size_t i = 0; !found && i != n; ++i)
+            if(!update_set_newest(
+                u, id, v[i].ext_id, v[i].ext_id_len, &found
+            ))
+                goto end;
+    }
+    if(stop) {
+        if(verbose)
+            fputs("reached last known video\n", stderr);
+        ret = DONE;
+    } else if(done && depth == -1) {
+        if(verbose)
+            fputs(
+                "page has no new videos"
+                " (use a deep update to unconditionally fetch all pages)\n",
+                stderr);
+        ret = DONE;
+    } else
+        ret = max_depth(verbose, depth, page) ? DONE : 0;
+end:
+    free(entries.p);
+    return ret;
+}
+
+static bool parse_page(const struct buffer *input, struct buffer *entries) {
+    const char *p = input->p;
+    size_t n = input->n;
     while(n && *p != '\n') {
         const char *const ext_id = p;
         const char *const space = memchr(ext_id, ' ', n);
@@ -177,37 +323,74 @@ static enum result process(
         const char *const new_line = memchr(title, '\n', n - ext_id_len - 1);
         if(!new_line)
             goto invalid;
-        const size_t title_len = (size_t)(new_line - title);
-        if(!process_line(
-            db, u, b, verbose,
-            id, ext_id, ext_id_len, title, title_len, &done, n_p
-        ))
-            return ERR;
+        BUFFER_APPEND(entries, (&(struct entry){
+            .ext_id = ext_id,
+            .ext_id_len = ext_id_len,
+            .title = title,
+            .title_len = (size_t)(new_line - title),
+        }));
         n -= (size_t)(new_line - ext_id + 1);
         p = new_line + 1;
     }
-    if(done && depth == -1) {
-        if(verbose)
-            fputs(
-                "page has no new videos"
-                " (use a deep update to unconditionally fetch all pages)\n",
-                stderr);
-        return DONE;
-    }
-    if(page == (size_t)(depth - 1)) {
-        if(verbose)
-            fputs("maximum depth reached\n", stderr);
-        return DONE;
-    }
-    return 0;
+    return true;
 invalid:
     LOG_ERR("invalid output line: '%.*s'\n", (int)n, p);
-    return ERR;
+    return false;
+}
+
+/**
+ * Sets \c exists for entries which are already in the database.
+ * The set of known videos is used if it has been loaded, otherwise a single
+ * query is used for the entire page.
+ */
+static bool mark_existing(
+    const struct updater *u, int id, struct entry *v, size_t n)
+{
+    if(!n)
+        return true;
+    if(u->has_known) {
+        for(size_t i = 0; i != n; ++i)
+            v[i].exists = update_known(u, id, v[i].ext_id, v[i].ext_id_len);
+        return true;
+    }
+    sqlite3 *const db = u->s->db;
+    struct buffer sql = {0};
+    buffer_append_str(
+        &sql, "select ext_id from videos where sub == ? and ext_id in (");
+    query_add_param_list(&sql, n);
+    buffer_str_append_str(&sql, ")");
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v3(db, sql.p, (int)sql.n - 1, 0, &stmt, NULL);
+    free(sql.p);
+    if(!stmt)
+        return false;
+    bool ret = false;
+    if(sqlite3_bind_int(stmt, 1, id) != SQLITE_OK)
+        goto end;
+    for(size_t i = 0; i != n; ++i)
+        if(sqlite3_bind_text(
+            stmt, (int)i + 2, v[i].ext_id, (int)v[i].ext_id_len,
+            SQLITE_STATIC
+        ) != SQLITE_OK)
+            goto end;
+    for(;;) {
+        switch(sqlite3_step(stmt)) {
+        case SQLITE_BUSY: continue;
+        case SQLITE_DONE: ret = true; goto end;
+        case SQLITE_ROW: break;
+        default: goto end;
+        }
+        const char *const ext_id = (const char*)sqlite3_column_text(stmt, 0);
+        const size_t len = (size_t)sqlite3_column_bytes(stmt, 0);
+        for(size_t i = 0; i != n; ++i)
+            if(v[i].ext_id_len == len && memcmp(v[i].ext_id, ext_id, len) == 0)
+                v[i].exists = true;
+    }
+end:
+    ret = sqlite3_finalize(stmt) == SQLITE_OK && ret;
+    return ret;
 }
 
-static bool exists_query(
-    sqlite3 *db, const char *sql, int len, const char *arg, int arg_len,
-    bool *p);
 static bool get_info(
     const struct update_youtube *u,
     const char *id, size_t id_len, struct buffer *b,
@@ -217,51 +400,33 @@ static bool insert(
     const char *title, size_t title_len, i64 timestamp, i64 duration_seconds,
     int *n);
 
-static bool process_line(
-    sqlite3 *db, const struct update_youtube *u, struct buffer *b,
-    bool verbose, int id, const char *ext_id, size_t ext_id_len,
-    const char *title, size_t title_len, bool *done, int *n)
+static bool process_entry(
+    struct updater *u, struct buffer *b, bool verbose, int id,
+    const struct entry *e, int *n, bool *skipped)
 {
-    const char sql[] = "select 1 from videos where ext_id == ?";
-    bool exists;
-    if(!exists_query(
-        db, sql, sizeof(sql) - 1, ext_id, (int)ext_id_len, &exists
-    ))
-        return false;
-    if(exists)
-        return true;
-    *done = false;
     i64 timestamp, duration_seconds;
-    if(!get_info(u, ext_id, ext_id_len, b, &timestamp, &duration_seconds))
+    if(!rate_limiter_wait(&u->rate[SUBS_YOUTUBE]))
         return false;
-    if(!timestamp || !duration_seconds)
+    struct update_stats *const stats = u->stats;
+    u64 t = update_stats_now(stats);
+    if(!get_info(
+        &u->youtube, e->ext_id, e->ext_id_len, b, &timestamp, &duration_seconds
+    ))
+        return false;
+    const u64 t_info = t;
+    t = update_stats_phase(stats, UPDATE_PHASE_FETCH, t);
+    update_stats_request(stats, UPDATE_CHANNEL_YT_DLP, t - t_info);
+    if(!timestamp || !duration_seconds) {
+        *skipped = true;
         return true;
-    return insert(
-        db, verbose, id, ext_id, ext_id_len, title, title_len, timestamp,
-        duration_seconds, n);
-}
-
-static bool exists_query(
-    sqlite3 *db, const char *sql, int len, const char *arg, int arg_len,
-    bool *p)
-{
-    sqlite3_stmt *stmt;
-    sqlite3_prepare_v3(db, sql, (int)len, 0, &stmt, NULL);
-    if(!stmt)
+    }
+    if(!insert(
+        u->s->db, verbose, id, e->ext_id, e->ext_id_len,
+        e->title, e->title_len, timestamp, duration_seconds, n
+    ))
         return false;
-    bool ret = false;
-    if(sqlite3_bind_text(stmt, 1, arg, arg_len, SQLITE_STATIC) != SQLITE_OK)
-        goto end;
-    for(;;)
-        switch(sqlite3_step(stmt)) {
-        case SQLITE_BUSY: continue;
-        case SQLITE_ROW: ret = *p = true; goto end;
-        case SQLITE_DONE: ret = true; *p = false; goto end;
-        default: goto end;
-        }
-end:
-    ret = (sqlite3_finalize(stmt) == SQLITE_OK) && ret;
-    return ret;
+    update_stats_phase(stats, UPDATE_PHASE_INSERT, t);
+    return update_known_add(u, id, e->ext_id, e->ext_id_len);
 }
 
 static bool get_info(
@@ -25,6 +25,9 @@
     for(type *var = array; var != (array) + ARRAY_SIZE(array); ++var)
 #define FOR_EACH(type, var, init) for(type *var = (init); *var; ++var)
 
+/** Initial value for \ref hash_fnv1a. */
+#define HASH_FNV1A_INIT ((u64)0xcbf29ce484222325)
+
 static void *checked_malloc(size_t n);
 static void *checked_calloc(size_t n, size_t s);
 static bool checked_calloc_p(size_t n, size_t s, void **p);
@@ -33,6 +36,7 @@ static bool checked_realloc(size_t s, void **p);
 static size_t strlen_utf8(const char *s);
 static size_t strlcpy(char *restrict dst, const char *restrict src, size_t n);
 static i64 parse_i64(const char *s);
+static u64 hash_fnv1a(u64 h, const void *p, size_t n);
 char *sprintf_alloc(const char *restrict fmt, ...);
 char *vsprintf_alloc(const char *restrict fmt, va_list args);
 char *join_path(char v[static SUBS_MAX_PATH], int n, ...);
@@ -111,4 +115,16 @@ static inline i64 parse_i64(const char *s) {
     return parse_int_common(INT64_MAX, "i64", s);
 }
 
+/**
+ * Hashes \p n bytes from \p p with 64-bit FNV-1a.
+ * \p h is either \ref HASH_FNV1A_INIT or the result of a previous call, which
+ * allows non-contiguous data to be hashed incrementally.
+ */
+static inline u64 hash_fnv1a(u64 h, const void *p, size_t n) {
+    const unsigned char *s = p;
+    for(const unsigned char *const e = s + n; s != e; ++s)
+        h = (h ^ *s) * (u64)0x100000001b3;
+    return h;
+}
+
 #endif
@@ -0,0 +1,196 @@
+#include "youtube_fake.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "log.h"
+#include "util.h"
+
+/** One of the helpers, served by its own thread. */
+struct helper {
+    const struct youtube_fake_server *s;
+    /** End of the socket pair not used by the updater. */
+    int fd;
+    /** Writes the response for one request line into the buffer. */
+    void (*handle)(const struct youtube_fake_server*, char*, struct buffer*);
+    unsigned latency;
+    thrd_t t;
+    bool running;
+};
+
+struct fake {
+    struct helper channel, info;
+};
+
+static void handle_channel(
+    const struct youtube_fake_server *s, char *line, struct buffer *b)
+{
+    char *const space = strchr(line, ' ');
+    const i64 page = space ? parse_i64(space + 1) : -1;
+    if(space)
+        *space = 0;
+    for(size_t i = 0; page != -1 && i != s->n_channels; ++i) {
+        const struct youtube_fake_channel *const c = s->channels + i;
+        if(strcmp(c->id, line) != 0 || c->n_pages <= (size_t)page)
+            continue;
+        buffer_append_str(b, c->pages[page]);
+        return;
+    }
+    buffer_append_str(b, "\n");
+}
+
+static void handle_info(
+    const struct youtube_fake_server *s, char *line, struct buffer *b)
+{
+    i64 timestamp = 0, duration_seconds = 0;
+    for(size_t i = 0; i != s->n_videos; ++i)
+        if(strcmp(s->videos[i].id, line) == 0) {
+            timestamp = s->videos[i].timestamp;
+            duration_seconds = s->videos[i].duration_seconds;
+            break;
+        }
+    buffer_printf(b, "%" PRId64 " %" PRId64, timestamp, duration_seconds);
+}
+
+static bool respond(struct helper *h, char *line, struct buffer *b) {
+    if(h->latency)
+        nanosleep(&(struct timespec){
+            .tv_sec = h->latency / 1000,
+            .tv_nsec = (long)(h->latency % 1000) * 1000000,
+        }, NULL);
+    b->n = 0;
+    h->handle(h->s, line, b);
+    /* The updater reads each response with a single call. */
+    const size_t n = b->n - 1;
+    const ssize_t nw = send(h->fd, b->p, n, MSG_NOSIGNAL);
+    if(nw == -1)
+        return LOG_ERRNO("send", 0), false;
+    if((size_t)nw != n)
+        return LOG_ERR("short write: %zd != %zu\n", nw, n), false;
+    return true;
+}
+
+/** Serves requests, one per line, until the updater closes its end. */
+static int serve(void *p) {
+    struct helper *const h = p;
+    struct buffer input = {0}, output = {0};
+    char v[256];
+    for(;;) {
+        const ssize_t nr = recv(h->fd, v, sizeof(v), 0);
+        if(nr == -1) {
+            LOG_ERRNO("recv", 0);
+            break;
+        }
+        if(!nr)
+            break;
+        buffer_append(&input, v, (size_t)nr);
+        char *nl;
+        while((nl = memchr(input.p, '\n', input.n))) {
+            *nl = 0;
+            if(!respond(h, input.p, &output))
+                goto end;
+            const size_t n = (size_t)(nl + 1 - (char*)input.p);
+            memmove(input.p, nl + 1, input.n - n);
+            input.n -= n;
+        }
+    }
+end:
+    free(input.p);
+    free(output.p);
+    return 0;
+}
+
+static bool start(struct helper *h, int *r, int *w) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return LOG_ERRNO("socketpair", 0), false;
+    h->fd = fds[1];
+    *r = fds[0];
+    if((*w = dup(fds[0])) == -1) {
+        LOG_ERRNO("dup", 0);
+        goto err;
+    }
+    if(thrd_create(&h->t, serve, h) != thrd_success) {
+        LOG_ERR("failed to create thread\n", 0);
+        close(*w);
+        goto err;
+    }
+    return h->running = true;
+err:
+    close(fds[0]);
+    close(fds[1]);
+    *r = *w = -1;
+    return false;
+}
+
+static bool stop(struct helper *h, int *r, int *w) {
+    bool ret = true;
+    if(*r != -1 && close(*r) == -1)
+        LOG_ERRNO("close", 0), ret = false;
+    if(*w != -1 && close(*w) == -1)
+        LOG_ERRNO("close", 0), ret = false;
+    *r = *w = -1;
+    if(!h->running)
+        return ret;
+    thrd_join(h->t, NULL);
+    if(close(h->fd) == -1)
+        LOG_ERRNO("close", 0), ret = false;
+    return ret;
+}
+
+static bool fake_destroy(void *p, struct update_youtube *u) {
+    (void)p;
+    struct fake *const f = u->priv;
+    bool ret = stop(&f->channel, &u->channel_r, &u->channel_w);
+    ret = stop(&f->info, &u->info_r, &u->info_w) && ret;
+    free(f);
+    return ret;
+}
+
+static bool fake_init(void *p, struct update_youtube *u) {
+    const struct youtube_fake_server *const s = p;
+    struct fake *const f = checked_malloc(sizeof(*f));
+    if(!f)
+        return false;
+    *f = (struct fake){
+        .channel = {
+            .s = s,
+            .handle = handle_channel,
+            .latency = s->channel_latency,
+        },
+        .info = {.s = s, .handle = handle_info, .latency = s->info_latency},
+    };
+    *u = (struct update_youtube){
+        .channel_pid = -1,
+        .channel_r   = -1,
+        .channel_w   = -1,
+        .info_pid    = -1,
+        .info_r      = -1,
+        .info_w      = -1,
+        .priv = f,
+    };
+    if(
+        start(&f->channel, &u->channel_r, &u->channel_w)
+        && start(&f->info, &u->info_r, &u->info_w)
+    )
+        return true;
+    fake_destroy(p, u);
+    return false;
+}
+
+struct update_youtube_backend update_youtube_fake_init(
+    const struct youtube_fake_server *s)
+{
+    return (struct update_youtube_backend){
+        .data = (struct youtube_fake_server*)s,
+        .init = fake_init,
+        .destroy = fake_destroy,
+    };
+}
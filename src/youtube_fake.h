@@ -0,0 +1,41 @@
+#ifndef SUBS_YOUTUBE_FAKE_H
+#define SUBS_YOUTUBE_FAKE_H
+
+#include <stddef.h>
+
+#include "def.h"
+#include "update.h"
+
+struct youtube_fake_channel {
+    const char *id;
+    /**
+     * Output of the channel helper for each page: one `ID TITLE` line for
+     * each video.  Requests for later pages get an empty page.
+     */
+    const char *const *pages;
+    size_t n_pages;
+};
+
+struct youtube_fake_video {
+    const char *id;
+    i64 timestamp, duration_seconds;
+};
+
+/**
+ * Canned responses for the YouTube helpers.
+ * Requests are served in-process by a thread for each helper.  Unknown videos
+ * are reported as unavailable, unknown channels have no videos.
+ */
+struct youtube_fake_server {
+    const struct youtube_fake_channel *channels;
+    size_t n_channels;
+    const struct youtube_fake_video *videos;
+    size_t n_videos;
+    /** Artificial delay before each response, in milliseconds. */
+    unsigned channel_latency, info_latency;
+};
+
+struct update_youtube_backend update_youtube_fake_init(
+    const struct youtube_fake_server *s);
+
+#endif
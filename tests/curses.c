@@ -1,15 +1,35 @@
 #include "common.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <lauxlib.h>
+#include <lualib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "unix.h"
+#include "curses/children.h"
+#include "curses/input.h"
 #include "curses/window/list.h"
 #include "curses/window/window.h"
 
 const char *PROG_NAME = NULL;
 const char *CMD_NAME = NULL;
 
+enum { TEST_WINDOW_MAX = 16 };
+
 struct test_window {
     struct window base;
     struct window *parent;
     int h, w, y, x;
+    /** Cursor position. */
+    int cy, cx;
+    /** Number of lines written and scrolled. */
+    int n_print, n_scroll;
+    char text[TEST_WINDOW_MAX][TEST_WINDOW_MAX + 1];
+    unsigned attr[TEST_WINDOW_MAX];
 };
 
 struct window *test_window_new(int y, int x, int h, int w);
@@ -26,10 +46,64 @@ int test_window_height(const struct window *w) {
     return ((const struct test_window*)w)->h;
 }
 
+int test_window_width(const struct window *w) {
+    return ((const struct test_window*)w)->w;
+}
+
 void test_window_box(struct window *w, unsigned v_ch, unsigned h_ch) {
     (void)w, (void)v_ch, (void)h_ch;
 }
 
+void test_window_move(struct window *w, int y, int x) {
+    struct test_window *const t = (struct test_window*)w;
+    t->cy = y;
+    t->cx = x;
+}
+
+void test_window_change_attr(struct window *w, unsigned a) {
+    struct test_window *const t = (struct test_window*)w;
+    t->attr[t->cy] = a;
+}
+
+void test_window_refresh(struct window *w) {
+    (void)w;
+}
+
+/** Writes a single line, text which does not fit is discarded. */
+void test_window_vprint(
+    struct window *w, int y, int x, const char *restrict fmt, va_list args)
+{
+    struct test_window *const t = (struct test_window*)w;
+    char *const line = t->text[y];
+    vsnprintf(line + x, (size_t)(t->w - x + 1), fmt, args);
+    t->cy = y;
+    t->cx = (int)strlen(line);
+    t->attr[y] = 0;
+    ++t->n_print;
+}
+
+void test_window_clear_line(struct window *w) {
+    struct test_window *const t = (struct test_window*)w;
+    t->text[t->cy][t->cx] = 0;
+}
+
+void test_window_scroll(struct window *w, int n) {
+    struct test_window *const t = (struct test_window*)w;
+    const int h = t->h;
+    for(int i = 0; i != h; ++i) {
+        const int src = n < 0 ? h - 1 - i - (-n) : i + n;
+        const int dst = n < 0 ? h - 1 - i : i;
+        if(0 <= src && src < h) {
+            memcpy(t->text[dst], t->text[src], sizeof(t->text[dst]));
+            t->attr[dst] = t->attr[src];
+        } else {
+            t->text[dst][0] = 0;
+            t->attr[dst] = 0;
+        }
+    }
+    ++t->n_scroll;
+}
+
 void test_window_destroy(struct window *w) {
     free(w);
 }
@@ -43,7 +117,14 @@ struct window *test_window_new(int h, int w, int y, int x) {
             .derive = test_window_derive,
             .destroy = test_window_destroy,
             .height = test_window_height,
+            .width = test_window_width,
             .box = test_window_box,
+            .move = test_window_move,
+            .change_attr = test_window_change_attr,
+            .refresh = test_window_refresh,
+            .vprint = test_window_vprint,
+            .clear_line = test_window_clear_line,
+            .scroll = test_window_scroll,
         },
         .h = h,
         .w = w,
@@ -70,9 +151,167 @@ end:
     return ret;
 }
 
+static char **make_lines(int n, const char *changed) {
+    char **const ret = checked_calloc((size_t)n, sizeof(*ret));
+    for(int i = 0; i != n; ++i)
+        ret[i] = sprintf_alloc("line %d", i);
+    if(changed) {
+        free(ret[1]);
+        ret[1] = strdup(changed);
+    }
+    return ret;
+}
+
+static i64 *make_ids(int n) {
+    i64 *const ret = checked_calloc((size_t)n, sizeof(*ret));
+    for(int i = 0; i != n; ++i)
+        ret[i] = i;
+    return ret;
+}
+
+static void free_lines(struct list *l) {
+    for(int i = 0; i != l->n; ++i)
+        free(l->lines[i]);
+}
+
+static bool check_rows(const struct list *l) {
+    const struct test_window *const w = (const struct test_window*)l->sub;
+    char v[TEST_WINDOW_MAX + 1];
+    for(int y = 0; y != w->h; ++y) {
+        snprintf(v, (size_t)w->w + 1, "%s", l->lines[l->offset + y]);
+        if(!ASSERT_STR_EQ(w->text[y], v))
+            return false;
+    }
+    return true;
+}
+
+static bool list_damage(void) {
+    enum { N = 10, CTRL = 0x1f };
+    struct list l = {0};
+    /* 4 lines of 8 columns inside the borders. */
+    list_init(&l, test_window_new, N, make_ids(N), make_lines(N, NULL),
+        0, 0, 12, 6);
+    const struct test_window *const w = (const struct test_window*)l.sub;
+    bool ret = ASSERT_EQ(w->n_print, 4) && check_rows(&l);
+    if(!ret)
+        goto end;
+    /* Moving the selection only changes attributes. */
+    list_move(&l, 1);
+    ret = ASSERT_EQ(w->n_print, 4) && ASSERT_EQ(w->attr[1], l.selected_attr)
+        && ASSERT_EQ(w->attr[0], 0);
+    /* Scrolling writes only the new line. */
+    list_input(&l, CTRL & 'e', 1);
+    ret = ret
+        && ASSERT_EQ(l.offset, 1) && ASSERT_EQ(w->n_scroll, 1)
+        && ASSERT_EQ(w->n_print, 5) && check_rows(&l);
+    list_input(&l, CTRL & 'y', 1);
+    ret = ret
+        && ASSERT_EQ(l.offset, 0) && ASSERT_EQ(w->n_scroll, 2)
+        && ASSERT_EQ(w->n_print, 6) && check_rows(&l);
+    if(!ret)
+        goto end;
+    /* Reloading identical items writes nothing, a changed item only its
+     * line. */
+    free_lines(&l);
+    list_init(&l, NULL, N, make_ids(N), make_lines(N, NULL), 0, 0, 12, 6);
+    ret = ASSERT_EQ(w->n_print, 6);
+    free_lines(&l);
+    list_init(&l, NULL, N, make_ids(N), make_lines(N, "changed"), 0, 0, 12, 6);
+    ret = ret && ASSERT_EQ(w->n_print, 7) && check_rows(&l);
+    /* Text wrapping into the next line causes it to be written again. */
+    free_lines(&l);
+    list_init(&l, NULL, N, make_ids(N), make_lines(N, "0123456789"),
+        0, 0, 12, 6);
+    ret = ret && ASSERT_EQ(w->n_print, 9) && check_rows(&l);
+end:
+    free_lines(&l);
+    list_destroy(&l);
+    return ret;
+}
+
+static int spawn_lua(lua_State *L) {
+    return children_spawn_lua(L, lua_touserdata(L, lua_upvalueindex(1)), 1);
+}
+
+static bool run_lua(lua_State *L, const char *src) {
+    if(luaL_dostring(L, src) == LUA_OK)
+        return true;
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return false;
+}
+
+static bool spawn_reap(void) {
+    const char src[] =
+        "for _, cmd in ipairs({\n"
+        "    42, {}, {'true', 1},\n"
+        "    setmetatable({}, {\n"
+        "        __index = function() return 'true' end,\n"
+        "        __len = function() return 1 end,\n"
+        "    }),\n"
+        "}) do\n"
+        "    assert(not pcall(spawn, cmd), 'invalid command accepted')\n"
+        "end\n"
+        "assert(not pcall(spawn, {'true'}, 42), 'invalid callback accepted')\n"
+        "pid = spawn({'true'}, function(...) result = table.pack(...) end)\n";
+    const char check[] =
+        "assert(result, 'callback not called')\n"
+        "assert(result.n == 3 and result[1] == true)\n"
+        "assert(result[2] == 'exit' and result[3] == 0)\n";
+    lua_State *const L = luaL_newstate();
+    if(!L)
+        return false;
+    luaL_openlibs(L);
+    struct children c = {.L = L};
+    lua_pushlightuserdata(L, &c);
+    lua_pushcclosure(L, spawn_lua, 1);
+    lua_setglobal(L, "spawn");
+    /* Nothing is ever written to the standard input, so that only the
+     * signal is received. */
+    const int stdin_fd = dup(STDIN_FILENO);
+    int r = -1, w = -1;
+    struct input input = {0};
+    bool ret = ASSERT(stdin_fd != -1)
+        && ASSERT(setup_pipe(&r, &w))
+        && ASSERT(dup2(r, STDIN_FILENO) != -1)
+        && ASSERT(input_init(&input));
+    if(!ret)
+        goto end;
+    ret = run_lua(L, src) && ASSERT(c.v.n);
+    if(!ret)
+        goto destroy;
+    lua_getglobal(L, "pid");
+    const pid_t pid = (pid_t)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    ret = ASSERT_EQ(input_process(&input).type, INPUT_TYPE_CHILD);
+    children_reap(&c);
+    /* The process must have been waited for, not left as a zombie. */
+    ret = ret
+        && ASSERT_EQ(c.v.n, 0)
+        && run_lua(L, check)
+        && ASSERT_EQ(waitpid(pid, NULL, WNOHANG), -1)
+        && ASSERT_EQ(errno, ECHILD);
+destroy:
+    ret = input_destroy(&input) && ret;
+end:
+    if(stdin_fd != -1) {
+        dup2(stdin_fd, STDIN_FILENO);
+        close(stdin_fd);
+    }
+    if(r != -1) {
+        close(r);
+        close(w);
+    }
+    children_destroy(&c);
+    lua_close(L);
+    return ret;
+}
+
 int main(void) {
     log_set(stderr);
     bool ret = true;
     ret = RUN(list_window_new) && ret;
+    ret = RUN(list_damage) && ret;
+    ret = RUN(spawn_reap) && ret;
     return !ret;
 }
@@ -0,0 +1,52 @@
+#include "common.h"
+
+#include "hash_set.h"
+
+const char *PROG_NAME = NULL;
+const char *CMD_NAME = NULL;
+
+static bool empty(void) {
+    struct hash_set s = {0};
+    return ASSERT(!hash_set_contains(&s, 0))
+        && ASSERT(!hash_set_contains(&s, 42));
+}
+
+static bool insert(void) {
+    struct hash_set s = {0};
+    bool ret = ASSERT(hash_set_insert(&s, 42))
+        && ASSERT(hash_set_insert(&s, 42))
+        && ASSERT(hash_set_insert(&s, 0))
+        && ASSERT_EQ(s.n, 2)
+        && ASSERT(hash_set_contains(&s, 42))
+        && ASSERT(hash_set_contains(&s, 0))
+        && ASSERT(!hash_set_contains(&s, 43));
+    hash_set_clear(&s);
+    ret = ret
+        && ASSERT_EQ(s.n, 0)
+        && ASSERT(!hash_set_contains(&s, 42));
+    hash_set_destroy(&s);
+    return ret;
+}
+
+static bool grow(void) {
+    struct hash_set s = {0};
+    bool ret = true;
+    /* Multiples of the capacity all collide in the first slot. */
+    for(u64 i = 1; ret && i <= 1024; ++i)
+        ret = ASSERT(hash_set_insert(&s, i * 64));
+    for(u64 i = 1; ret && i <= 1024; ++i)
+        ret = ASSERT(hash_set_contains(&s, i * 64))
+            && ASSERT(!hash_set_contains(&s, i * 64 + 1));
+    ret = ret && ASSERT_EQ(s.n, 1024);
+    hash_set_destroy(&s);
+    return ret;
+}
+
+int main(void) {
+    log_set(stderr);
+    bool ret = true;
+    ret = RUN(empty) && ret;
+    ret = RUN(insert) && ret;
+    ret = RUN(grow) && ret;
+    return !ret;
+}
@@ -0,0 +1,87 @@
+#include "common.h"
+
+#include "queue.h"
+
+const char *PROG_NAME = NULL;
+const char *CMD_NAME = NULL;
+
+enum { N = 1024 };
+
+static bool fifo(void) {
+    struct queue q;
+    if(!queue_init(&q, 4))
+        return false;
+    static int v[3];
+    void *p = NULL;
+    bool ret = ASSERT(queue_push(&q, v))
+        && ASSERT(queue_push(&q, v + 1))
+        && ASSERT(queue_pop(&q, &p)) && ASSERT_EQ(p, (void*)v)
+        && ASSERT(queue_push(&q, v + 2))
+        && ASSERT(queue_pop(&q, &p)) && ASSERT_EQ(p, (void*)(v + 1))
+        && ASSERT(queue_pop(&q, &p)) && ASSERT_EQ(p, (void*)(v + 2));
+    queue_close(&q);
+    ret = ret
+        && ASSERT(!queue_push(&q, v))
+        && ASSERT(!queue_pop(&q, &p));
+    queue_destroy(&q);
+    return ret;
+}
+
+static bool try_pop(void) {
+    struct queue q;
+    if(!queue_init(&q, 2))
+        return false;
+    static int v;
+    void *p = NULL;
+    bool ret = ASSERT(!queue_try_pop(&q, &p))
+        && ASSERT(queue_push(&q, &v))
+        && ASSERT(queue_try_pop(&q, &p)) && ASSERT_EQ(p, (void*)&v)
+        && ASSERT(!queue_try_pop(&q, &p));
+    queue_destroy(&q);
+    return ret;
+}
+
+static int produce(void *p) {
+    static int v[N];
+    struct queue *const q = p;
+    for(int i = 0; i != N; ++i) {
+        v[i] = i;
+        if(!queue_push(q, v + i))
+            return 1;
+    }
+    queue_close(q);
+    return 0;
+}
+
+static bool threads(void) {
+    struct queue q;
+    if(!queue_init(&q, 4))
+        return false;
+    thrd_t t;
+    if(thrd_create(&t, produce, &q) != thrd_success) {
+        queue_destroy(&q);
+        return false;
+    }
+    bool ret = true;
+    int n = 0;
+    /* Elements are received in order even though the queue is much smaller
+     * than the number of elements. */
+    for(void *p = NULL; ret && queue_pop(&q, &p); ++n)
+        ret = ASSERT_EQ(*(int*)p, n);
+    if(!ret)
+        queue_close(&q);
+    int status = -1;
+    ret = ASSERT_EQ(thrd_join(t, &status), thrd_success) && ret;
+    ret = ret && ASSERT_EQ(status, 0) && ASSERT_EQ(n, N);
+    queue_destroy(&q);
+    return ret;
+}
+
+int main(void) {
+    log_set(stderr);
+    bool ret = true;
+    ret = RUN(fifo) && ret;
+    ret = RUN(try_pop) && ret;
+    ret = RUN(threads) && ret;
+    return !ret;
+}
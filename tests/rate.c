@@ -0,0 +1,47 @@
+#include "common.h"
+
+#include "rate.h"
+
+const char *PROG_NAME = NULL;
+const char *CMD_NAME = NULL;
+
+static bool unlimited(void) {
+    struct rate_limiter r;
+    rate_limiter_init(&r, 0, 0);
+    for(int i = 0; i != 16; ++i)
+        if(!ASSERT_EQ(rate_limiter_reserve(&r, 0), 0))
+            return false;
+    return true;
+}
+
+static bool burst(void) {
+    struct rate_limiter r;
+    rate_limiter_init(&r, 2, 3);
+    return ASSERT_EQ(rate_limiter_reserve(&r, 10), 0)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 10), 0)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 10), 0)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 10), 0.5)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 10), 1);
+}
+
+static bool refill(void) {
+    struct rate_limiter r;
+    rate_limiter_init(&r, 2, 2);
+    return ASSERT_EQ(rate_limiter_reserve(&r, 0), 0)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 0), 0)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 0), 0.5)
+        /* Pays the deficit, then accumulates at most `burst` tokens. */
+        && ASSERT_EQ(rate_limiter_reserve(&r, 0.5), 0.5)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 100), 0)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 100), 0)
+        && ASSERT_EQ(rate_limiter_reserve(&r, 100), 0.5);
+}
+
+int main(void) {
+    log_set(stderr);
+    bool ret = true;
+    ret = RUN(unlimited) && ret;
+    ret = RUN(burst) && ret;
+    ret = RUN(refill) && ret;
+    return !ret;
+}
@@ -1,9 +1,11 @@
 #include <stdbool.h>
 
 #include "db.h"
+#include "export.h"
 #include "http_fake.h"
 #include "log.h"
 #include "os.h"
+#include "query.h"
 #include "subs.h"
 #include "util.h"
 
@@ -294,6 +296,305 @@ end:
     return ret;
 }
 
+static bool query_text(
+    const struct subs *s, struct video_filter filter, const char *expected)
+{
+    FILE *const tmp = tmpfile();
+    if(!tmp)
+        return LOG_ERRNO("tmpfile", 0), false;
+    const bool ret = subs_query_videos(s, &filter, tmp)
+        && CHECK_FILE(tmp, expected);
+    fclose(tmp);
+    return ret;
+}
+
+static bool query_videos(void) {
+    const char v0[] = "1 0 lbry 100 30 c0 id0 first video\n";
+    const char v1[] = "2 w lbry 200 10 c1 id0 second\n";
+    const char v2[] = "3 0 youtube 300 20 y0 id1 third video\n";
+    char v[3 * sizeof(v2)] = {0};
+    struct subs s = {.db_path = ":memory:"};
+    const bool ret = subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add(&s, SUBS_YOUTUBE, "name1", "id1")
+        && subs_add_video(&s, 1, 100, 30, "c0", "first video")
+        && subs_add_video(&s, 1, 200, 10, "c1", "second")
+        && subs_add_video(&s, 2, 300, 20, "y0", "third video")
+        && subs_set_watched(&s, 2, true)
+        && subs_add_tag(&s, "tag0")
+        && subs_tag_sub(&s, 1, 2)
+        && query_text(&s, (struct video_filter){.tag = 1}, v2)
+        && query_text(&s,
+            (struct video_filter){.flags = VIDEO_FILTER_UNTAGGED},
+            strcat(strcpy(v, v0), v1))
+        && query_text(&s, (struct video_filter){.sub = 1},
+            strcat(strcpy(v, v0), v1))
+        && query_text(&s, (struct video_filter){.type = SUBS_YOUTUBE}, v2)
+        && query_text(&s,
+            (struct video_filter){.flags = VIDEO_FILTER_NOT_WATCHED},
+            strcat(strcpy(v, v0), v2))
+        && query_text(&s, (struct video_filter){.since = 150, .until = 300}, v1)
+        && query_text(&s, (struct video_filter){.title = "video"},
+            strcat(strcpy(v, v0), v2))
+        && query_text(&s,
+            (struct video_filter){.order = VIDEO_ORDER_DURATION},
+            strcat(strcat(strcpy(v, v1), v2), v0))
+        && query_text(&s,
+            (struct video_filter){
+                .flags = VIDEO_FILTER_DESC, .limit = 1, .offset = 1},
+            v1)
+        && query_text(&s, (struct video_filter){.offset = 2}, v2);
+    return subs_destroy(&s) && ret;
+}
+
+static bool query_order_ties(void) {
+    const char v0[] = "1 0 lbry 100 10 c0 id0 b\n";
+    const char v1[] = "2 0 lbry 100 10 c1 id0 a\n";
+    const char v2[] = "3 0 lbry 100 10 c2 id0 a\n";
+    char v[3 * sizeof(v2)] = {0};
+    struct subs s = {.db_path = ":memory:"};
+    /* Equal keys are ordered by ID, in the same direction. */
+    const bool ret = subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add_video(&s, 1, 100, 10, "c0", "b")
+        && subs_add_video(&s, 1, 100, 10, "c1", "a")
+        && subs_add_video(&s, 1, 100, 10, "c2", "a")
+        && query_text(&s, (struct video_filter){.order = VIDEO_ORDER_TITLE},
+            strcat(strcat(strcpy(v, v1), v2), v0))
+        && query_text(&s,
+            (struct video_filter){
+                .order = VIDEO_ORDER_TITLE, .limit = 1, .offset = 1},
+            v2)
+        && query_text(&s,
+            (struct video_filter){
+                .order = VIDEO_ORDER_SUB, .flags = VIDEO_FILTER_DESC},
+            strcat(strcat(strcpy(v, v2), v1), v0));
+    return subs_destroy(&s) && ret;
+}
+
+static bool lua_worker(void) {
+    const char src[] =
+        "local echo <close> = S.worker([[\n"
+        "    while true do\n"
+        "        local t = table.pack(S.recv())\n"
+        "        if t.n == 0 then break end\n"
+        "        S.send(table.unpack(t, 1, t.n))\n"
+        "    end\n"
+        "]])\n"
+        "assert(echo:send({\n"
+        "    a = {1, 'two', {true, false}}, [10] = 'x', n = -3, f = 1.5,\n"
+        "}, 'b', nil, 42, true, false))\n"
+        "local r = table.pack(echo:recv())\n"
+        "assert(r.n == 6, 'unexpected number of values')\n"
+        "local t, b, x, i, y, z = table.unpack(r, 1, r.n)\n"
+        "assert(t.a[1] == 1 and math.type(t.a[1]) == 'integer')\n"
+        "assert(t.a[2] == 'two' and t.a[3][1] == true and t.a[3][2] == false)\n"
+        "assert(t[10] == 'x' and t.n == -3 and t.f == 1.5)\n"
+        "assert(b == 'b' and x == nil and math.type(i) == 'integer')\n"
+        "assert(i == 42 and y == true and z == false)\n"
+        /* Functions, userdata, threads, and deep nesting cannot be sent. */
+        "local deep = {}\n"
+        "for _ = 1, 40 do deep = {deep} end\n"
+        "for _, v in ipairs({\n"
+        "    print, {f = print}, echo, coroutine.create(print), deep,\n"
+        "}) do\n"
+        "    assert(not pcall(echo.send, echo, v), 'value sent')\n"
+        "end\n"
+        "assert(echo:send('still usable'))\n"
+        "assert(echo:recv() == 'still usable')\n"
+        /* A worker which never waits is interrupted by the count hook. */
+        "local busy = S.worker('S.send(true) while true do end')\n"
+        "assert(busy:recv() == true)\n"
+        "assert(busy:close())\n"
+        "assert(not pcall(busy.send, busy, 1), 'closed worker used')\n"
+        "assert(echo:close())\n";
+    struct subs s = {.db_path = ":memory:"};
+    const bool ret = subs_init(&s) && ASSERT(subs_lua(&s, src));
+    return subs_destroy(&s) && ret;
+}
+
+static bool lua_query(void) {
+    const char src[] =
+        "local n = 0\n"
+        "for i, a, b, c in S.query(\n"
+        "    'select * from (values (null, 1, null), (2, null, ?))', 'x'\n"
+        ") do\n"
+        "    n = i\n"
+        "    if i == 1 then assert(a == nil and b == 1 and c == nil) end\n"
+        "    if i == 2 then assert(a == 2 and b == nil and c == 'x') end\n"
+        "end\n"
+        "assert(n == 2, 'rows skipped')\n"
+        "local t = S.fetch_all('select ?, null, ?', 1, 'a')\n"
+        "assert(#t == 1 and t[1][1] == 1 and t[1][2] == nil)\n"
+        "assert(t[1][3] == 'a')\n"
+        /* The statement is the closing value of the loop. */
+        "for _ in S.query('select * from (values (1), (2))') do break end\n"
+        "assert(not pcall(function()\n"
+        "    for _ in S.query('select 1') do error('in loop') end\n"
+        "end))\n"
+        "assert(not pcall(S.query, 'select from'))\n";
+    struct subs s = {.db_path = ":memory:"};
+    const bool ret = subs_init(&s)
+        && ASSERT(subs_lua(&s, src))
+        && ASSERT(!sqlite3_next_stmt(s.db, NULL));
+    return subs_destroy(&s) && ret;
+}
+
+static bool lua_prepare(void) {
+    const char src[] =
+        "collectgarbage('stop')\n"
+        "local st <close> = S.prepare('select :a, $b, @c')\n"
+        "local r = st:bind({a = 1, ['$b'] = 'two', c = true}):step()\n"
+        "assert(r[1] == 1 and r[2] == 'two' and r[3] == 1)\n"
+        "assert(st:step() == nil)\n"
+        /* Resetting keeps the parameters, binding replaces all of them. */
+        "r = st:reset():step()\n"
+        "assert(r[1] == 1 and r[2] == 'two' and r[3] == 1)\n"
+        "r = st:bind(4, nil, 6):step()\n"
+        "assert(r[1] == 4 and r[2] == nil and r[3] == 6)\n"
+        "r = st:bind(7):step()\n"
+        "assert(r[1] == 7 and r[2] == nil and r[3] == nil)\n"
+        "assert(not pcall(st.bind, st, {d = 1}))\n"
+        "local rows = S.prepare('select * from (values (1), (2), (3))')\n"
+        "assert(#rows:fetch_many(2) == 2 and #rows:fetch_all() == 1)\n"
+        "local n = 0\n"
+        "for row in rows:rows() do n = n + row[1] end\n"
+        "assert(n == 6)\n"
+        "rows:close()\n"
+        "assert(not pcall(rows.step, rows), 'closed statement used')\n"
+        "local closed\n"
+        "do local c <close> = S.prepare('select 1') closed = c end\n"
+        "assert(not pcall(closed.step, closed), 'statement not closed')\n"
+        "S.prepare('select 2')\n";
+    struct subs s = {.db_path = ":memory:"};
+    /* The last statement is only finalized when it is collected. */
+    const bool ret = subs_init(&s)
+        && ASSERT(subs_lua(&s, src))
+        && ASSERT(sqlite3_next_stmt(s.db, NULL))
+        && ASSERT(subs_lua(&s, "collectgarbage('restart') collectgarbage()"))
+        && ASSERT(!sqlite3_next_stmt(s.db, NULL));
+    return subs_destroy(&s) && ret;
+}
+
+static bool bulk(void) {
+    const char v0[] = "1 w lbry 100 30 c0 id0 v0\n";
+    const char v1[] = "2 0 lbry 200 10 c1 id0 v1\n";
+    const char v2[] = "3 w youtube 300 20 y0 id1 v2\n";
+    char v[3 * sizeof(v2)] = {0};
+    struct subs s = {.db_path = ":memory:"};
+    const bool ret = subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add(&s, SUBS_YOUTUBE, "name1", "id1")
+        && subs_add_video(&s, 1, 100, 30, "c0", "v0")
+        && subs_add_video(&s, 1, 200, 10, "c1", "v1")
+        && subs_add_video(&s, 2, 300, 20, "y0", "v2")
+        && subs_add_tag(&s, "tag0")
+        && subs_set_watched_videos(&s,
+            &(struct video_filter){.ids = (i64[]){1, 3, 4}, .n_ids = 3}, true)
+        && query_text(&s, (struct video_filter){0},
+            strcat(strcat(strcpy(v, v0), v1), v2))
+        && subs_set_watched_videos(&s,
+            &(struct video_filter){.sub = 2, .until = 300}, false)
+        && query_text(&s, (struct video_filter){.sub = 2}, v2)
+        && subs_tag_videos(&s, 1, &(struct video_filter){.sub = 1})
+        && subs_tag_videos(&s, 1, &(struct video_filter){
+            .order = VIDEO_ORDER_DURATION, .limit = 1})
+        && query_text(&s, (struct video_filter){.tag = 1},
+            strcat(strcpy(v, v0), v1))
+        && subs_set_watched_videos(&s, &(struct video_filter){.tag = 1}, false)
+        && query_text(&s, (struct video_filter){.flags = VIDEO_FILTER_WATCHED},
+            v2);
+    return subs_destroy(&s) && ret;
+}
+
+static bool export_text(struct subs *s, enum subs_export_format format) {
+    FILE *const tmp = tmpfile();
+    if(!tmp)
+        return LOG_ERRNO("tmpfile", 0), false;
+    if(!subs_export(s, format, tmp))
+        return false;
+    switch(format) {
+    case SUBS_EXPORT_NDJSON:
+        return CHECK_FILE(tmp,
+            "{\"id\":1,\"sub\":1,\"type\":\"lbry\",\"watched\":false,"
+                "\"timestamp\":1630796966,\"duration_seconds\":26233,"
+                "\"ext_id\":\"claim_id0\",\"title\":\"v0\"}\n"
+            "{\"id\":2,\"sub\":2,\"type\":\"youtube\",\"watched\":true,"
+                "\"timestamp\":-1,\"duration_seconds\":0,"
+                "\"ext_id\":\"yt0\",\"title\":\"\\\"a\\\", b\\n\\u0001\"}\n");
+    case SUBS_EXPORT_CSV:
+        return CHECK_FILE(tmp,
+            "id,sub,type,watched,timestamp,duration_seconds,ext_id,title\n"
+            "1,1,lbry,0,1630796966,26233,claim_id0,v0\n"
+            "2,2,youtube,1,-1,0,yt0,\"\"\"a\"\", b\n\x01\"\n");
+    default:
+        return false;
+    }
+}
+
+static bool export(void) {
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add(&s, SUBS_YOUTUBE, "name1", "id1")
+        && subs_add_video(&s, 1, 1630796966, 26233, "claim_id0", "v0")
+        && subs_add_video(&s, 2, -1, 0, "yt0", "\"a\", b\n\x01")
+        && subs_set_watched(&s, 2, true)
+        && export_text(&s, SUBS_EXPORT_NDJSON)
+        && export_text(&s, SUBS_EXPORT_CSV)
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_export(&s, SUBS_EXPORT_BINARY, tmp))
+        goto end;
+    const long len = ftell(tmp);
+    char *const p = len > 0 ? checked_malloc((size_t)len) : NULL;
+    if(!(
+        p
+        && fseek(tmp, 0, SEEK_SET) == 0
+        && fread(p, 1, (size_t)len, tmp) == (size_t)len
+    ))
+        goto binary_end;
+    const struct export_header *const h = (const void*)p;
+    const struct export_column *const c = (const void*)(h + 1);
+    if(!(
+        ASSERT_STR_EQ_N(h->magic, EXPORT_MAGIC, 8)
+        && ASSERT_EQ(h->version, EXPORT_VERSION)
+        && ASSERT_EQ(h->byte_order, EXPORT_BYTE_ORDER)
+        && ASSERT_EQ(h->n_rows, 2)
+        && ASSERT_EQ(h->n_columns, 8)
+        && ASSERT_STR_EQ(c[4].name, "timestamp")
+        && ASSERT_EQ(c[4].type, EXPORT_COLUMN_I64)
+        && ASSERT_EQ(c[4].offset % EXPORT_ALIGN, 0)
+        && ASSERT_STR_EQ(c[6].name, "ext_id")
+        && ASSERT_EQ(c[6].type, EXPORT_COLUMN_STR)
+        && ASSERT_EQ(c[6].offset % EXPORT_ALIGN, 0)
+        && ASSERT(c[7].offset + c[7].size <= (u64)len)
+    ))
+        goto binary_end;
+    const i64 *const timestamps = (const void*)(p + c[4].offset);
+    const u64 *const offsets = (const void*)(p + c[6].offset);
+    const char *const ext_ids = (const char*)(offsets + 3);
+    ret = ASSERT_EQ(timestamps[0], 1630796966)
+        && ASSERT_EQ(timestamps[1], -1)
+        && ASSERT_EQ(offsets[0], 0)
+        && ASSERT_EQ(offsets[1], 9)
+        && ASSERT_EQ(offsets[2], 12)
+        && ASSERT_STR_EQ_N(ext_ids, "claim_id0yt0", 12)
+        && ASSERT_EQ(c[6].size, 3 * sizeof(u64) + 12);
+binary_end:
+    free(p);
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
 int main(void) {
     log_set(stderr);
     db_sqlite_init();
@@ -306,5 +607,12 @@ int main(void) {
     ret = RUN(tag_subs) && ret;
     ret = RUN(tag_videos) && ret;
     ret = RUN(watched) && ret;
+    ret = RUN(query_videos) && ret;
+    ret = RUN(query_order_ties) && ret;
+    ret = RUN(bulk) && ret;
+    ret = RUN(lua_worker) && ret;
+    ret = RUN(lua_query) && ret;
+    ret = RUN(lua_prepare) && ret;
+    ret = RUN(export) && ret;
     return !ret;
 }
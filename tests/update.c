@@ -1,6 +1,8 @@
 #include "db.h"
 #include "http_fake.h"
 #include "subs.h"
+#include "update.h"
+#include "youtube_fake.h"
 
 #include "common.h"
 
@@ -390,6 +392,1159 @@ end:
     return ret;
 }
 
+static bool update_cache(void) {
+    const struct http_fake_response responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id0","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }, {
+                    "claim_id": "claim_id4",
+                    "value": {
+                        "title": "v4",
+                        "release_time": "1630796966",
+                        "video": {"duration": 26233}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 2,
+                "total_pages": 1
+            }
+        }),
+    }};
+    /* Same items, but fields which are not stored have changed. */
+    const struct http_fake_response volatile_responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = responses[0].post_data,
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "meta": {"effective_amount": "1.5"},
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }, {
+                    "claim_id": "claim_id4",
+                    "meta": {"effective_amount": "0.25"},
+                    "value": {
+                        "title": "v4",
+                        "release_time": "1630796966",
+                        "video": {"duration": 26233}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 3,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+    };
+    const struct http_fake_server volatile_server = {
+        .n = ARRAY_SIZE(volatile_responses),
+        .responses = volatile_responses,
+    };
+    struct http_client http = http_client_fake_init(&server);
+    struct http_client volatile_http = http_client_fake_init(&volatile_server);
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    /* Unchanged pages are not processed, so deleted videos are not restored
+     * unless the cache is bypassed. */
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_update(&s, &http, 0, -1, 0, 0, 0, NULL)
+        && sqlite3_exec(
+            s.db, "delete from videos where id == 2", NULL, NULL, NULL
+        ) == SQLITE_OK
+        && subs_update(&s, &volatile_http, 0, -1, 0, 0, 0, NULL)
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected0[] = "1 0 lbry 1630796966 26233 claim_id4 id0 v4\n";
+    if(!CHECK_FILE(tmp, expected0))
+        goto end;
+    if(!subs_update(&s, &http, UPDATE_NO_CACHE, -1, 0, 0, 0, NULL))
+        goto end;
+    if(fseek(tmp, SEEK_SET, 0)) {
+        LOG_ERRNO("fseek", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected1[] =
+        "4 0 lbry 1630795115 33675 claim_id6 id0 v6\n"
+        "1 0 lbry 1630796966 26233 claim_id4 id0 v4\n";
+    if(!CHECK_FILE(tmp, expected1))
+        goto end;
+    ret = true;
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_schedule(void) {
+    const struct http_fake_response responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id0","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 1,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+    };
+    struct http_client http = http_client_fake_init(&server);
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    /* The second subscription is not due, so its (missing) response is never
+     * requested. */
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add(&s, SUBS_LBRY, "name1", "id1")
+        && sqlite3_exec(
+            s.db, "update subs set next_update = 1 << 62 where id == 2",
+            NULL, NULL, NULL
+        ) == SQLITE_OK
+        && subs_update(&s, &http, UPDATE_SCHEDULE, -1, 0, 0, 0, NULL)
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] = "1 0 lbry 1630795115 33675 claim_id6 id0 v6\n";
+    if(!CHECK_FILE(tmp, expected))
+        goto end;
+    sqlite3_stmt *stmt = NULL;
+    const char sql[] =
+        "select count(*) from subs"
+        " where next_update > last_update and last_update != 0";
+    sqlite3_prepare_v3(s.db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        goto end;
+    const bool row = sqlite3_step(stmt) == SQLITE_ROW;
+    const int n = row ? sqlite3_column_int(stmt, 0) : -1;
+    if(sqlite3_finalize(stmt) != SQLITE_OK || !row)
+        goto end;
+    if(n != 1) {
+        fprintf(stderr, "%s: unexpected scheduled count: %d\n", __func__, n);
+        goto end;
+    }
+    ret = true;
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_keep_going(void) {
+    const struct http_fake_response responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id1","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 1,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+    };
+    struct http_client http = http_client_fake_init(&server);
+    struct subs s = {.db_path = ":memory:"};
+    struct updater u = {0};
+    bool ret = false, init = false;
+    /* The first subscription has no response and fails, the second one is
+     * still updated. */
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add(&s, SUBS_LBRY, "name1", "id1")
+        && (init = updater_init(&u, &s, &http))
+        && updater_run(&u, UPDATE_KEEP_GOING, -1, 0, 0, 0, NULL)
+    ))
+        goto end;
+    if(u.n_failed != 1) {
+        fprintf(stderr, "%s: unexpected failures: %zu\n", __func__, u.n_failed);
+        goto end;
+    }
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] = "1 0 lbry 1630795115 33675 claim_id6 id1 v6\n";
+    if(!CHECK_FILE(tmp, expected))
+        goto end;
+    sqlite3_stmt *stmt = NULL;
+    const char sql[] =
+        "select count(*) from subs"
+        " where id == 1 and failures == 1 and last_update == 0"
+        " and next_update > cast(strftime('%s', 'now') as integer)";
+    sqlite3_prepare_v3(s.db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        goto end;
+    const bool row = sqlite3_step(stmt) == SQLITE_ROW;
+    const int n = row ? sqlite3_column_int(stmt, 0) : -1;
+    if(sqlite3_finalize(stmt) != SQLITE_OK || !row)
+        goto end;
+    if(n != 1) {
+        fprintf(stderr, "%s: failed subscription not rescheduled\n", __func__);
+        goto end;
+    }
+    ret = true;
+end:
+    if(init)
+        ret = updater_destroy(&u) && ret;
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool stop_poll(void *p) {
+    ++*(int*)p;
+    return false;
+}
+
+static bool update_poll(void) {
+    const struct http_fake_response responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id1","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 1,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+    };
+    struct http_client http = http_client_fake_init(&server);
+    struct subs s = {.db_path = ":memory:"};
+    struct updater u = {0};
+    bool ret = false, init = false;
+    int n_polls = 0;
+    /* The run is stopped after the first subscription, before the second
+     * one (which has no response) would fail. */
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name1", "id1")
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && (init = updater_init(&u, &s, &http))
+    ))
+        goto end;
+    u.poll = stop_poll;
+    u.poll_data = &n_polls;
+    if(!updater_run(&u, 0, -1, 0, 0, 0, NULL))
+        goto end;
+    if(n_polls != 1) {
+        fprintf(stderr, "%s: unexpected polls: %d\n", __func__, n_polls);
+        goto end;
+    }
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] = "1 0 lbry 1630795115 33675 claim_id6 id1 v6\n";
+    if(!CHECK_FILE(tmp, expected))
+        goto end;
+    ret = true;
+end:
+    if(init)
+        ret = updater_destroy(&u) && ret;
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_updater(void) {
+    const struct http_fake_response responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id0","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 1,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+    };
+    struct http_client http = http_client_fake_init(&server);
+    struct subs s = {.db_path = ":memory:"};
+    struct updater u = {0};
+    bool ret = false, init = false;
+    /* State is reused between runs. */
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && (init = updater_init(&u, &s, &http))
+        && updater_run(&u, 0, -1, 0, 0, 0, NULL)
+        && sqlite3_exec(
+            s.db, "delete from videos", NULL, NULL, NULL) == SQLITE_OK
+        && updater_run(&u, UPDATE_NO_CACHE, -1, 0, 0, 0, NULL)
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] = "2 0 lbry 1630795115 33675 claim_id6 id0 v6\n";
+    if(!CHECK_FILE(tmp, expected))
+        goto end;
+    ret = true;
+end:
+    if(init)
+        ret = updater_destroy(&u) && ret;
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_known_deep(void) {
+    const struct http_fake_response responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id0","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }, {
+                    "claim_id": "claim_id4",
+                    "value": {
+                        "title": "v4",
+                        "release_time": "1630796966",
+                        "video": {"duration": 26233}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 2,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+    };
+    struct http_client http = http_client_fake_init(&server);
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    /* Deep updates check existing videos in memory, deleted videos must not
+     * be considered known. */
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_update(&s, &http, 0, 0, 0, 0, 0, NULL)
+        && sqlite3_exec(
+            s.db, "delete from videos where id == 2", NULL, NULL, NULL
+        ) == SQLITE_OK
+        && subs_update(&s, &http, UPDATE_NO_CACHE, 0, 0, 0, 0, NULL)
+        && subs_update(&s, &http, UPDATE_NO_CACHE, 0, 0, 0, 0, NULL)
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] =
+        "3 0 lbry 1630795115 33675 claim_id6 id0 v6\n"
+        "1 0 lbry 1630796966 26233 claim_id4 id0 v4\n";
+    if(!CHECK_FILE(tmp, expected))
+        goto end;
+    ret = true;
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_last_video(void) {
+    const struct http_fake_response responses0[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id0","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }, {
+                    "claim_id": "claim_id5",
+                    "value": {
+                        "title": "v5",
+                        "release_time": "1630795015",
+                        "video": {"duration": 29954}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 2,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_response responses1[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = responses0[0].post_data,
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id7",
+                    "value": {
+                        "title": "v7",
+                        "release_time": "1630796966",
+                        "video": {"duration": 37396}
+                    },
+                    "value_type": "stream"
+                }, {
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }, {
+                    "claim_id": "claim_id5",
+                    "value": {
+                        "title": "v5",
+                        "release_time": "1630795015",
+                        "video": {"duration": 29954}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 3,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server0 = {
+        .n = ARRAY_SIZE(responses0),
+        .responses = responses0,
+    };
+    const struct http_fake_server server1 = {
+        .n = ARRAY_SIZE(responses1),
+        .responses = responses1,
+    };
+    struct http_client http0 = http_client_fake_init(&server0);
+    struct http_client http1 = http_client_fake_init(&server1);
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    /* Processing stops at the newest video of the previous update, so the
+     * deleted video after it is not restored. */
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_update(&s, &http0, 0, -1, 0, 0, 0, NULL)
+        && sqlite3_exec(
+            s.db, "delete from videos where id == 1", NULL, NULL, NULL
+        ) == SQLITE_OK
+        && subs_update(&s, &http1, 0, -1, 0, 0, 0, NULL)
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] =
+        "2 0 lbry 1630795115 33675 claim_id6 id0 v6\n"
+        "3 0 lbry 1630796966 37396 claim_id7 id0 v7\n";
+    if(!CHECK_FILE(tmp, expected))
+        goto end;
+    sqlite3_stmt *stmt = NULL;
+    const char sql[] = "select last_video from subs where id == 1";
+    sqlite3_prepare_v3(s.db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        goto end;
+    const bool row = sqlite3_step(stmt) == SQLITE_ROW;
+    const int last_video = row ? sqlite3_column_int(stmt, 0) : -1;
+    if(sqlite3_finalize(stmt) != SQLITE_OK || !row)
+        goto end;
+    if(!ASSERT_EQ(last_video, 3))
+        goto end;
+    ret = true;
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static int progress_page(sqlite3 *db) {
+    sqlite3_stmt *stmt = NULL;
+    const char sql[] = "select page from update_progress where sub == 1";
+    sqlite3_prepare_v3(db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        return -1;
+    const int r = sqlite3_step(stmt);
+    const int page = r == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    if(sqlite3_finalize(stmt) != SQLITE_OK)
+        return -1;
+    if(r != SQLITE_ROW && r != SQLITE_DONE)
+        return -1;
+    return page;
+}
+
+static bool update_resume(void) {
+#define PAGE(n, id, title, t, total) { \
+        .url = "/", \
+        .method = HTTP_POST, \
+        .post_data = "{" \
+            JSON("method":"claim_search",) \
+            JSON("params":{) \
+                JSON("channel":"id0","order_by":["release_time"],"page":n) \
+            JSON(}) \
+        "}", \
+        .data = "{\"result\":{" \
+            "\"items\":[{" \
+                "\"claim_id\":\"" id "\"," \
+                "\"value\":{" \
+                    "\"title\":\"" title "\"," \
+                    "\"release_time\":\"" t "\"," \
+                    "\"video\":{\"duration\":1}" \
+                "}," \
+                "\"value_type\":\"stream\"" \
+            "}]," \
+            "\"page\":" #n ",\"page_size\":1," \
+            "\"total_items\":3,\"total_pages\":" #total \
+        "}}", \
+    }
+    /* The first update is interrupted by a failure in the third page. */
+    const struct http_fake_response responses0[] = {
+        PAGE(1, "claim_id0", "v0", "1630795115", 3),
+        PAGE(2, "claim_id1", "v1", "1630796966", 3),
+    };
+    /* The first two pages must not be requested again. */
+    const struct http_fake_response responses1[] = {
+        PAGE(3, "claim_id2", "v2", "1630797000", 3),
+    };
+#undef PAGE
+    const struct http_fake_server server0 = {
+        .n = ARRAY_SIZE(responses0),
+        .responses = responses0,
+    };
+    const struct http_fake_server server1 = {
+        .n = ARRAY_SIZE(responses1),
+        .responses = responses1,
+    };
+    struct http_client http0 = http_client_fake_init(&server0);
+    struct http_client http1 = http_client_fake_init(&server1);
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add(&s, SUBS_LBRY, "name1", "id1")
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    log_set(tmp);
+    const bool failed = !subs_update(&s, &http0, 0, 0, 0, 0, 1, (i64[]){1});
+    const char expected_log[] = "serve: unexpected request";
+    const bool logged = CHECK_LOG_N(expected_log, sizeof(expected_log) - 1);
+    log_set(stderr);
+    if(!ASSERT(failed) || !logged || !ASSERT_EQ(progress_page(s.db), 3))
+        goto end;
+    /* Only the interrupted subscription is updated. */
+    if(!subs_update(&s, &http1, UPDATE_RESUME, -1, 0, 0, 0, NULL))
+        goto end;
+    if(!ASSERT_EQ(progress_page(s.db), 0))
+        goto end;
+    if(ftruncate(fileno(tmp), 0) == -1 || fseek(tmp, 0, SEEK_SET)) {
+        LOG_ERRNO("ftruncate", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] =
+        "1 0 lbry 1630795115 1 claim_id0 id0 v0\n"
+        "2 0 lbry 1630796966 1 claim_id1 id0 v1\n"
+        "3 0 lbry 1630797000 1 claim_id2 id0 v2\n";
+    if(!CHECK_FILE(tmp, expected))
+        goto end;
+    ret = true;
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_stats(void) {
+    const struct http_fake_response responses[] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id0","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 1,
+                "total_pages": 1
+            }
+        }),
+    }};
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+    };
+    struct http_client http = http_client_fake_init(&server);
+    struct subs s = {.db_path = ":memory:"};
+    struct update_stats stats = {0};
+    struct updater u = {0};
+    bool ret = false, init = false;
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && (init = updater_init(&u, &s, &http))
+    ))
+        goto end;
+    u.stats = &stats;
+    if(!updater_run(&u, 0, -1, 0, 0, 0, NULL))
+        goto end;
+    const struct update_sub_stats *const sub = stats.subs.p;
+    if(!(
+        ASSERT_EQ(stats.subs.n, sizeof(*sub))
+        && ASSERT_EQ(sub->id, 1)
+        && ASSERT_EQ(sub->n_requests, 1)
+        && ASSERT_EQ(stats.n_requests, 1)
+        && ASSERT_NE(stats.n_statements, 0)
+        && ASSERT(sub->wall <= stats.wall)
+        && ASSERT_EQ(stats.latency[UPDATE_CHANNEL_HTTP][0], 1)
+        && ASSERT_EQ(stats.latency[UPDATE_CHANNEL_YT_DLP][0], 0)
+        && ASSERT_EQ(update_stats_bucket(999999), 0)
+        && ASSERT_EQ(update_stats_bucket(1000000), 1)
+        && ASSERT_EQ(update_stats_bucket(3999999), 2)
+        && ASSERT_EQ(update_stats_bucket(UINT64_MAX), 15)
+        && update_stats_store(&stats, s.db)
+    ))
+        goto end;
+    sqlite3_stmt *stmt = NULL;
+    const char sql[] =
+        "select n_subs, n_requests, json_extract(stats, '$.subs[0].id')"
+        " from update_runs";
+    sqlite3_prepare_v3(s.db, sql, sizeof(sql) - 1, 0, &stmt, NULL);
+    if(!stmt)
+        goto end;
+    const bool row = sqlite3_step(stmt) == SQLITE_ROW;
+    const int n_subs = row ? sqlite3_column_int(stmt, 0) : -1;
+    const int n_requests = row ? sqlite3_column_int(stmt, 1) : -1;
+    const int id = row ? sqlite3_column_int(stmt, 2) : -1;
+    if(sqlite3_finalize(stmt) != SQLITE_OK || !row)
+        goto end;
+    ret = ASSERT_EQ(n_subs, 1) && ASSERT_EQ(n_requests, 1) && ASSERT_EQ(id, 1);
+end:
+    if(init)
+        ret = updater_destroy(&u) && ret;
+    update_stats_destroy(&stats);
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_youtube_fake(void) {
+    const char *const pages[] = {
+        "yt0 v0\nyt1 v1\n",
+        "yt2 v2\n",
+    };
+    const struct youtube_fake_channel channels[] = {{
+        .id = "ch0",
+        .pages = pages,
+        .n_pages = ARRAY_SIZE(pages),
+    }};
+    /* yt1 is unavailable. */
+    const struct youtube_fake_video videos[] = {
+        {.id = "yt0", .timestamp = 1630795115, .duration_seconds = 33675},
+        {.id = "yt2", .timestamp = 1630795116, .duration_seconds = 42},
+    };
+    const struct youtube_fake_server server = {
+        .channels = channels,
+        .n_channels = ARRAY_SIZE(channels),
+        .videos = videos,
+        .n_videos = ARRAY_SIZE(videos),
+        .channel_latency = 1,
+        .info_latency = 1,
+    };
+    struct subs s = {.db_path = ":memory:"};
+    struct update_stats stats = {0};
+    struct updater u = {0};
+    bool ret = false, init = false;
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_YOUTUBE, "name0", "ch0")
+        && (init = updater_init(&u, &s, NULL))
+    ))
+        goto end;
+    u.youtube_backend = update_youtube_fake_init(&server);
+    u.stats = &stats;
+    if(!updater_run(&u, UPDATE_NO_CACHE, -1, 0, 0, 0, NULL))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] =
+        "1 0 youtube 1630795115 33675 yt0 ch0 v0\n"
+        "2 0 youtube 1630795116 42 yt2 ch0 v2\n";
+    /* Two pages plus the empty one which ends the list, three videos. */
+    ret = CHECK_FILE(tmp, expected)
+        && ASSERT_EQ(stats.n_requests, 6)
+        && ASSERT_EQ(stats.latency[UPDATE_CHANNEL_YT_DLP][0], 0);
+end:
+    if(init)
+        ret = updater_destroy(&u) && ret;
+    update_stats_destroy(&stats);
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_youtube_skipped(void) {
+    const char *const pages[] = {"yt1 v1\nyt0 v0\n"};
+    const struct youtube_fake_channel channels[] = {{
+        .id = "ch0",
+        .pages = pages,
+        .n_pages = ARRAY_SIZE(pages),
+    }};
+    const struct youtube_fake_video videos[] = {
+        {.id = "yt0", .timestamp = 1630795115, .duration_seconds = 33675},
+        {.id = "yt1", .timestamp = 1630795116, .duration_seconds = 42},
+    };
+    /* yt1 is unavailable in the first update, e.g. a premiere. */
+    const struct youtube_fake_server servers[] = {{
+        .channels = channels,
+        .n_channels = ARRAY_SIZE(channels),
+        .videos = videos,
+        .n_videos = 1,
+    }, {
+        .channels = channels,
+        .n_channels = ARRAY_SIZE(channels),
+        .videos = videos,
+        .n_videos = ARRAY_SIZE(videos),
+    }};
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    if(!(subs_init(&s) && subs_add(&s, SUBS_YOUTUBE, "name0", "ch0")))
+        goto end;
+    /* The page is the same in both updates, but it must not be cached while
+     * it contains skipped videos. */
+    for(size_t i = 0; i != ARRAY_SIZE(servers); ++i) {
+        struct updater u;
+        if(!updater_init(&u, &s, NULL))
+            goto end;
+        u.youtube_backend = update_youtube_fake_init(servers + i);
+        const bool ok = updater_run(&u, 0, -1, 0, 0, 0, NULL);
+        if(!updater_destroy(&u) || !ok)
+            goto end;
+    }
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] =
+        "1 0 youtube 1630795115 33675 yt0 ch0 v0\n"
+        "2 0 youtube 1630795116 42 yt1 ch0 v1\n";
+    ret = CHECK_FILE(tmp, expected);
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_lua_pages(void) {
+    /* Newest first, like the other backends. */
+    const char src[] =
+        "pages = {\n"
+        "    {\n"
+        "        {ext_id = 'l2', title = 'v2', timestamp = 1630795117},\n"
+        "        {\n"
+        "            ext_id = 'l1', title = 'v1', timestamp = 1630795116,\n"
+        "            duration_seconds = 42,\n"
+        "        },\n"
+        "    },\n"
+        "    {{ext_id = 'l0', title = 'v0', timestamp = 1630795115}},\n"
+        "}\n"
+        "calls = 0\n"
+        "function subs_update(id, ext_id, page)\n"
+        "    assert(id == 1 and ext_id == 'ch0')\n"
+        "    assert(page == calls % 3 + 1, 'unexpected page')\n"
+        "    calls = calls + 1\n"
+        "    return pages[page] or {}\n"
+        "end\n";
+    const char invalid[] =
+        "function subs_update(id, ext_id, page) return items end\n"
+        "items = {{ext_id = 3, title = 'v3'}}\n";
+    /* Metamethods are not used to read the fields. */
+    const char meta[] =
+        "items = {\n"
+        "    setmetatable({title = 'v4'}, {__index = {ext_id = 'l4'}}),\n"
+        "}\n";
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LUA, "name0", "ch0")
+        && subs_lua(&s, src)
+        && subs_update(&s, NULL, 0, -1, 0, 0, 0, NULL)
+        && ASSERT(subs_lua(&s, "assert(calls == 3)"))
+    ))
+        goto end;
+    /* A deep update fetches every page again, without new videos. */
+    if(!(
+        subs_update(&s, NULL, 0, 0, 0, 0, 0, NULL)
+        && ASSERT(subs_lua(&s, "assert(calls == 6)"))
+        && subs_lua(&s, invalid)
+        && ASSERT(!subs_update(&s, NULL, 0, 0, 0, 0, 0, NULL))
+        && subs_lua(&s, meta)
+        && ASSERT(!subs_update(&s, NULL, 0, 0, 0, 0, 0, NULL))
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] =
+        "3 0 lua 1630795115 0 l0 ch0 v0\n"
+        "1 0 lua 1630795116 42 l1 ch0 v1\n"
+        "2 0 lua 1630795117 0 l2 ch0 v2\n";
+    ret = CHECK_FILE(tmp, expected);
+end:
+    ret = subs_destroy(&s) && ret;
+    return ret;
+}
+
+static bool update_http_fake(void) {
+    /* Unrelated responses, to exercise the index. */
+    enum { N = 64 };
+    char urls[N][8];
+    struct http_fake_response responses[N + 2] = {{
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id0","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .data = JSON({
+            "result": {
+                "items": [{
+                    "claim_id": "claim_id6",
+                    "value": {
+                        "title": "v6",
+                        "release_time": "1630795115",
+                        "video": {"duration": 33675}
+                    },
+                    "value_type": "stream"
+                }],
+                "page": 1,
+                "page_size": 20,
+                "total_items": 1,
+                "total_pages": 1
+            }
+        }),
+    }, {
+        .url = "/",
+        .method = HTTP_POST,
+        .post_data = "{"
+            JSON("method":"claim_search",)
+            JSON("params":{)
+                JSON("channel":"id1","order_by":["release_time"],"page":1)
+            JSON(})
+        "}",
+        .fail = true,
+    }};
+    for(size_t i = 0; i != N; ++i) {
+        snprintf(urls[i], sizeof(urls[i]), "/%zu", i);
+        responses[i + 2] = (struct http_fake_response){
+            .url = urls[i],
+            .method = HTTP_GET,
+            .data = "",
+        };
+    }
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+        .jitter = 2,
+        .seed = 1,
+    };
+    struct http_fake f;
+    if(!http_fake_init(&f, &server))
+        return false;
+    struct http_client http = http_fake_client(&f);
+    struct subs s = {.db_path = ":memory:"};
+    bool ret = false;
+    if(!(
+        subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_add(&s, SUBS_LBRY, "name1", "id1")
+        && subs_update(&s, &http, 0, -1, 0, 0, 1, (i64[]){1})
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    log_set(tmp);
+    const bool failed = !subs_update(&s, &http, 0, -1, 0, 0, 1, (i64[]){2});
+    const char expected_log[] = "serve: injected failure: POST /";
+    const bool logged = CHECK_LOG_N(expected_log, sizeof(expected_log) - 1);
+    log_set(stderr);
+    if(!(ASSERT(failed) && logged && ASSERT_EQ(f.n_requests, 2)))
+        goto end;
+    if(ftruncate(fileno(tmp), 0) == -1 || fseek(tmp, 0, SEEK_SET)) {
+        LOG_ERRNO("ftruncate", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] = "1 0 lbry 1630795115 33675 claim_id6 id0 v6\n";
+    ret = CHECK_FILE(tmp, expected);
+end:
+    ret = subs_destroy(&s) && ret;
+    ret = http_fake_destroy(&f) && ret;
+    return ret;
+}
+
+static bool update_loopback(void) {
+#define PAGE(n, id, title, t) { \
+        .url = "/", \
+        .method = HTTP_POST, \
+        .post_data = "{" \
+            JSON("method":"claim_search",) \
+            JSON("params":{) \
+                JSON("channel":"id0","order_by":["release_time"],"page":n) \
+            JSON(}) \
+        "}", \
+        .data = "{\"result\":{" \
+            "\"items\":[{" \
+                "\"claim_id\":\"" id "\"," \
+                "\"value\":{" \
+                    "\"title\":\"" title "\"," \
+                    "\"release_time\":\"" t "\"," \
+                    "\"video\":{\"duration\":1}" \
+                "}," \
+                "\"value_type\":\"stream\"" \
+            "}]," \
+            "\"page\":" #n ",\"page_size\":1," \
+            "\"total_items\":2,\"total_pages\":2" \
+        "}}", \
+    }
+    const struct http_fake_response responses[] = {
+        PAGE(1, "claim_id0", "v0", "1630795115"),
+        PAGE(2, "claim_id1", "v1", "1630796966"),
+    };
+#undef PAGE
+    const struct http_fake_server server = {
+        .n = ARRAY_SIZE(responses),
+        .responses = responses,
+        .latency = 1,
+    };
+    struct http_fake f;
+    if(!http_fake_init(&f, &server))
+        return false;
+    struct http_client http;
+    http_client_init(&http, 0);
+    struct subs s = {.db_path = ":memory:", .url = f.url};
+    bool ret = false;
+    if(!(
+        http_fake_listen(&f)
+        && subs_init(&s)
+        && subs_add(&s, SUBS_LBRY, "name0", "id0")
+        && subs_update(&s, &http, 0, 0, 0, 0, 0, NULL)
+    ))
+        goto end;
+    FILE *const tmp = tmpfile();
+    if(!tmp) {
+        LOG_ERRNO("tmpfile", 0);
+        goto end;
+    }
+    if(!subs_list_videos(&s, 0, tmp))
+        goto end;
+    const char expected[] =
+        "1 0 lbry 1630795115 1 claim_id0 id0 v0\n"
+        "2 0 lbry 1630796966 1 claim_id1 id0 v1\n";
+    ret = CHECK_FILE(tmp, expected) && ASSERT_EQ(f.n_requests, 2);
+end:
+    ret = subs_destroy(&s) && ret;
+    http_client_destroy(&http);
+    ret = http_fake_destroy(&f) && ret;
+    return ret;
+}
+
 int main(void) {
     log_set(stderr);
     db_sqlite_init();
@@ -398,5 +1553,19 @@ int main(void) {
     ret = RUN(update_pages) && ret;
     ret = RUN(update_short) && ret;
     ret = RUN(update_ids) && ret;
+    ret = RUN(update_cache) && ret;
+    ret = RUN(update_schedule) && ret;
+    ret = RUN(update_keep_going) && ret;
+    ret = RUN(update_poll) && ret;
+    ret = RUN(update_updater) && ret;
+    ret = RUN(update_known_deep) && ret;
+    ret = RUN(update_last_video) && ret;
+    ret = RUN(update_resume) && ret;
+    ret = RUN(update_stats) && ret;
+    ret = RUN(update_youtube_fake) && ret;
+    ret = RUN(update_youtube_skipped) && ret;
+    ret = RUN(update_lua_pages) && ret;
+    ret = RUN(update_http_fake) && ret;
+    ret = RUN(update_loopback) && ret;
     return !ret;
 }